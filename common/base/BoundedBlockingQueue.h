@@ -0,0 +1,356 @@
+// Copyright (c) 2013 The claire-common Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef _CLAIRE_COMMON_BASE_BOUNDEDBLOCKINGQUEUE_H_
+#define _CLAIRE_COMMON_BASE_BOUNDEDBLOCKINGQUEUE_H_
+
+#include <stdint.h>
+
+#include <vector>
+#include <utility>
+
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_array.hpp>
+
+#include <claire/common/base/PaddedAtomic.h>
+#include <claire/common/threading/Mutex.h>
+#include <claire/common/threading/Condition.h>
+
+namespace claire {
+
+/// Bounded multi-producer multi-consumer queue on a ring buffer.
+///
+/// Put and Take do not lock while the queue is neither full nor empty,
+/// the mutex is only for threads waiting on it. When full, Put blocks
+/// or drops the newest or the oldest item, by overflow policy.
+///
+/// Ring of Dmitry Vyukov, see
+/// http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+template<typename T>
+class BoundedBlockingQueue : boost::noncopyable
+{
+public:
+    enum OverflowPolicy
+    {
+        kBlock,      // Put waits for room
+        kDropNewest, // Put drops the item to put
+        kDropOldest  // Put drops the item at front
+    };
+
+    /// capacity is rounded up to power of 2
+    explicit BoundedBlockingQueue(size_t capacity, OverflowPolicy policy = kBlock)
+        : policy_(policy),
+          mask_(RoundUp(capacity) - 1),
+          cells_(new Cell[mask_ + 1]),
+          mutex_(),
+          not_empty_(mutex_),
+          not_full_(mutex_),
+          num_takers_(0),
+          num_putters_(0),
+          enqueue_position_(0),
+          dequeue_position_(0),
+          dropped_(0)
+    {
+        for (size_t i = 0; i <= mask_; i++)
+        {
+            cells_[i].sequence.store(i, boost::memory_order_relaxed);
+        }
+    }
+
+    /// Returns false if x is dropped by kDropNewest
+    bool Put(const T& x)
+    {
+        T copy(x);
+        return Put(std::move(copy));
+    }
+
+    bool Put(T&& x)
+    {
+        auto put = PutOne(std::move(x));
+        NotifyTakers(1);
+        return put;
+    }
+
+    /// Puts items in order, waking takers once. Returns number of items
+    /// put, the rest is dropped by kDropNewest.
+    size_t PutBatch(std::vector<T>&& items)
+    {
+        size_t put = 0;
+        for (auto it = items.begin(); it != items.end(); ++it)
+        {
+            if (PutOne(std::move(*it)))
+            {
+                put++;
+            }
+        }
+        items.clear();
+        NotifyTakers(put);
+        return put;
+    }
+
+    /// Returns false at once if full, whatever the policy
+    bool TryPut(T&& x)
+    {
+        if (!Push(x))
+        {
+            return false;
+        }
+        NotifyTakers(1);
+        return true;
+    }
+
+    T Take()
+    {
+        T x;
+        if (!Pop(&x))
+        {
+            WaitNotEmpty(-1);
+            while (!Pop(&x))
+            {
+                WaitNotEmpty(-1);
+            }
+        }
+        NotifyPutters();
+        return x;
+    }
+
+    bool TryTake(T* x)
+    {
+        if (!Pop(x))
+        {
+            return false;
+        }
+        NotifyPutters();
+        return true;
+    }
+
+    /// Appends at most max items to output, waiting up to timeout
+    /// milliseconds for the first one, -1 waits forever. Returns number
+    /// of items taken, 0 if timeout.
+    size_t TakeBatch(std::vector<T>* output, size_t max, int64_t timeout)
+    {
+        size_t taken = 0;
+        T x;
+        while (taken < max && Pop(&x))
+        {
+            output->push_back(std::move(x));
+            taken++;
+        }
+
+        if (taken == 0 && max > 0 && WaitNotEmpty(timeout))
+        {
+            while (taken < max && Pop(&x))
+            {
+                output->push_back(std::move(x));
+                taken++;
+            }
+        }
+
+        if (taken > 0)
+        {
+            NotifyPutters();
+        }
+        return taken;
+    }
+
+    /// Approximate when other threads are putting or taking
+    size_t size() const
+    {
+        auto enqueue = enqueue_position_.load(boost::memory_order_acquire);
+        auto dequeue = dequeue_position_.load(boost::memory_order_acquire);
+        return enqueue > dequeue ? enqueue - dequeue : 0;
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+    OverflowPolicy policy() const { return policy_; }
+
+    /// Items dropped by kDropNewest or kDropOldest since created
+    int64_t dropped() const { return dropped_.load(boost::memory_order_relaxed); }
+
+private:
+    struct Cell
+    {
+        boost::atomic<size_t> sequence;
+        T data;
+    };
+
+    static size_t RoundUp(size_t capacity)
+    {
+        size_t n = 2;
+        while (n < capacity)
+        {
+            n <<= 1;
+        }
+        return n;
+    }
+
+    bool PutOne(T&& x)
+    {
+        while (!Push(x))
+        {
+            switch (policy_)
+            {
+                case kDropNewest:
+                    dropped_.fetch_add(1, boost::memory_order_relaxed);
+                    return false;
+                case kDropOldest:
+                {
+                    T oldest;
+                    if (Pop(&oldest))
+                    {
+                        dropped_.fetch_add(1, boost::memory_order_relaxed);
+                    }
+                    break;
+                }
+                default:
+                    WaitNotFull();
+                    break;
+            }
+        }
+        return true;
+    }
+
+    // x is moved only if pushed
+    bool Push(T& x)
+    {
+        auto position = enqueue_position_.load(boost::memory_order_relaxed);
+        for (;;)
+        {
+            auto& cell = cells_[position & mask_];
+            auto sequence = cell.sequence.load(boost::memory_order_acquire);
+            auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if (diff == 0)
+            {
+                if (enqueue_position_.compare_exchange_weak(position, position+1,
+                                                            boost::memory_order_relaxed))
+                {
+                    cell.data = std::move(x);
+                    cell.sequence.store(position+1, boost::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false; // full
+            }
+            else
+            {
+                position = enqueue_position_.load(boost::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool Pop(T* x)
+    {
+        auto position = dequeue_position_.load(boost::memory_order_relaxed);
+        for (;;)
+        {
+            auto& cell = cells_[position & mask_];
+            auto sequence = cell.sequence.load(boost::memory_order_acquire);
+            auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position+1);
+            if (diff == 0)
+            {
+                if (dequeue_position_.compare_exchange_weak(position, position+1,
+                                                            boost::memory_order_relaxed))
+                {
+                    *x = std::move(cell.data);
+                    cell.data = T(); // releases what item holds now
+                    cell.sequence.store(position + mask_ + 1, boost::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false; // empty
+            }
+            else
+            {
+                position = dequeue_position_.load(boost::memory_order_relaxed);
+            }
+        }
+    }
+
+    // waiters count themselves before checking the ring again, wakers
+    // check the count after changing the ring, so one sees the other
+
+    bool WaitNotEmpty(int64_t timeout)
+    {
+        MutexLock lock(mutex_);
+        num_takers_.fetch_add(1, boost::memory_order_seq_cst);
+
+        auto ready = true;
+        while (size() == 0)
+        {
+            if (timeout < 0)
+            {
+                not_empty_.Wait();
+            }
+            else if (not_empty_.WaitForMilliseconds(timeout))
+            {
+                ready = size() > 0;
+                break;
+            }
+        }
+        num_takers_.fetch_sub(1, boost::memory_order_relaxed);
+        return ready;
+    }
+
+    void WaitNotFull()
+    {
+        MutexLock lock(mutex_);
+        num_putters_.fetch_add(1, boost::memory_order_seq_cst);
+        while (size() > mask_)
+        {
+            not_full_.Wait();
+        }
+        num_putters_.fetch_sub(1, boost::memory_order_relaxed);
+    }
+
+    void NotifyTakers(size_t count)
+    {
+        boost::atomic_thread_fence(boost::memory_order_seq_cst);
+        if (count > 0 && num_takers_.load(boost::memory_order_relaxed) > 0)
+        {
+            MutexLock lock(mutex_);
+            if (count == 1)
+            {
+                not_empty_.Notify();
+            }
+            else
+            {
+                not_empty_.NotifyAll();
+            }
+        }
+    }
+
+    void NotifyPutters()
+    {
+        boost::atomic_thread_fence(boost::memory_order_seq_cst);
+        if (num_putters_.load(boost::memory_order_relaxed) > 0)
+        {
+            MutexLock lock(mutex_);
+            not_full_.NotifyAll();
+        }
+    }
+
+    const OverflowPolicy policy_;
+    const size_t mask_;
+    boost::scoped_array<Cell> cells_;
+
+    Mutex mutex_;
+    Condition not_empty_;
+    Condition not_full_;
+    boost::atomic<int> num_takers_;
+    boost::atomic<int> num_putters_;
+
+    // producers move enqueue_position_, consumers dequeue_position_
+    PaddedAtomic<size_t> enqueue_position_;
+    PaddedAtomic<size_t> dequeue_position_;
+    PaddedAtomic<int64_t> dropped_;
+};
+
+} // namespace claire
+
+#endif // _CLAIRE_COMMON_BASE_BOUNDEDBLOCKINGQUEUE_H_
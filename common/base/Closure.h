@@ -0,0 +1,262 @@
+// Copyright (c) 2013 The claire-common Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef _CLAIRE_COMMON_BASE_CLOSURE_H_
+#define _CLAIRE_COMMON_BASE_CLOSURE_H_
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <new>
+#include <utility>
+#include <typeinfo>
+#include <functional>
+#include <type_traits>
+
+#include <boost/function/function_fwd.hpp>
+
+namespace claire {
+
+/// Move-only void() callable, like boost::function but never copied.
+///
+/// Functors up to kInlineSize bytes, like boost::bind of a member
+/// function with a shared_ptr and a few arguments, are stored inline,
+/// larger ones are allocated once and only the pointer moves after.
+/// An empty boost::function or std::function, or a null function pointer,
+/// makes an empty Closure.
+class Closure
+{
+public:
+    static const size_t kInlineSize = 64;
+
+    Closure() : ops_(NULL) {}
+
+    template<typename F,
+             typename = typename std::enable_if<
+                 !std::is_same<typename std::decay<F>::type, Closure>::value>::type>
+    Closure(F&& f)
+        : ops_(NULL)
+    {
+        if (IsEmpty(f))
+        {
+            return ;
+        }
+
+        typedef typename std::decay<F>::type Functor;
+        typedef typename std::conditional<IsInline<Functor>::value,
+                                          InlineOps<Functor>,
+                                          HeapOps<Functor> >::type Ops;
+        Ops::Init(&storage_, std::forward<F>(f));
+        ops_ = &Ops::kOps;
+    }
+
+    Closure(Closure&& other)
+        : ops_(other.ops_)
+    {
+        if (ops_)
+        {
+            Relocate(&other.storage_, &storage_);
+            other.ops_ = NULL;
+        }
+    }
+
+    Closure& operator=(Closure&& other)
+    {
+        if (this != &other)
+        {
+            reset();
+            if (other.ops_)
+            {
+                ops_ = other.ops_;
+                Relocate(&other.storage_, &storage_);
+                other.ops_ = NULL;
+            }
+        }
+        return *this;
+    }
+
+    ~Closure()
+    {
+        reset();
+    }
+
+    Closure(const Closure&) = delete;
+    Closure& operator=(const Closure&) = delete;
+
+    void operator()()
+    {
+        assert(ops_);
+        ops_->invoke(&storage_);
+    }
+
+    explicit operator bool() const { return ops_ != NULL; }
+
+    void reset()
+    {
+        if (ops_)
+        {
+            if (ops_->destroy)
+            {
+                ops_->destroy(&storage_);
+            }
+            ops_ = NULL;
+        }
+    }
+
+    /// Type of the stored functor, typeid(void) if empty
+    const std::type_info& target_type() const
+    {
+        return ops_ ? ops_->type() : typeid(void);
+    }
+
+private:
+    typedef typename std::aligned_storage<kInlineSize>::type Storage;
+
+    template<typename F>
+    static bool IsEmpty(const F&) { return false; }
+
+    template<typename Signature>
+    static bool IsEmpty(const boost::function<Signature>& f) { return f.empty(); }
+
+    template<typename Signature>
+    static bool IsEmpty(const std::function<Signature>& f) { return !f; }
+
+    template<typename R>
+    static bool IsEmpty(R (*f)()) { return f == NULL; }
+
+    // relocate and destroy are NULL for trivially copyable functors,
+    // like boost::bind of raw pointers and values, moved by memcpy
+    struct Ops
+    {
+        void (*invoke)(Storage* storage);
+        void (*relocate)(Storage* from, Storage* to); // moves to, destroys from
+        void (*destroy)(Storage* storage);
+        const std::type_info& (*type)();
+    };
+
+    void Relocate(Storage* from, Storage* to)
+    {
+        if (ops_->relocate)
+        {
+            ops_->relocate(from, to);
+        }
+        else
+        {
+            memcpy(to, from, sizeof(Storage));
+        }
+    }
+
+    template<typename Functor>
+    struct IsInline
+    {
+        static const bool value = sizeof(Functor) <= sizeof(Storage)
+            && std::alignment_of<Functor>::value <= std::alignment_of<Storage>::value;
+    };
+
+    template<typename Functor>
+    struct IsTrivial
+    {
+        static const bool value = std::is_trivially_copyable<Functor>::value
+            && std::is_trivially_destructible<Functor>::value;
+    };
+
+    template<typename Functor>
+    struct InlineOps
+    {
+        template<typename F>
+        static void Init(Storage* storage, F&& f)
+        {
+            new (storage) Functor(std::forward<F>(f));
+        }
+
+        static Functor* Get(Storage* storage)
+        {
+            return reinterpret_cast<Functor*>(storage);
+        }
+
+        static void Invoke(Storage* storage)
+        {
+            (*Get(storage))();
+        }
+
+        static void Relocate(Storage* from, Storage* to)
+        {
+            new (to) Functor(std::move(*Get(from)));
+            Get(from)->~Functor();
+        }
+
+        static void Destroy(Storage* storage)
+        {
+            Get(storage)->~Functor();
+        }
+
+        static const std::type_info& Type()
+        {
+            return typeid(Functor);
+        }
+
+        static const Ops kOps;
+    };
+
+    template<typename Functor>
+    struct HeapOps
+    {
+        template<typename F>
+        static void Init(Storage* storage, F&& f)
+        {
+            *reinterpret_cast<Functor**>(storage) = new Functor(std::forward<F>(f));
+        }
+
+        static Functor* Get(Storage* storage)
+        {
+            return *reinterpret_cast<Functor**>(storage);
+        }
+
+        static void Invoke(Storage* storage)
+        {
+            (*Get(storage))();
+        }
+
+        static void Relocate(Storage* from, Storage* to)
+        {
+            *reinterpret_cast<Functor**>(to) = Get(from);
+        }
+
+        static void Destroy(Storage* storage)
+        {
+            delete Get(storage);
+        }
+
+        static const std::type_info& Type()
+        {
+            return typeid(Functor);
+        }
+
+        static const Ops kOps;
+    };
+
+    Storage storage_;
+    const Ops* ops_;
+};
+
+template<typename Functor>
+const Closure::Ops Closure::InlineOps<Functor>::kOps = {
+    &Closure::InlineOps<Functor>::Invoke,
+    Closure::IsTrivial<Functor>::value ? NULL : &Closure::InlineOps<Functor>::Relocate,
+    Closure::IsTrivial<Functor>::value ? NULL : &Closure::InlineOps<Functor>::Destroy,
+    &Closure::InlineOps<Functor>::Type
+};
+
+template<typename Functor>
+const Closure::Ops Closure::HeapOps<Functor>::kOps = {
+    &Closure::HeapOps<Functor>::Invoke,
+    &Closure::HeapOps<Functor>::Relocate,
+    &Closure::HeapOps<Functor>::Destroy,
+    &Closure::HeapOps<Functor>::Type
+};
+
+} // namespace claire
+
+#endif // _CLAIRE_COMMON_BASE_CLOSURE_H_
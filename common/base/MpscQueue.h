@@ -0,0 +1,94 @@
+// Copyright (c) 2013 The claire-common Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef _CLAIRE_COMMON_BASE_MPSCQUEUE_H_
+#define _CLAIRE_COMMON_BASE_MPSCQUEUE_H_
+
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace claire {
+
+/// Link of element in MpscQueue, element type derives from it
+struct MpscQueueHook
+{
+    MpscQueueHook() : mpsc_next(NULL) {}
+
+    boost::atomic<MpscQueueHook*> mpsc_next;
+};
+
+/// Intrusive lock-free multi-producer single-consumer queue,
+/// by Dmitry Vyukov's algorithm.
+///
+/// Push is wait-free and safe from any thread, Pop must be called by
+/// one thread only. Queue does not own the elements.
+template<typename T>
+class MpscQueue : boost::noncopyable
+{
+public:
+    MpscQueue()
+        : head_(&stub_),
+          tail_(&stub_)
+    {}
+
+    void Push(T* element)
+    {
+        Push(static_cast<MpscQueueHook*>(element));
+    }
+
+    /// Returns NULL if queue is empty, or the element pushed last is
+    /// not linked yet, it is visible after its Push returns.
+    T* Pop()
+    {
+        auto tail = tail_;
+        auto next = tail->mpsc_next.load(boost::memory_order_acquire);
+        if (tail == &stub_)
+        {
+            if (!next)
+            {
+                return NULL;
+            }
+            tail_ = next;
+            tail = next;
+            next = next->mpsc_next.load(boost::memory_order_acquire);
+        }
+
+        if (next)
+        {
+            tail_ = next;
+            return static_cast<T*>(tail);
+        }
+
+        if (tail != head_.load())
+        {
+            return NULL;
+        }
+
+        // tail is the last one, put stub behind it so it can be taken
+        Push(&stub_);
+        next = tail->mpsc_next.load(boost::memory_order_acquire);
+        if (next)
+        {
+            tail_ = next;
+            return static_cast<T*>(tail);
+        }
+        return NULL;
+    }
+
+private:
+    void Push(MpscQueueHook* hook)
+    {
+        hook->mpsc_next.store(NULL, boost::memory_order_relaxed);
+        auto prev = head_.exchange(hook);
+        prev->mpsc_next.store(hook, boost::memory_order_release);
+    }
+
+    boost::atomic<MpscQueueHook*> head_; // pushed to
+    MpscQueueHook* tail_; // popped from, consumer only
+    MpscQueueHook stub_;
+};
+
+} // namespace claire
+
+#endif // _CLAIRE_COMMON_BASE_MPSCQUEUE_H_
@@ -0,0 +1,41 @@
+// Copyright (c) 2013 The claire-common Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef _CLAIRE_COMMON_BASE_PADDEDATOMIC_H_
+#define _CLAIRE_COMMON_BASE_PADDEDATOMIC_H_
+
+#include <stddef.h>
+
+#include <boost/atomic.hpp>
+
+namespace claire {
+
+static const size_t kCacheLineSize = 64;
+
+struct CacheLinePadding
+{
+    char padding[kCacheLineSize];
+};
+
+/// boost::atomic on a cache line of its own, for counters written by
+/// different threads side by side, e.g. two ends of a queue.
+///
+/// A full line of padding is put before and after the value rather than
+/// aligning it, as operator new ignores alignas before c++17 and the
+/// owner may be allocated anywhere.
+template<typename T>
+class PaddedAtomic : private CacheLinePadding, public boost::atomic<T>
+{
+public:
+    explicit PaddedAtomic(T value)
+        : boost::atomic<T>(value)
+    {}
+
+private:
+    char padding_after_[kCacheLineSize - sizeof(boost::atomic<T>) % kCacheLineSize];
+};
+
+} // namespace claire
+
+#endif // _CLAIRE_COMMON_BASE_PADDEDATOMIC_H_
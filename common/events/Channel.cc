@@ -22,6 +22,7 @@ Channel::Channel(EventLoop* loop, int fd__)
       revents_(0),
       context_(-1),
       priority_(Priority::kNormal),
+      edge_triggered_(false),
       tied_(false),
       event_handling_(false)
 {}
@@ -34,6 +35,15 @@ void Channel::tie(const boost::shared_ptr<void>& ptr)
     tied_ = true;
 }
 
+void Channel::set_edge_triggered(bool on)
+{
+    edge_triggered_ = on;
+    if (!IsNoneEvent())
+    {
+        Update();
+    }
+}
+
 void Channel::Update()
 {
     loop_->UpdateChannel(this);
@@ -6,6 +6,7 @@
 #define _CLAIRE_COMMON_EVENTS_CHANNEL_H_
 
 #include <string>
+#include <typeinfo>
 
 #include <boost/any.hpp>
 #include <boost/function.hpp>
@@ -28,12 +29,15 @@ class Channel : boost::noncopyable
 public:
     typedef boost::function<void()> EventCallback;
 
+    /// Dispatch order of channels ready in the same poll, channels
+    /// of a higher class are handled first, in poll order within a class.
     enum class Priority : char
     {
-        kLow,
-        kNormal,
-        kHigh
+        kLow,    // signals, background work
+        kNormal, // data connections, default
+        kHigh    // wakeup, timers and control traffic like heartbeats
     };
+    static const int kNumPriorities = 3;
 
     Channel(EventLoop* loop, int fd);
     ~Channel();
@@ -75,9 +79,26 @@ public:
     const boost::any& context() const { return context_; }
     void set_context(const boost::any& context__) { context_ = context__; }
 
+    /// Type of the read callback, or write callback if no read one,
+    /// tells who owns the channel in logs
+    const std::type_info& owner_type() const
+    {
+        return read_callback_ ? read_callback_.target_type() : write_callback_.target_type();
+    }
+
     Priority priority() const { return priority_; }
     void set_priority(Priority priority__) { priority_ = priority__; }
 
+    /// Edge-triggered channel is notified only when it becomes ready,
+    /// its callbacks must drain the fd until EAGAIN, or call Rearm()
+    /// to be notified again if they stop early.
+    bool edge_triggered() const { return edge_triggered_; }
+    void set_edge_triggered(bool on);
+
+    /// Registers the events again, so an edge-triggered channel which is
+    /// still ready is notified in next poll.
+    void Rearm() { Update(); }
+
     bool IsNoneEvent() const { return events_ == kNoneEvent; }
     bool IsWriting() const { return (events_ & kWriteEvent); }
 
@@ -100,6 +121,7 @@ private:
     int revents_;
     boost::any context_; // used by Poller
     Priority priority_;
+    bool edge_triggered_;
 
     boost::weak_ptr<void> tie_;
     bool tied_;
@@ -0,0 +1,481 @@
+// Copyright (c) 2013 The claire-common Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef _CLAIRE_COMMON_EVENTS_COROUTINE_H_
+#define _CLAIRE_COMMON_EVENTS_COROUTINE_H_
+
+// Coroutines on EventLoop, only for code built with -std=c++20, the
+// library itself stays C++11 and does not include this header.
+//
+//   Task<int> Handle(EventLoop* loop)
+//   {
+//       co_await Sleep(loop, 100);
+//       co_return 42;
+//   }
+//
+//   Spawn(loop, Handle(loop));
+//
+// A coroutine runs on the loop it is spawned on, awaiters resume it in
+// that loop thread, so its state needs no lock.
+
+#if !defined(__cpp_impl_coroutine)
+#error "claire/common/events/Coroutine.h requires C++20 coroutines, build with -std=c++20"
+#endif
+
+#include <stdlib.h>
+
+#include <atomic>
+#include <coroutine>
+#include <vector>
+#include <exception>
+#include <utility>
+
+#include <claire/common/events/EventLoop.h>
+#include <claire/common/logging/Logging.h>
+
+namespace claire {
+
+/// Recycles coroutine frames in the thread freeing them, which is the
+/// loop they run on, so frames of a loop come from its own free lists.
+class FramePool
+{
+public:
+    static const size_t kClassSize = 64;
+    static const size_t kNumClasses = 32; // frames up to 2KB are pooled
+    static const int kMaxFreeFrames = 256; // per class and thread
+
+    static void* Allocate(size_t size)
+    {
+        auto index = ClassOf(size);
+        if (index >= kNumClasses)
+        {
+            return ::operator new(size);
+        }
+
+        auto& list = lists().free[index];
+        if (list.head)
+        {
+            auto frame = list.head;
+            list.head = frame->next;
+            list.count--;
+            return frame;
+        }
+        return ::operator new((index+1) * kClassSize);
+    }
+
+    static void Free(void* frame, size_t size)
+    {
+        auto index = ClassOf(size);
+        if (index >= kNumClasses)
+        {
+            ::operator delete(frame);
+            return ;
+        }
+
+        auto& list = lists().free[index];
+        if (list.count >= kMaxFreeFrames)
+        {
+            ::operator delete(frame);
+            return ;
+        }
+
+        auto node = static_cast<Node*>(frame);
+        node->next = list.head;
+        list.head = node;
+        list.count++;
+    }
+
+private:
+    struct Node
+    {
+        Node* next;
+    };
+
+    struct FreeList
+    {
+        Node* head = nullptr;
+        int count = 0;
+    };
+
+    struct Lists
+    {
+        ~Lists()
+        {
+            for (size_t i = 0; i < kNumClasses; i++)
+            {
+                while (free[i].head)
+                {
+                    auto node = free[i].head;
+                    free[i].head = node->next;
+                    ::operator delete(node);
+                }
+            }
+        }
+
+        FreeList free[kNumClasses];
+    };
+
+    static size_t ClassOf(size_t size)
+    {
+        return (size - 1) / kClassSize;
+    }
+
+    static Lists& lists()
+    {
+        static thread_local Lists lists;
+        return lists;
+    }
+};
+
+namespace detail {
+
+struct PooledPromise
+{
+    static void* operator new(size_t size)
+    {
+        return FramePool::Allocate(size);
+    }
+
+    static void operator delete(void* frame, size_t size)
+    {
+        FramePool::Free(frame, size);
+    }
+};
+
+struct TaskPromiseBase : PooledPromise
+{
+    struct FinalAwaiter
+    {
+        bool await_ready() noexcept { return false; }
+
+        template<typename Promise>
+        void await_suspend(std::coroutine_handle<Promise> handle) noexcept
+        {
+            // the awaiting coroutine is suspended already, or it will not
+            // suspend at all, see AwaitTask
+            auto& promise = handle.promise();
+            if (promise.finished.exchange(true, std::memory_order_acq_rel))
+            {
+                promise.continuation.resume();
+            }
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() noexcept
+    {
+        exception = std::current_exception();
+    }
+
+    std::coroutine_handle<> continuation;
+    std::exception_ptr exception;
+    std::atomic<bool> finished{false}; // set by the first of task and its awaiter
+};
+
+// Starts task, returns false if it finished at once so the awaiting one
+// goes on without suspending. Unlike symmetric transfer it does not grow
+// the stack in loops of synchronous calls without tail call optimization.
+template<typename Promise>
+bool AwaitTask(std::coroutine_handle<Promise> task, std::coroutine_handle<> awaiting)
+{
+    task.promise().continuation = awaiting;
+    task.resume();
+    return !task.promise().finished.exchange(true, std::memory_order_acq_rel);
+}
+
+} // namespace detail
+
+/// Lazy coroutine, starts when awaited or spawned.
+template<typename T = void>
+class Task
+{
+public:
+    struct promise_type : detail::TaskPromiseBase
+    {
+        Task get_return_object()
+        {
+            return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        template<typename U>
+        void return_value(U&& value__)
+        {
+            value = std::forward<U>(value__);
+        }
+
+        T value{};
+    };
+
+    Task(Task&& other) noexcept
+        : handle_(std::exchange(other.handle_, nullptr))
+    {}
+
+    ~Task()
+    {
+        if (handle_)
+        {
+            handle_.destroy();
+        }
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    bool await_ready() const noexcept { return false; }
+
+    bool await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        return detail::AwaitTask(handle_, awaiting);
+    }
+
+    T await_resume()
+    {
+        if (handle_.promise().exception)
+        {
+            std::rethrow_exception(handle_.promise().exception);
+        }
+        return std::move(handle_.promise().value);
+    }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> handle__)
+        : handle_(handle__)
+    {}
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+template<>
+class Task<void>
+{
+public:
+    struct promise_type : detail::TaskPromiseBase
+    {
+        Task get_return_object()
+        {
+            return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        void return_void() {}
+    };
+
+    Task(Task&& other) noexcept
+        : handle_(std::exchange(other.handle_, nullptr))
+    {}
+
+    ~Task()
+    {
+        if (handle_)
+        {
+            handle_.destroy();
+        }
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    bool await_ready() const noexcept { return false; }
+
+    bool await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        return detail::AwaitTask(handle_, awaiting);
+    }
+
+    void await_resume()
+    {
+        if (handle_.promise().exception)
+        {
+            std::rethrow_exception(handle_.promise().exception);
+        }
+    }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> handle__)
+        : handle_(handle__)
+    {}
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+namespace detail {
+
+// owns itself, destroyed when the spawned task finishes
+struct Detached
+{
+    struct promise_type : PooledPromise
+    {
+        Detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+
+        void unhandled_exception() noexcept
+        {
+            try
+            {
+                throw;
+            }
+            catch (const std::exception& e)
+            {
+                LOG(FATAL) << "Uncaught exception in coroutine: " << e.what();
+            }
+            catch (...)
+            {
+                LOG(FATAL) << "Uncaught unknown exception in coroutine";
+            }
+        }
+    };
+};
+
+inline Detached RunDetached(Task<void> task)
+{
+    co_await task;
+}
+
+struct SpawnTask
+{
+    void operator()()
+    {
+        RunDetached(std::move(task));
+    }
+
+    Task<void> task;
+};
+
+} // namespace detail
+
+/// Starts task in loop, immediately if called in the loop thread.
+/// Safe to call from other threads.
+inline void Spawn(EventLoop* loop, Task<void>&& task)
+{
+    loop->Run(detail::SpawnTask{std::move(task)});
+}
+
+/// co_await Sleep(loop, ms) resumes in loop after ms milliseconds
+class Sleep
+{
+public:
+    Sleep(EventLoop* loop__, int milliseconds__)
+        : loop_(loop__),
+          milliseconds_(milliseconds__)
+    {}
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        loop_->RunAfter(milliseconds_, handle);
+    }
+
+    void await_resume() noexcept {}
+
+private:
+    EventLoop* loop_;
+    int milliseconds_;
+};
+
+/// co_await SwitchTo(loop) resumes in loop thread after its pending tasks,
+/// like moving the rest of coroutine into loop->Post
+class SwitchTo
+{
+public:
+    explicit SwitchTo(EventLoop* loop__)
+        : loop_(loop__)
+    {}
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        loop_->Post(handle);
+    }
+
+    void await_resume() noexcept {}
+
+private:
+    EventLoop* loop_;
+};
+
+/// co_await WhenAll(tasks) runs tasks at the same time in the current
+/// thread, like rpc calls fanned out, resumes when all are finished and
+/// rethrows the first exception of them.
+class WhenAll
+{
+public:
+    explicit WhenAll(std::vector<Task<void> >&& tasks__)
+        : tasks_(std::move(tasks__)),
+          remaining_(0)
+    {}
+
+    bool await_ready() const noexcept { return tasks_.empty(); }
+
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        handle_ = handle;
+
+        // one more, so tasks finished inside the loop do not resume
+        remaining_ = tasks_.size() + 1;
+        for (auto it = tasks_.begin(); it != tasks_.end(); ++it)
+        {
+            Run(std::move(*it), this);
+        }
+        return --remaining_ > 0;
+    }
+
+    void await_resume()
+    {
+        if (exception_)
+        {
+            std::rethrow_exception(exception_);
+        }
+    }
+
+private:
+    static detail::Detached Run(Task<void> task, WhenAll* parent)
+    {
+        try
+        {
+            co_await task;
+        }
+        catch (...)
+        {
+            if (!parent->exception_)
+            {
+                parent->exception_ = std::current_exception();
+            }
+        }
+
+        if (--parent->remaining_ == 0)
+        {
+            parent->handle_.resume();
+        }
+    }
+
+    std::vector<Task<void> > tasks_;
+    size_t remaining_;
+    std::coroutine_handle<> handle_;
+    std::exception_ptr exception_;
+};
+
+/// Resumes handle in loop, at once if already in its thread.
+/// For awaiters completed by callbacks of other threads.
+inline void ResumeIn(EventLoop* loop, std::coroutine_handle<> handle)
+{
+    if (!loop || loop->IsInLoopThread())
+    {
+        handle.resume();
+    }
+    else
+    {
+        loop->Post(handle);
+    }
+}
+
+} // namespace claire
+
+#endif // _CLAIRE_COMMON_EVENTS_COROUTINE_H_
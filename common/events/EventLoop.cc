@@ -5,6 +5,7 @@
 #include <claire/common/events/EventLoop.h>
 
 #include <signal.h>
+#include <pthread.h>
 #include <sys/eventfd.h>
 
 #include <algorithm>
@@ -13,11 +14,18 @@
 
 #include <claire/common/events/Poller.h>
 #include <claire/common/events/Channel.h>
-#include <claire/common/events/poller/EPollPoller.h>
 #include <claire/common/events/TimeoutQueue.h>
+#include <claire/common/base/StackTrace.h>
 #include <claire/common/logging/Logging.h>
+#include <claire/common/metrics/Histogram.h>
+#include <claire/common/strings/StringPrintf.h>
 #include <claire/common/threading/ThisThread.h>
 
+DEFINE_int32(eventloop_slow_callback_ms, 100,
+             "logs channel callbacks and tasks of EventLoop running longer than it, 0 disables");
+DEFINE_int32(eventloop_busy_poll_us, 0,
+             "EventLoop spins polling for this long after activity before blocking, 0 disables");
+
 namespace claire {
 
 namespace {
@@ -25,13 +33,16 @@ namespace {
 __thread EventLoop * tLoopInThisThread = NULL;
 const int64_t kPollTimeMs = 10;
 
-struct Cmp
+// PendingTask nodes taken by this thread for posting, linked by mpsc_next
+__thread MpscQueueHook* t_free_tasks = NULL;
+const int kMaxFreeTasks = 1024;
+
+pthread_key_t CreateFreeTasksKey(void (*destructor)(void*))
 {
-    bool operator()(const Channel* lhs, const Channel* rhs)
-    {
-        return static_cast<int>(lhs->priority()) > static_cast<int>(rhs->priority());
-    }
-};
+    pthread_key_t key;
+    ::pthread_key_create(&key, destructor);
+    return key;
+}
 
 int CreateEventfd()
 {
@@ -44,6 +55,23 @@ int CreateEventfd()
     return fd;
 }
 
+Histogram* GetLoopHistogram(pid_t tid, const char* name, int maximum)
+{
+    return Histogram::FactoryGet(StringPrintf("claire.EventLoop.%d.%s", tid, name),
+                                 1, maximum, 50);
+}
+
+// counter is in milliseconds, keeps microseconds less than one
+void AddTime(Counter* counter, int64_t* remainder, int64_t microseconds)
+{
+    *remainder += microseconds;
+    if (*remainder >= 1000)
+    {
+        counter->Add(static_cast<int>(*remainder / 1000));
+        *remainder %= 1000;
+    }
+}
+
 #pragma GCC diagnostic ignored "-Wold-style-cast"
 class IgnoreSigPipe
 {
@@ -64,11 +92,35 @@ EventLoop::EventLoop()
     : looping_(false),
       quit_(false),
       tid_(ThisThread::tid()),
-      poller_(new EPollPoller(this)), // FIXME
+      poller_(Poller::NewDefaultPoller(this)),
       timeouts_(new TimeoutQueue(this)), // since 2.6.28
       wakeup_fd_(CreateEventfd()),
       wakeup_channel_(new Channel(this, wakeup_fd_)),
-      current_active_channel_(NULL)
+      prioritized_channels_(Channel::kNumPriorities),
+      current_active_channel_(NULL),
+      free_tasks_(NULL),
+      num_free_tasks_(0),
+      wakeup_pending_(false),
+      post_counter_("claire.EventLoop.posts"),
+      wakeup_counter_("claire.EventLoop.wakeups"),
+      coalesced_wakeup_counter_("claire.EventLoop.coalesced_wakeups"),
+      poll_time_histogram_(GetLoopHistogram(tid_, "PollTime", 1000000)),
+      callback_time_histogram_(GetLoopHistogram(tid_, "CallbackTime", 1000000)),
+      task_time_histogram_(GetLoopHistogram(tid_, "TaskTime", 1000000)),
+      ready_channels_histogram_(GetLoopHistogram(tid_, "ReadyChannels", 10000)),
+      pending_tasks_histogram_(GetLoopHistogram(tid_, "PendingTasks", 10000)),
+      poll_time_counter_("claire.EventLoop.poll_ms"),
+      callback_time_counter_("claire.EventLoop.callback_ms"),
+      task_time_counter_("claire.EventLoop.task_ms"),
+      slow_callback_counter_("claire.EventLoop.slow_callbacks"),
+      poll_time_remainder_(0),
+      callback_time_remainder_(0),
+      task_time_remainder_(0),
+      busy_poll_us_(FLAGS_eventloop_busy_poll_us),
+      spin_poll_counter_("claire.EventLoop.spin_polls"),
+      idle_spin_poll_counter_("claire.EventLoop.idle_spin_polls"),
+      blocking_poll_counter_("claire.EventLoop.blocking_polls"),
+      busy_window_time_(0)
 {
     LOG(DEBUG) << "EventLoop create " << this << "in thread " << tid_;
     if (tLoopInThisThread)
@@ -83,6 +135,7 @@ EventLoop::EventLoop()
 
     wakeup_channel_->set_read_callback(
         boost::bind(&EventLoop::OnWakeup, this));
+    wakeup_channel_->set_priority(Channel::Priority::kHigh);
     wakeup_channel_->EnableReading();
 }
 
@@ -92,6 +145,19 @@ EventLoop::~EventLoop()
                << " destructs in thread " << ThisThread::tid();
     ::close(wakeup_fd_);
 
+    PendingTask* task;
+    while ((task = pending_tasks_.Pop()) != NULL)
+    {
+        delete task;
+    }
+
+    while (free_tasks_)
+    {
+        task = static_cast<PendingTask*>(free_tasks_);
+        free_tasks_ = task->mpsc_next.load(boost::memory_order_relaxed);
+        delete task;
+    }
+
     DCHECK(tLoopInThisThread == this);
     tLoopInThisThread = NULL;
 }
@@ -104,57 +170,163 @@ void EventLoop::loop()
     looping_ = true;
     LOG(INFO) << "EventLoop " << this << " start looping";
 
+    auto poll_start = Timestamp::Now();
+    busy_window_start_ = poll_start;
     while(!quit_)
     {
         active_channels_.clear();
-        poller_->poll(kPollTimeMs, &active_channels_);
-
-        Cmp cmp;
-        sort(active_channels_.begin(), active_channels_.end(), cmp); // FIXME
+        auto spinning = busy_poll_us_ > 0
+            && TimeDifference(poll_start, last_active_) < busy_poll_us_;
+        poller_->poll(spinning ? 0 : kPollTimeMs, &active_channels_);
+        auto dispatch_start = Timestamp::Now();
 
-        for (auto it = active_channels_.begin(); it != active_channels_.end(); ++it)
+        if (!active_channels_.empty())
         {
-            current_active_channel_ = *it;
-            (*it)->OnEvent();
+            last_active_ = dispatch_start;
+        }
+        if (spinning)
+        {
+            spin_poll_counter_.Increment();
+            if (active_channels_.empty())
+            {
+                idle_spin_poll_counter_.Increment();
+            }
+        }
+        else
+        {
+            blocking_poll_counter_.Increment();
         }
-        current_active_channel_ = NULL;
 
+        callback_start_ = dispatch_start;
+        DispatchActiveChannels();
+        auto tasks_start = Timestamp::Now();
+
+        callback_start_ = tasks_start;
         RunPendingTasks();
+        auto end = Timestamp::Now();
+
+        // loop is saturated if little time is spent in poll
+        auto poll_time = TimeDifference(dispatch_start, poll_start);
+        auto callback_time = TimeDifference(tasks_start, dispatch_start);
+        auto task_time = TimeDifference(end, tasks_start);
+        poll_time_histogram_->Add(static_cast<int>(poll_time));
+        callback_time_histogram_->Add(static_cast<int>(callback_time));
+        task_time_histogram_->Add(static_cast<int>(task_time));
+        ready_channels_histogram_->Add(static_cast<int>(active_channels_.size()));
+        AddTime(&poll_time_counter_, &poll_time_remainder_, poll_time);
+        AddTime(&callback_time_counter_, &callback_time_remainder_, callback_time);
+        AddTime(&task_time_counter_, &task_time_remainder_, task_time);
+
+        busy_window_time_ += callback_time + task_time;
+        auto window = TimeDifference(end, busy_window_start_);
+        if (window >= Timestamp::kMicroSecondsPerSecond)
+        {
+            load_.busy_permille.store(static_cast<int>(busy_window_time_*1000/window),
+                                      boost::memory_order_relaxed);
+            busy_window_start_ = end;
+            busy_window_time_ = 0;
+        }
+        poll_start = end;
     }
 
     LOG(INFO) << "EventLoop " << this << " stop looping";
     looping_ = false;
 }
 
-void EventLoop::quit()
+void EventLoop::DispatchActiveChannels()
 {
-    quit_ = true; // FIXME
-    if (!IsInLoopThread())
+    bool mixed = false;
+    for (auto it = active_channels_.begin(); it != active_channels_.end(); ++it)
     {
-        Wakeup();
+        if ((*it)->priority() != Channel::Priority::kNormal)
+        {
+            mixed = true;
+            break;
+        }
     }
+
+    if (!mixed)
+    {
+        for (auto it = active_channels_.begin(); it != active_channels_.end(); ++it)
+        {
+            DispatchChannel(*it);
+        }
+        current_active_channel_ = NULL;
+        return ;
+    }
+
+    // bucket by class instead of sorting, poll order is kept in a class
+    for (auto it = active_channels_.begin(); it != active_channels_.end(); ++it)
+    {
+        prioritized_channels_[static_cast<int>((*it)->priority())].push_back(*it);
+    }
+
+    for (int i = Channel::kNumPriorities-1; i >= 0; i--)
+    {
+        auto& channels = prioritized_channels_[i];
+        for (auto it = channels.begin(); it != channels.end(); ++it)
+        {
+            DispatchChannel(*it);
+        }
+        channels.clear();
+    }
+    current_active_channel_ = NULL;
 }
 
-void EventLoop::Run(const Task& task)
+void EventLoop::DispatchChannel(Channel* channel)
 {
-    if (IsInLoopThread())
+    current_active_channel_ = channel;
+    if (FLAGS_eventloop_slow_callback_ms <= 0)
     {
-        task();
+        channel->OnEvent();
+        return ;
     }
-    else
+
+    // channel may be gone after its callback, so take them before
+    auto fd = channel->fd();
+    auto revents = channel->revents();
+    auto& owner = channel->owner_type();
+
+    // one clock read per callback, it ends when the next starts
+    channel->OnEvent();
+    auto now = Timestamp::Now();
+    auto elapsed = TimeDifference(now, callback_start_);
+    callback_start_ = now;
+    if (elapsed >= FLAGS_eventloop_slow_callback_ms*1000LL)
     {
-        Post(task);
+        slow_callback_counter_.Increment();
+        LOG(WARNING) << "Slow channel callback of EventLoop " << this
+                     << " takes " << elapsed/1000 << " ms, fd " << fd
+                     << ", revents " << revents
+                     << ", callback " << demangle(owner.name());
     }
 }
 
-void EventLoop::Post(const Task& task)
+void EventLoop::RunTask(PendingTask* task)
 {
+    if (FLAGS_eventloop_slow_callback_ms <= 0)
     {
-        MutexLock lock(mutex_);
-        pending_tasks_.push_back(std::make_pair(ThisThread::GetTraceContext(), task));
+        task->task();
+        return ;
     }
 
-    if (!IsInLoopThread() || !current_active_channel_) // FIXME
+    task->task();
+    auto now = Timestamp::Now();
+    auto elapsed = TimeDifference(now, callback_start_);
+    callback_start_ = now;
+    if (elapsed >= FLAGS_eventloop_slow_callback_ms*1000LL)
+    {
+        slow_callback_counter_.Increment();
+        LOG(WARNING) << "Slow task of EventLoop " << this
+                     << " takes " << elapsed/1000 << " ms"
+                     << ", task " << demangle(task->task.target_type().name());
+    }
+}
+
+void EventLoop::quit()
+{
+    quit_ = true; // FIXME
+    if (!IsInLoopThread())
     {
         Wakeup();
     }
@@ -174,15 +346,97 @@ void EventLoop::Run(Task&& task)
 
 void EventLoop::Post(Task&& task)
 {
+    auto node = TakeFreeTask();
+    if (node)
     {
-        MutexLock lock(mutex_);
-        pending_tasks_.push_back(std::make_pair(ThisThread::GetTraceContext(), std::move(task))); // emplace_back
+        node->context = ThisThread::GetTraceContext();
+        node->task = std::move(task);
     }
+    else
+    {
+        node = new PendingTask(ThisThread::GetTraceContext(), std::move(task));
+    }
+    QueueTask(node);
+}
 
-    if (!IsInLoopThread() || !current_active_channel_) // FIXME
+EventLoop::PendingTask* EventLoop::TakeFreeTask()
+{
+    if (!t_free_tasks)
     {
-        Wakeup();
+        MpscQueueHook* tasks;
+        {
+            MutexLock lock(free_tasks_mutex_);
+            tasks = free_tasks_;
+            free_tasks_ = NULL;
+            num_free_tasks_ = 0;
+        }
+        if (!tasks)
+        {
+            return NULL;
+        }
+
+        // the cache is deleted when the thread exits
+        static pthread_key_t key = CreateFreeTasksKey(&EventLoop::DeleteFreeTasks);
+        ::pthread_setspecific(key, tasks);
+        t_free_tasks = tasks;
     }
+
+    auto task = static_cast<PendingTask*>(t_free_tasks);
+    t_free_tasks = task->mpsc_next.load(boost::memory_order_relaxed);
+    return task;
+}
+
+void EventLoop::RecycleTasks()
+{
+    size_t kept = 0;
+    {
+        MutexLock lock(free_tasks_mutex_);
+        while (kept < running_tasks_.size() && num_free_tasks_ < kMaxFreeTasks)
+        {
+            running_tasks_[kept]->mpsc_next.store(free_tasks_, boost::memory_order_relaxed);
+            free_tasks_ = running_tasks_[kept];
+            num_free_tasks_++;
+            kept++;
+        }
+    }
+
+    for (auto i = kept; i < running_tasks_.size(); i++)
+    {
+        delete running_tasks_[i];
+    }
+    running_tasks_.clear();
+}
+
+void EventLoop::DeleteFreeTasks(void*)
+{
+    while (t_free_tasks)
+    {
+        auto task = static_cast<PendingTask*>(t_free_tasks);
+        t_free_tasks = task->mpsc_next.load(boost::memory_order_relaxed);
+        delete task;
+    }
+}
+
+void EventLoop::QueueTask(PendingTask* task)
+{
+    pending_tasks_.Push(task);
+    post_counter_.Increment();
+
+    // pending tasks run right after the active channels
+    if (IsInLoopThread() && current_active_channel_)
+    {
+        return ;
+    }
+
+    // only the first post since loop took tasks wakes it up
+    if (wakeup_pending_.exchange(true))
+    {
+        coalesced_wakeup_counter_.Increment();
+        return ;
+    }
+
+    wakeup_counter_.Increment();
+    Wakeup();
 }
 
 TimerId EventLoop::RunAt(const Timestamp& time, const TimeoutCallback& callback)
@@ -206,6 +460,12 @@ void EventLoop::Cancel(TimerId id)
     timeouts_->Cancel(id.get());
 }
 
+void EventLoop::SetBusyPoll(int microseconds)
+{
+    AssertInLoopThread();
+    busy_poll_us_ = microseconds;
+}
+
 void EventLoop::UpdateChannel(Channel* channel)
 {
     DCHECK(channel->OwnerLoop() == this);
@@ -256,18 +516,29 @@ void EventLoop::OnWakeup()
 
 void EventLoop::RunPendingTasks()
 {
-    std::vector<Entry> tasks;
+    // clear before taking tasks, a post after it wakes up the loop again
+    wakeup_pending_.store(false);
+
+    // tasks posted by the running ones wait for next round
+    DCHECK(running_tasks_.empty());
+    PendingTask* task;
+    while ((task = pending_tasks_.Pop()) != NULL)
+    {
+        running_tasks_.push_back(task);
+    }
+    if (!running_tasks_.empty())
     {
-        MutexLock lock(mutex_);
-        tasks.swap(pending_tasks_);
+        pending_tasks_histogram_->Add(static_cast<int>(running_tasks_.size()));
     }
 
-    for (auto it = tasks.begin(); it != tasks.end(); ++it)
+    for (auto it = running_tasks_.begin(); it != running_tasks_.end(); ++it)
     {
-        ThisThread::SetTraceContext((*it).first);
-        (*it).second();
+        ThisThread::SetTraceContext((*it)->context);
+        RunTask(*it);
         ThisThread::ResetTraceContext();
+        (*it)->task.reset(); // releases what the functor holds now
     }
+    RecycleTasks();
 }
 
 bool EventLoop::IsInLoopThread() const
@@ -13,24 +13,43 @@
 #include <boost/scoped_ptr.hpp>
 #include <boost/noncopyable.hpp>
 
-#include <claire/common/threading/Mutex.h>
+#include <claire/common/base/Closure.h>
+#include <claire/common/base/MpscQueue.h>
 #include <claire/common/time/Timestamp.h>
+#include <claire/common/metrics/Counter.h>
 #include <claire/common/events/TimerId.h>
+#include <claire/common/threading/Mutex.h>
 #include <claire/common/tracing/TraceContext.h>
 
 namespace claire {
 
 class Poller;
 class Channel;
+class Histogram;
 class TimeoutQueue;
 
 /// Reactor, at most one per thread.
 class EventLoop : boost::noncopyable
 {
 public:
-    typedef boost::function<void()> Task;
+    typedef Closure Task; // move-only, functors up to 64 bytes are not allocated
     typedef boost::function<void()> TimeoutCallback;
 
+    /// Load of the loop, for placing connections on loops, updated
+    /// by the loop and its connections, read from any thread.
+    struct Load
+    {
+        Load()
+            : connections(0),
+              pending_bytes(0),
+              busy_permille(0)
+        {}
+
+        boost::atomic<int> connections;
+        boost::atomic<int64_t> pending_bytes; // output not sent yet
+        boost::atomic<int> busy_permille; // time out of poll in last second
+    };
+
     EventLoop();
     ~EventLoop();
 
@@ -51,13 +70,11 @@ public:
     /// It wakes up the loop, and run the task.
     /// If in the same loop thread, task is run within the function.
     /// Safe to call from other threads.
-    void Run(const Task& task);
     void Run(Task&& task);
 
     /// Queues callback in the loop thread.
     /// Runs after finish pooling.
     /// Safe to call from other threads.
-    void Post(const Task& task);
     void Post(Task&& task);
 
     ///
@@ -83,6 +100,13 @@ public:
     // Safe to call from other threads.
     void Cancel(TimerId id);
 
+    /// Busy-poll mode, after any ready channel loop polls with zero
+    /// timeout for @c microseconds before blocking in poll again,
+    /// trades cpu for latency. 0 disables it.
+    ///
+    /// Default is --eventloop_busy_poll_us. Call in the loop thread.
+    void SetBusyPoll(int microseconds);
+
     // for channel
     void UpdateChannel(Channel* channel);
     void RemoveChannel(Channel* channel);
@@ -90,15 +114,34 @@ public:
     void AssertInLoopThread() const;
     bool IsInLoopThread() const;
 
+    Load& load() { return load_; }
+    const Load& load() const { return load_; }
+
     static EventLoop* CurrentLoopInThisThread();
 
 private:
-    typedef std::pair<TraceContext, Task> Entry;
+    struct PendingTask : MpscQueueHook
+    {
+        PendingTask(const TraceContext& context__, Task&& task__)
+            : context(context__),
+              task(std::move(task__))
+        {}
+
+        TraceContext context;
+        Task task;
+    };
 
     void AbortNotInLoopThread() const;
     void Wakeup();
     void OnWakeup();
     void OnTimer();
+    void QueueTask(PendingTask* task);
+    PendingTask* TakeFreeTask();
+    void RecycleTasks();
+    static void DeleteFreeTasks(void*);
+    void DispatchActiveChannels();
+    void DispatchChannel(Channel* channel);
+    void RunTask(PendingTask* task);
     void RunPendingTasks();
 
     typedef std::vector<Channel*> ChannelList;
@@ -114,10 +157,51 @@ private:
     boost::scoped_ptr<Channel> wakeup_channel_;
 
     ChannelList active_channels_;
+    std::vector<ChannelList> prioritized_channels_; // by Channel::Priority
     Channel* current_active_channel_;
 
-    Mutex mutex_;
-    std::vector<Entry> pending_tasks_; // @GUARDBY mutex_
+    MpscQueue<PendingTask> pending_tasks_;
+    std::vector<PendingTask*> running_tasks_;
+
+    // tasks run are given back here, a posting thread takes all of them
+    // into its own cache at once, so posts seldom allocate or lock
+    Mutex free_tasks_mutex_;
+    MpscQueueHook* free_tasks_; // @GUARDBY free_tasks_mutex_
+    int num_free_tasks_; // @GUARDBY free_tasks_mutex_
+
+    // set by the post which wakes up loop, cleared before running tasks,
+    // so posts in between need no more wakeup
+    boost::atomic<bool> wakeup_pending_;
+
+    Counter post_counter_;
+    Counter wakeup_counter_;
+    Counter coalesced_wakeup_counter_;
+
+    // time spent in each phase of loop, histograms are of this loop only,
+    // in microseconds, counters sum all loops in milliseconds
+    Histogram* poll_time_histogram_;
+    Histogram* callback_time_histogram_;
+    Histogram* task_time_histogram_;
+    Histogram* ready_channels_histogram_;
+    Histogram* pending_tasks_histogram_;
+    Counter poll_time_counter_;
+    Counter callback_time_counter_;
+    Counter task_time_counter_;
+    Counter slow_callback_counter_;
+    int64_t poll_time_remainder_; // microseconds not added to counter yet
+    int64_t callback_time_remainder_;
+    int64_t task_time_remainder_;
+    Timestamp callback_start_; // of the running channel callback or task
+
+    int busy_poll_us_;
+    Timestamp last_active_; // last time poll returned ready channels
+    Counter spin_poll_counter_;
+    Counter idle_spin_poll_counter_;
+    Counter blocking_poll_counter_;
+
+    Load load_;
+    Timestamp busy_window_start_;
+    int64_t busy_window_time_; // microseconds out of poll in window
 };
 
 } // namespace claire
@@ -16,7 +16,8 @@ EventLoopThread::EventLoopThread(const ThreadInitCallback& callback)
       thread_(boost::bind(&EventLoopThread::ThreadMain, this), std::string()),
       mutex_(),
       condition_(mutex_),
-      callback_(callback)
+      callback_(callback),
+      affinity_index_(0)
 {}
 
 EventLoopThread::~EventLoopThread()
@@ -43,6 +44,9 @@ EventLoop* EventLoopThread::StartLoop()
 
 void EventLoopThread::ThreadMain()
 {
+    // before the loop, so memory allocated by it is local
+    affinity_.Apply(affinity_index_);
+
     EventLoop loop;
     if (callback_)
     {
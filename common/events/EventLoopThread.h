@@ -11,6 +11,7 @@
 #include <claire/common/threading/Mutex.h>
 #include <claire/common/threading/Thread.h>
 #include <claire/common/threading/Condition.h>
+#include <claire/common/threading/CpuAffinity.h>
 
 namespace claire {
 
@@ -24,6 +25,14 @@ public:
     EventLoopThread(const ThreadInitCallback& callback);
     ~EventLoopThread();
 
+    /// Pins the loop thread as the index-th one of affinity,
+    /// must be called before StartLoop
+    void set_affinity(const CpuAffinity& affinity, int index)
+    {
+        affinity_ = affinity;
+        affinity_index_ = index;
+    }
+
     EventLoop* StartLoop();
 
 private:
@@ -34,6 +43,8 @@ private:
     Mutex mutex_;
     Condition condition_;
     ThreadInitCallback callback_;
+    CpuAffinity affinity_;
+    int affinity_index_;
 };
 
 } // namespace claire
@@ -8,14 +8,69 @@
 #include <claire/common/events/EventLoopThread.h>
 #include <claire/common/logging/Logging.h>
 
+DEFINE_string(eventloop_affinity, "none",
+              "pins IO loop threads of each EventLoopThreadPool, none, cores "
+              "(one physical core each), numa (one node each) or a cpu list like 0-3,8");
+
 namespace claire {
 
+namespace {
+
+int64_t LoadOf(EventLoop* loop, EventLoopThreadPool::Placement placement)
+{
+    const auto& load = loop->load();
+    switch (placement)
+    {
+        case EventLoopThreadPool::kLeastConnections:
+            return load.connections.load(boost::memory_order_relaxed);
+        case EventLoopThreadPool::kLeastPendingBytes:
+            return load.pending_bytes.load(boost::memory_order_relaxed);
+        case EventLoopThreadPool::kLeastBusyTime:
+            return load.busy_permille.load(boost::memory_order_relaxed);
+        default:
+            return 0;
+    }
+}
+
+} // namespace
+
 EventLoopThreadPool::EventLoopThreadPool(EventLoop* loop)
     : base_loop_(loop),
       started_(false),
       num_threads_(0),
-      next_(0)
-{}
+      next_(0),
+      placement_(kRoundRobin)
+{
+    if (!CpuAffinity::Parse(FLAGS_eventloop_affinity, &affinity_))
+    {
+        LOG(ERROR) << "Unknown affinity " << FLAGS_eventloop_affinity << ", threads not pinned";
+    }
+}
+
+bool EventLoopThreadPool::ParsePlacement(const std::string& name, Placement* placement)
+{
+    if (name == "round_robin")
+    {
+        *placement = kRoundRobin;
+    }
+    else if (name == "least_connections")
+    {
+        *placement = kLeastConnections;
+    }
+    else if (name == "least_pending_bytes")
+    {
+        *placement = kLeastPendingBytes;
+    }
+    else if (name == "least_busy_time")
+    {
+        *placement = kLeastBusyTime;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
 
 void EventLoopThreadPool::Start()
 {
@@ -29,9 +84,11 @@ void EventLoopThreadPool::Start(const ThreadInitCallback& callback)
     base_loop_->AssertInLoopThread();
 
     started_ = true;
+    affinity_.Reserve(num_threads_);
     for (int i = 0;i < num_threads_; ++i)
     {
         auto thread = new EventLoopThread(callback);
+        thread->set_affinity(affinity_, i);
         threads_.push_back(thread);
         loops_.push_back(thread->StartLoop());
     }
@@ -46,18 +103,49 @@ EventLoop* EventLoopThreadPool::NextLoop()
 {
     base_loop_->AssertInLoopThread();
 
-    auto loop = base_loop_;
-    if (!loops_.empty())
+    if (loops_.empty())
     {
-        // round-robin
-        loop = loops_[next_++];
-        if (next_ >= static_cast<int>(loops_.size()))
+        return base_loop_;
+    }
+
+    if (placement_callback_)
+    {
+        return placement_callback_(loops_);
+    }
+
+    // round-robin, or the least loaded one starting from next
+    auto size = static_cast<int>(loops_.size());
+    auto loop = loops_[next_];
+    if (placement_ != kRoundRobin)
+    {
+        auto least = LoadOf(loop, placement_);
+        for (int i = 1; i < size && least > 0; i++)
         {
-            next_ = 0;
+            auto candidate = loops_[(next_ + i) % size];
+            auto load = LoadOf(candidate, placement_);
+            if (load < least)
+            {
+                loop = candidate;
+                least = load;
+            }
         }
     }
 
+    if (++next_ >= size)
+    {
+        next_ = 0;
+    }
     return loop;
 }
 
+std::vector<EventLoop*> EventLoopThreadPool::GetAllLoops() const
+{
+    DCHECK(started_);
+    if (loops_.empty())
+    {
+        return std::vector<EventLoop*>(1, base_loop_);
+    }
+    return loops_;
+}
+
 } // namespace claire
@@ -5,12 +5,15 @@
 #ifndef _CLAIRE_COMMON_EVENTS_EVENTLOOPTHREADPOOL_H_
 #define _CLAIRE_COMMON_EVENTS_EVENTLOOPTHREADPOOL_H_
 
+#include <string>
 #include <vector>
 
 #include <boost/function.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/ptr_container/ptr_vector.hpp>
 
+#include <claire/common/threading/CpuAffinity.h>
+
 namespace claire {
 
 class EventLoop;
@@ -21,6 +24,19 @@ class EventLoopThreadPool : boost::noncopyable
 public:
     typedef boost::function<void(EventLoop*)> ThreadInitCallback;
 
+    /// How NextLoop picks a loop, the least loaded ones are picked by
+    /// EventLoop::Load, ties are broken round-robin.
+    enum Placement
+    {
+        kRoundRobin,
+        kLeastConnections,
+        kLeastPendingBytes,
+        kLeastBusyTime
+    };
+
+    /// Custom placement, picks one of loops
+    typedef boost::function<EventLoop*(const std::vector<EventLoop*>& loops)> PlacementCallback;
+
     EventLoopThreadPool(EventLoop* base_loop);
 
     void set_num_threads(int num_threads)
@@ -28,15 +44,43 @@ public:
         num_threads_ = num_threads;
     }
 
+    void set_placement(Placement placement)
+    {
+        placement_ = placement;
+    }
+
+    /// Overrides placement if set
+    void set_placement_callback(const PlacementCallback& callback)
+    {
+        placement_callback_ = callback;
+    }
+
+    /// Pins the i-th loop thread by affinity.CpusOf(i), overrides
+    /// --eventloop_affinity, must be called before Start
+    void set_affinity(const CpuAffinity& affinity)
+    {
+        affinity_ = affinity;
+    }
+
+    /// Parses round_robin, least_connections, least_pending_bytes or
+    /// least_busy_time, returns false if unknown
+    static bool ParsePlacement(const std::string& name, Placement* placement);
+
     void Start();
     void Start(const ThreadInitCallback& callback);
     EventLoop* NextLoop();
 
+    /// All loops of the pool, or the base loop if no thread started
+    std::vector<EventLoop*> GetAllLoops() const;
+
 private:
     EventLoop* base_loop_;
     bool started_;
     int num_threads_;
     int next_;
+    Placement placement_;
+    PlacementCallback placement_callback_;
+    CpuAffinity affinity_;
     boost::ptr_vector<EventLoopThread> threads_;
     std::vector<EventLoop*> loops_;
 };
@@ -13,6 +13,8 @@
 
 namespace claire {
 
+class EventLoop;
+
 class Poller : boost::noncopyable
 {
 public:
@@ -20,6 +22,10 @@ public:
 
     virtual ~Poller() {}
 
+    /// Creates the poller selected by --poller, falls back to epoll
+    /// if it is not supported by kernel.
+    static Poller* NewDefaultPoller(EventLoop* loop);
+
     /// Polls the I/O events.
     /// Must be called in the loop thread.
     virtual void poll(int timeout_in_milliseconds, ChannelList* active_channels) = 0;
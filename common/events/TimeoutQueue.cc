@@ -31,11 +31,19 @@
 #include <claire/common/logging/Logging.h>
 #include <claire/common/events/EventLoop.h>
 #include <claire/common/events/Channel.h>
+#include <claire/common/events/TimingWheel.h>
+
+DEFINE_int32(timer_wheel_tick_ms, 10,
+             "tick of timing wheel for coarse timeouts in milliseconds, 0 disables it");
 
 namespace claire {
 
 namespace {
 
+// timeouts shorter than this many ticks stay in the precise set,
+// so rounding up to tick delays others by 10% at most
+const int kMinWheelTicks = 10;
+
 int CreateTimerfd()
 {
     int fd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
@@ -94,12 +102,19 @@ TimeoutQueue::TimeoutQueue(EventLoop* loop)
     : loop_(loop),
       timer_fd_(CreateTimerfd()),
       timer_channel_(new Channel(loop, timer_fd_)),
-      next_(1)
+      next_(1),
+      armed_expiration_(std::numeric_limits<int64_t>::max())
 {
+    if (FLAGS_timer_wheel_tick_ms > 0)
+    {
+        wheel_.reset(new TimingWheel(FLAGS_timer_wheel_tick_ms*1000,
+                                     Timestamp::Now().MicroSecondsSinceEpoch()));
+    }
+
     timer_channel_->set_read_callback(
         boost::bind(&TimeoutQueue::OnTimer, this));
     timer_channel_->EnableReading();
-    timer_channel_->set_priority(Channel::Priority::kHigh); // FIXME
+    timer_channel_->set_priority(Channel::Priority::kHigh);
 }
 
 TimeoutQueue::~TimeoutQueue()
@@ -110,7 +125,8 @@ TimeoutQueue::~TimeoutQueue()
 void TimeoutQueue::OnTimer()
 {
     ReadTimerfd(timer_fd_);
-    ResetTimerfd(timer_fd_, Run(Timestamp::Now().MicroSecondsSinceEpoch()));
+    armed_expiration_ = Run(Timestamp::Now().MicroSecondsSinceEpoch());
+    ResetTimerfd(timer_fd_, armed_expiration_);
 }
 
 TimeoutQueue::Id TimeoutQueue::Add(int64_t expiration, const Callback& callback)
@@ -148,11 +164,31 @@ TimeoutQueue::Id TimeoutQueue::AddRepeating(int64_t now, int64_t interval, Callb
 void TimeoutQueue::AddInLoop(Event& event)
 {
     loop_->AssertInLoopThread();
-    bool reset = event.expiration < NextExpiration();
-    timeouts_.insert(std::move(event));
-    if (reset)
+
+    int64_t fire_time;
+    auto now = Timestamp::Now().MicroSecondsSinceEpoch();
+    if (wheel_
+        && event.repeat_interval < 0
+        && event.expiration - now >= kMinWheelTicks*wheel_->tick())
+    {
+        if (wheel_->size() == 0)
+        {
+            wheel_->Advance(now); // catches up after idle, nothing fires
+        }
+        fire_time = wheel_->FireTime(event.expiration);
+        wheel_->Add(event.id, event.expiration, std::move(event.callback));
+    }
+    else
     {
-        ResetTimerfd(timer_fd_, NextExpiration());
+        fire_time = event.expiration;
+        timeouts_.insert(std::move(event));
+    }
+
+    // timerfd may fire earlier than needed, but never later
+    if (fire_time < armed_expiration_)
+    {
+        armed_expiration_ = fire_time;
+        ResetTimerfd(timer_fd_, armed_expiration_);
     }
     return ;
 }
@@ -165,17 +201,30 @@ void TimeoutQueue::Cancel(Id id)
 void TimeoutQueue::CancelInLoop(Id id)
 {
     loop_->AssertInLoopThread();
-    timeouts_.get<kById>().erase(id);
+    if (!wheel_ || !wheel_->Cancel(id))
+    {
+        timeouts_.get<kById>().erase(id);
+    }
 }
 
 int64_t TimeoutQueue::NextExpiration() const
 {
-    return (timeouts_.empty() ? std::numeric_limits<int64_t>::max() :
+    auto next = (timeouts_.empty() ? std::numeric_limits<int64_t>::max() :
         timeouts_.get<kByExpiration>().begin()->expiration);
+    if (wheel_)
+    {
+        next = std::min(next, wheel_->NextExpiration());
+    }
+    return next;
 }
 
 int64_t TimeoutQueue::Run(int64_t now)
 {
+    if (wheel_)
+    {
+        wheel_->Advance(now);
+    }
+
     std::vector<Event> expired;
     auto& events = timeouts_.get<kByExpiration>();
     auto end = events.upper_bound(now);
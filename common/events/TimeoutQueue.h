@@ -48,6 +48,7 @@ namespace claire {
 
 class EventLoop;
 class Channel;
+class TimingWheel;
 
 class TimeoutQueue : boost::noncopyable
 {
@@ -134,6 +135,10 @@ private:
 
     Set timeouts_;
     boost::atomic<Id> next_;
+
+    // coarse one-shot timeouts, like rpc deadlines, NULL if disabled
+    boost::scoped_ptr<TimingWheel> wheel_;
+    int64_t armed_expiration_; // timerfd is set to fire at
 };
 
 } // namespace claire
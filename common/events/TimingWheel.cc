@@ -0,0 +1,207 @@
+// Copyright (c) 2013 The claire-common Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <claire/common/events/TimingWheel.h>
+
+#include <limits>
+#include <vector>
+#include <algorithm>
+
+#include <claire/common/logging/Logging.h>
+
+namespace claire {
+
+TimingWheel::TimingWheel(int64_t tick, int64_t now)
+    : tick_(tick),
+      current_tick_(now / tick)
+{
+    DCHECK(tick_ > 0);
+}
+
+TimingWheel::~TimingWheel()
+{
+    for (auto it = timers_.begin(); it != timers_.end(); ++it)
+    {
+        delete (*it).second;
+    }
+}
+
+int64_t TimingWheel::FireTime(int64_t expiration) const
+{
+    return (expiration + tick_ - 1) / tick_ * tick_;
+}
+
+void TimingWheel::Add(Id id, int64_t expiration, const Callback& callback)
+{
+    Add(id, expiration, Callback(callback));
+}
+
+void TimingWheel::Add(Id id, int64_t expiration, Callback&& callback)
+{
+    auto timer = new Timer();
+    timer->id = id;
+    timer->expire_tick = (expiration + tick_ - 1) / tick_;
+    timer->callback.swap(callback);
+
+    DCHECK(timers_.find(id) == timers_.end());
+    timers_[id] = timer;
+    Place(timer);
+}
+
+bool TimingWheel::Cancel(Id id)
+{
+    auto it = timers_.find(id);
+    if (it == timers_.end())
+    {
+        return false;
+    }
+
+    auto timer = (*it).second;
+    timers_.erase(it);
+    Unlink(timer);
+    delete timer;
+    return true;
+}
+
+void TimingWheel::Advance(int64_t now)
+{
+    auto target = now / tick_;
+    if (timers_.empty())
+    {
+        current_tick_ = std::max(current_tick_, target + 1);
+        return ;
+    }
+
+    std::vector<Timer*> expired;
+    while (current_tick_ <= target && !timers_.empty())
+    {
+        auto index = static_cast<int>(current_tick_ & (kLevel0Slots-1));
+        if (index == 0)
+        {
+            // refill level 0 from upper levels, level n+1 cascades when
+            // level n wraps around
+            for (int level = 1; level < kLevels && Cascade(level) == 0; level++) {}
+        }
+
+        auto slot = &wheel0_[index];
+        while (!slot->empty())
+        {
+            auto timer = static_cast<Timer*>(slot->next);
+            Unlink(timer);
+            timers_.erase(timer->id);
+            expired.push_back(timer);
+        }
+        current_tick_++;
+    }
+    current_tick_ = std::max(current_tick_, target + 1);
+
+    // callbacks may add or cancel timers, all expired are unlinked already
+    for (auto it = expired.begin(); it != expired.end(); ++it)
+    {
+        (*it)->callback();
+        delete *it;
+    }
+}
+
+int64_t TimingWheel::NextExpiration() const
+{
+    if (timers_.empty())
+    {
+        return std::numeric_limits<int64_t>::max();
+    }
+
+    // upper levels are cascaded at the start of each level 0 round
+    auto next_round = (current_tick_ | (kLevel0Slots-1)) + 1;
+    if ((current_tick_ & (kLevel0Slots-1)) == 0)
+    {
+        next_round = current_tick_;
+    }
+
+    for (auto t = current_tick_; t < next_round; t++)
+    {
+        if (!wheel0_[t & (kLevel0Slots-1)].empty())
+        {
+            return t * tick_;
+        }
+    }
+    return next_round * tick_;
+}
+
+void TimingWheel::Place(Timer* timer)
+{
+    auto expire = timer->expire_tick;
+    auto delta = expire - current_tick_;
+
+    Slot* slot;
+    if (delta < 0)
+    {
+        slot = &wheel0_[current_tick_ & (kLevel0Slots-1)];
+    }
+    else if (delta < (1LL << kLevel0Bits))
+    {
+        slot = &wheel0_[expire & (kLevel0Slots-1)];
+    }
+    else
+    {
+        // farther ones are placed in the last slot reachable, and put
+        // back when cascaded
+        if (delta > kMaxTicks)
+        {
+            expire = current_tick_ + kMaxTicks;
+            delta = kMaxTicks;
+        }
+
+        int level = 1;
+        while (delta >= (1LL << (kLevel0Bits + level*kLevelBits)))
+        {
+            level++;
+        }
+        auto shift = kLevel0Bits + (level-1)*kLevelBits;
+        slot = &wheels_[level-1][(expire >> shift) & (kLevelSlots-1)];
+    }
+    Append(slot, timer);
+}
+
+int TimingWheel::Cascade(int level)
+{
+    auto shift = kLevel0Bits + (level-1)*kLevelBits;
+    auto index = static_cast<int>((current_tick_ >> shift) & (kLevelSlots-1));
+
+    // detach the list first, timers may be placed back to the same slot
+    Slot pending;
+    auto slot = &wheels_[level-1][index];
+    if (!slot->empty())
+    {
+        pending.next = slot->next;
+        pending.prev = slot->prev;
+        pending.next->prev = &pending;
+        pending.prev->next = &pending;
+        slot->next = slot->prev = slot;
+    }
+
+    while (!pending.empty())
+    {
+        auto timer = static_cast<Timer*>(pending.next);
+        Unlink(timer);
+        Place(timer);
+    }
+    return index;
+}
+
+void TimingWheel::Append(Slot* slot, Timer* timer)
+{
+    timer->prev = slot->prev;
+    timer->next = slot;
+    slot->prev->next = timer;
+    slot->prev = timer;
+}
+
+void TimingWheel::Unlink(Timer* timer)
+{
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = timer->next = timer;
+}
+
+} // namespace claire
@@ -0,0 +1,97 @@
+// Copyright (c) 2013 The claire-common Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef _CLAIRE_COMMON_EVENTS_TIMINGWHEEL_H_
+#define _CLAIRE_COMMON_EVENTS_TIMINGWHEEL_H_
+
+#include <stdint.h>
+
+#include <unordered_map>
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace claire {
+
+/// Hierarchical timing wheel for coarse one-shot timeouts, add and cancel
+/// are O(1), timers fire at the first tick not before their expiration.
+///
+/// Level 0 has 256 slots of one tick each, level 1 to 3 have 64 slots,
+/// each slot spans all slots of the level below, so timers up to 2^26
+/// ticks away are kept, farther ones are clamped.
+///
+/// Time unit is the same as TimeoutQueue, microseconds. Not thread safe,
+/// used by TimeoutQueue in the loop thread.
+class TimingWheel : boost::noncopyable
+{
+public:
+    typedef int64_t Id;
+    typedef boost::function<void()> Callback;
+
+    TimingWheel(int64_t tick, int64_t now);
+    ~TimingWheel();
+
+    int64_t tick() const { return tick_; }
+    size_t size() const { return timers_.size(); }
+
+    /// Time the timer of expiration fires at, rounded up to tick
+    int64_t FireTime(int64_t expiration) const;
+
+    void Add(Id id, int64_t expiration, const Callback& callback);
+    void Add(Id id, int64_t expiration, Callback&& callback);
+
+    /// Returns false if no such timer, it may have fired
+    bool Cancel(Id id);
+
+    /// Fires all timers due at now
+    void Advance(int64_t now);
+
+    /// Time of next tick which has timers or has to cascade,
+    /// max of int64_t if empty
+    int64_t NextExpiration() const;
+
+private:
+    struct Link
+    {
+        Link* prev;
+        Link* next;
+    };
+
+    struct Timer : Link
+    {
+        Id id;
+        int64_t expire_tick;
+        Callback callback;
+    };
+
+    /// Sentinel of circular list of timers
+    struct Slot : Link, boost::noncopyable
+    {
+        Slot() { prev = next = this; }
+        bool empty() const { return next == this; }
+    };
+
+    static const int kLevel0Bits = 8;
+    static const int kLevelBits = 6;
+    static const int kLevels = 4;
+    static const int kLevel0Slots = 1 << kLevel0Bits;
+    static const int kLevelSlots = 1 << kLevelBits;
+    static const int64_t kMaxTicks = (1LL << (kLevel0Bits + (kLevels-1)*kLevelBits)) - 1;
+
+    void Place(Timer* timer);
+    int Cascade(int level);
+    static void Append(Slot* slot, Timer* timer);
+    static void Unlink(Timer* timer);
+
+    const int64_t tick_;
+    int64_t current_tick_; // next tick to process, ticks before it are done
+
+    Slot wheel0_[kLevel0Slots];
+    Slot wheels_[kLevels-1][kLevelSlots]; // level 1 to 3
+    std::unordered_map<Id, Timer*> timers_;
+};
+
+} // namespace claire
+
+#endif // _CLAIRE_COMMON_EVENTS_TIMINGWHEEL_H_
@@ -0,0 +1,38 @@
+// Copyright (c) 2013 The claire-common Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <claire/common/events/Poller.h>
+
+#include "thirdparty/gflags/gflags.h"
+
+#include <claire/common/events/poller/EPollPoller.h>
+#include <claire/common/events/poller/IoUringPoller.h>
+#include <claire/common/logging/Logging.h>
+
+DEFINE_string(poller, "epoll", "poller of EventLoop, epoll or io_uring");
+
+namespace claire {
+
+Poller* Poller::NewDefaultPoller(EventLoop* loop)
+{
+    if (FLAGS_poller == "io_uring")
+    {
+        auto poller = new IoUringPoller(loop);
+        if (poller->valid())
+        {
+            return poller;
+        }
+
+        LOG(WARNING) << "io_uring is not supported, fall back to epoll";
+        delete poller;
+    }
+    else if (FLAGS_poller != "epoll")
+    {
+        LOG(WARNING) << "unknown poller " << FLAGS_poller << ", use epoll";
+    }
+
+    return new EPollPoller(loop);
+}
+
+} // namespace claire
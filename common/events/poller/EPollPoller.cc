@@ -156,6 +156,10 @@ void EPollPoller::Update(int operation, Channel* channel)
     struct epoll_event event;
     ::bzero(&event, sizeof event);
     event.events = channel->events();
+    if (channel->edge_triggered())
+    {
+        event.events |= EPOLLET;
+    }
     event.data.u64 = channel->fd();
 
     if (::epoll_ctl(epoll_fd_, operation, channel->fd(), &event) == 0)
@@ -0,0 +1,337 @@
+// Copyright (c) 2013 The claire-common Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <claire/common/events/poller/IoUringPoller.h>
+
+#include <poll.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include <algorithm>
+
+#include <claire/common/base/Types.h>
+#include <claire/common/events/Channel.h>
+#include <claire/common/events/EventLoop.h>
+#include <claire/common/logging/Logging.h>
+
+namespace claire {
+
+namespace {
+
+const unsigned kEntries = 256;
+
+// user_data of POLL_REMOVE requests, their completions are ignored
+const uint64_t kRemoveTag = 1ULL << 63;
+
+uint64_t MakeUserData(int fd, uint32_t generation)
+{
+    return (static_cast<uint64_t>(generation & 0x7fffffff) << 32) | static_cast<uint32_t>(fd);
+}
+
+} // namespace
+
+IoUringPoller::IoUringPoller(EventLoop* loop)
+    : loop_(loop),
+      ring_fd_(-1),
+      sq_ring_(MAP_FAILED),
+      sq_ring_size_(0),
+      cq_ring_(MAP_FAILED),
+      cq_ring_size_(0),
+      sqes_(NULL),
+      sqes_size_(0),
+      sq_head_(NULL),
+      sq_tail_(NULL),
+      sq_mask_(NULL),
+      sq_array_(NULL),
+      cq_head_(NULL),
+      cq_tail_(NULL),
+      cq_mask_(NULL),
+      cqes_(NULL),
+      watches_(64)
+{
+    if (!Setup(kEntries) && ring_fd_ >= 0)
+    {
+        ::close(ring_fd_);
+        ring_fd_ = -1;
+    }
+}
+
+IoUringPoller::~IoUringPoller()
+{
+    if (sqes_)
+    {
+        ::munmap(sqes_, sqes_size_);
+    }
+    if (cq_ring_ != MAP_FAILED)
+    {
+        ::munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != MAP_FAILED)
+    {
+        ::munmap(sq_ring_, sq_ring_size_);
+    }
+    if (ring_fd_ >= 0)
+    {
+        ::close(ring_fd_);
+    }
+}
+
+bool IoUringPoller::Setup(unsigned entries)
+{
+    struct io_uring_params params;
+    ::bzero(&params, sizeof params);
+
+    ring_fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (ring_fd_ < 0)
+    {
+        PLOG(WARNING) << "io_uring_setup failed";
+        return false;
+    }
+
+    // wait with timeout needs IORING_ENTER_EXT_ARG, since 5.11
+    if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP))
+    {
+        LOG(WARNING) << "io_uring lacks required features " << params.features;
+        return false;
+    }
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    sq_ring_ = ::mmap(NULL, sq_ring_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    cq_ring_ = ::mmap(NULL, cq_ring_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+    sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    auto sqes = ::mmap(NULL, sqes_size_, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+    if (sq_ring_ == MAP_FAILED || cq_ring_ == MAP_FAILED || sqes == MAP_FAILED)
+    {
+        PLOG(WARNING) << "mmap io_uring failed";
+        return false;
+    }
+    sqes_ = static_cast<struct io_uring_sqe*>(sqes);
+
+    auto sq = static_cast<char*>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+    auto cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    return true;
+}
+
+void IoUringPoller::poll(int timeout_in_milliseconds, ChannelList* active_channles)
+{
+    // apply interest changes since last poll, in the same submission
+    for (auto it = dirty_fds_.begin(); it != dirty_fds_.end(); ++it)
+    {
+        auto& watch = watches_[*it];
+        watch.dirty = false;
+        if (!watch.channel)
+        {
+            continue;
+        }
+
+        if (watch.armed && watch.armed_events != watch.channel->events())
+        {
+            Disarm(*it);
+        }
+
+        if (!watch.armed && !watch.channel->IsNoneEvent())
+        {
+            Arm(*it);
+        }
+    }
+    dirty_fds_.clear();
+
+    Enter(PendingSqes(), 1, timeout_in_milliseconds);
+
+    auto head = *cq_head_;
+    auto tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head)
+    {
+        const auto& cqe = cqes_[head & *cq_mask_];
+        if (cqe.user_data & kRemoveTag)
+        {
+            continue;
+        }
+
+        auto fd = static_cast<int>(cqe.user_data & 0xffffffff);
+        auto generation = static_cast<uint32_t>(cqe.user_data >> 32);
+
+        // completion of a disarmed request
+        if (implicit_cast<size_t>(fd) >= watches_.size()
+            || !watches_[fd].channel
+            || (watches_[fd].generation & 0x7fffffff) != generation)
+        {
+            continue;
+        }
+
+        auto& watch = watches_[fd];
+        auto channel = watch.channel;
+        watch.armed = false;
+        if (!watch.dirty)
+        {
+            watch.dirty = true;
+            dirty_fds_.push_back(fd);
+        }
+
+        if (cqe.res == -ECANCELED)
+        {
+            continue;
+        }
+
+        // interest may be changed after the request was armed
+        auto revents = cqe.res < 0 ? POLLERR : cqe.res;
+        revents &= channel->events() | POLLERR | POLLHUP | POLLNVAL | POLLRDHUP;
+        if (revents == 0 || channel->IsNoneEvent())
+        {
+            continue;
+        }
+
+        channel->set_revents(revents);
+        active_channles->push_back(channel);
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+}
+
+void IoUringPoller::UpdateChannel(Channel* channel)
+{
+    loop_->AssertInLoopThread();
+
+    auto fd = channel->fd();
+    if (implicit_cast<size_t>(fd) >= watches_.size())
+    {
+        watches_.resize(std::max(watches_.size()*2, implicit_cast<size_t>(fd) + 1));
+    }
+
+    auto& watch = watches_[fd];
+    DCHECK(!watch.channel || watch.channel == channel);
+    watch.channel = channel;
+    if (!watch.dirty)
+    {
+        watch.dirty = true;
+        dirty_fds_.push_back(fd);
+    }
+}
+
+void IoUringPoller::RemoveChannel(Channel* channel)
+{
+    loop_->AssertInLoopThread();
+
+    auto fd = channel->fd();
+    DCHECK(implicit_cast<size_t>(fd) < watches_.size());
+    DCHECK(watches_[fd].channel == channel);
+    DCHECK(channel->IsNoneEvent());
+
+    // the fd may be closed and reused soon, cancel the request by now
+    if (watches_[fd].armed)
+    {
+        Disarm(fd);
+    }
+    watches_[fd].channel = NULL;
+}
+
+void IoUringPoller::Arm(int fd)
+{
+    auto& watch = watches_[fd];
+
+    auto sqe = GetSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = watch.channel->events();
+    sqe->user_data = MakeUserData(fd, watch.generation);
+
+    watch.armed = true;
+    watch.armed_events = watch.channel->events();
+}
+
+void IoUringPoller::Disarm(int fd)
+{
+    auto& watch = watches_[fd];
+
+    auto sqe = GetSqe();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = MakeUserData(fd, watch.generation);
+    sqe->user_data = kRemoveTag;
+
+    watch.armed = false;
+    watch.generation++;
+}
+
+struct io_uring_sqe* IoUringPoller::GetSqe()
+{
+    // submission queue is full, submits without waiting until kernel takes some
+    while (PendingSqes() > *sq_mask_)
+    {
+        auto n = Enter(PendingSqes(), 0, 0);
+        if (n == 0 || (n < 0 && errno != EINTR))
+        {
+            // e.g. EBUSY for overflowed completions, which are reaped by poll only,
+            // going on would overwrite the sqes not submitted
+            PLOG(FATAL) << "io_uring submission queue is full";
+        }
+    }
+
+    auto tail = *sq_tail_;
+    auto index = tail & *sq_mask_;
+    auto sqe = &sqes_[index];
+    ::bzero(sqe, sizeof *sqe);
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    return sqe;
+}
+
+unsigned IoUringPoller::PendingSqes() const
+{
+    // kernel advances head as it takes sqes in io_uring_enter, so it is
+    // right even if the submission stopped early, e.g. by EBUSY
+    return *sq_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+}
+
+int IoUringPoller::Enter(unsigned to_submit, unsigned min_complete, int timeout_in_milliseconds)
+{
+    struct __kernel_timespec ts;
+    ts.tv_sec = timeout_in_milliseconds / 1000;
+    ts.tv_nsec = (timeout_in_milliseconds % 1000) * 1000000LL;
+
+    struct io_uring_getevents_arg arg;
+    ::bzero(&arg, sizeof arg);
+    arg.sigmask_sz = _NSIG / 8;
+    if (timeout_in_milliseconds >= 0)
+    {
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+    }
+
+    unsigned flags = IORING_ENTER_EXT_ARG;
+    if (min_complete > 0)
+    {
+        flags |= IORING_ENTER_GETEVENTS;
+    }
+
+    auto n = static_cast<int>(::syscall(__NR_io_uring_enter, ring_fd_, to_submit,
+                                        min_complete, flags, &arg, sizeof arg));
+    if (n < 0)
+    {
+        if (errno != EINTR && errno != ETIME && errno != EAGAIN && errno != EBUSY)
+        {
+            PLOG(FATAL) << "Exception IoUringPoller::poll()";
+        }
+    }
+    return n;
+}
+
+} // namespace claire
@@ -0,0 +1,91 @@
+// Copyright (c) 2013 The claire-common Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef _CLAIRE_COMMON_EVENTS_POLLER_IOURINGPOLLER_H_
+#define _CLAIRE_COMMON_EVENTS_POLLER_IOURINGPOLLER_H_
+
+#include <claire/common/events/Poller.h>
+
+#include <stdint.h>
+
+#include <vector>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+namespace claire {
+
+/// Poller based on io_uring, channels are watched by one-shot
+/// IORING_OP_POLL_ADD requests, which are re-armed after the events are
+/// handled, so the level-triggered semantic of EPollPoller is kept.
+///
+/// Interest changes are not applied at once like epoll_ctl, they are
+/// batched and submitted with the wait of next poll in one io_uring_enter.
+///
+/// Edge-triggered channels are watched the same way as level-triggered
+/// ones, their drain loops work unchanged.
+class IoUringPoller : public Poller
+{
+public:
+    IoUringPoller(EventLoop* loop);
+    virtual ~IoUringPoller();
+
+    /// false if kernel lacks io_uring or the features required
+    bool valid() const { return ring_fd_ >= 0; }
+
+    virtual void poll(int timeout_in_milliseconds, ChannelList* active_channles);
+    virtual void UpdateChannel(Channel* channel);
+    virtual void RemoveChannel(Channel* channel);
+
+private:
+    struct Watch
+    {
+        Watch()
+            : channel(NULL),
+              generation(0),
+              armed_events(0),
+              armed(false),
+              dirty(false)
+        {}
+
+        Channel* channel;
+        uint32_t generation; // tells completions of old requests on fd
+        int armed_events;
+        bool armed;
+        bool dirty;
+    };
+
+    bool Setup(unsigned entries);
+    void Arm(int fd);
+    void Disarm(int fd);
+    struct io_uring_sqe* GetSqe();
+    unsigned PendingSqes() const; // sqes queued but not submitted yet
+    int Enter(unsigned to_submit, unsigned min_complete, int timeout_in_milliseconds);
+
+    EventLoop* loop_;
+    int ring_fd_;
+
+    void* sq_ring_;
+    size_t sq_ring_size_;
+    void* cq_ring_;
+    size_t cq_ring_size_;
+    struct io_uring_sqe* sqes_;
+    size_t sqes_size_;
+
+    unsigned* sq_head_;
+    unsigned* sq_tail_;
+    unsigned* sq_mask_;
+    unsigned* sq_array_;
+    unsigned* cq_head_;
+    unsigned* cq_tail_;
+    unsigned* cq_mask_;
+    struct io_uring_cqe* cqes_;
+
+
+    std::vector<Watch> watches_; // indexed by fd
+    std::vector<int> dirty_fds_;
+};
+
+} // namespace claire
+
+#endif // _CLAIRE_COMMON_EVENTS_POLLER_IOURINGPOLLER_H_
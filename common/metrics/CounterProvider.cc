@@ -10,30 +10,42 @@
 
 #include "thirdparty/gflags/gflags.h"
 
-#include <boost/scoped_array.hpp>
+#include <pthread.h>
+
+#include <vector>
 
 #include <claire/common/threading/Mutex.h>
-#include <claire/common/threading/ThisThread.h>
 
 DEFINE_int32(provider_max_counters, 100, "max counters in counter provider");
-DEFINE_int32(provider_max_threads, 8, "max threads in counter provider");
 
 namespace claire {
 
 CounterProvider* g_current_provider = NULL;
-__thread int t_thread_slot = 0;
+__thread int* t_thread_row = NULL;
 
+// Each thread counts in a row of its own, allocated when it first counts.
+// Row of an exited thread is kept and reused by a later one, so counts
+// are not lost and rows grow only with threads alive at the same time.
 class CounterProvider::Impl : boost::noncopyable
 {
 public:
     static_assert(sizeof(int)==4, "int should be 4 bytes");
 
-    Impl(int max_threads,
-         int max_counters)
-        : max_threads_(max_threads),
-          max_counters_(max_counters),
-          data_(new int[max_threads*max_counters])
-    {}
+    explicit Impl(int max_counters)
+        : max_counters_(max_counters)
+    {
+        ::pthread_key_create(&key_, &Impl::ReleaseRow);
+    }
+
+    ~Impl()
+    {
+        // no release of rows by threads exiting later
+        ::pthread_key_delete(key_);
+        for (auto it = rows_.begin(); it != rows_.end(); ++it)
+        {
+            delete [] *it;
+        }
+    }
 
     int GetCounterId(const std::string& name)
     {
@@ -58,49 +70,40 @@ public:
         return 0;
     }
 
-    int GetSlotId()
+    int* GetRow()
     {
-        if (t_thread_slot)
+        if (t_thread_row)
         {
-            return t_thread_slot;
+            return t_thread_row;
         }
 
         {
             MutexLock lock(mutex_);
-            if (t_thread_slot)
+            if (free_rows_.empty())
             {
-                return t_thread_slot;
-            }
-
-            if (slots_.size() >= static_cast<size_t>(max_threads_))
-            {
-                return 0;
-            }
-
-            auto result = slots_.insert(std::make_pair(ThisThread::tid(),
-                                                       static_cast<int>(slots_.size()+1)));
-            if (result.second)
-            {
-                t_thread_slot = static_cast<int>(slots_.size());
-                return t_thread_slot;
+                rows_.push_back(new int[max_counters_]());
+                free_rows_.push_back(rows_.back());
             }
+            t_thread_row = free_rows_.back();
+            free_rows_.pop_back();
         }
 
-        return 0;
+        ::pthread_setspecific(key_, t_thread_row);
+        return t_thread_row;
     }
 
-    int* GetLocation(int counter_id, int slot_id)
+    int* GetLocation(int counter_id)
     {
-        return (data_.get() + (counter_id-1)*max_threads_+slot_id-1);
+        return GetRow() + counter_id - 1;
     }
 
     int GetCounterValue(int counter_id)
     {
+        MutexLock lock(mutex_);
         int value = 0;
-        int row = (counter_id-1)*max_threads_;
-        for (int i = 0;i < max_threads_;i++)
+        for (auto it = rows_.begin(); it != rows_.end(); ++it)
         {
-            value += data_[row+i];
+            value += (*it)[counter_id-1];
         }
         return value;
     }
@@ -122,17 +125,25 @@ public:
     }
 
 private:
-    int max_threads_;
+    // called by exiting thread with its row
+    static void ReleaseRow(void* row)
+    {
+        auto impl = CounterProvider::instance()->impl_.get();
+        MutexLock lock(impl->mutex_);
+        impl->free_rows_.push_back(static_cast<int*>(row));
+    }
+
     int max_counters_;
+    pthread_key_t key_;
 
     mutable Mutex mutex_; // FIXME
     std::unordered_map<std::string, int> counters_;
-    std::unordered_map<int, int> slots_; // FIXME
-    boost::scoped_array<int> data_;
+    std::vector<int*> rows_; // @GUARDBY mutex_
+    std::vector<int*> free_rows_; // of exited threads, @GUARDBY mutex_
 };
 
 CounterProvider::CounterProvider()
-    : impl_(new Impl(FLAGS_provider_max_threads, FLAGS_provider_max_counters))
+    : impl_(new Impl(FLAGS_provider_max_counters))
 {}
 
 CounterProvider::~CounterProvider() {}
@@ -144,8 +155,7 @@ int CounterProvider::GetCounterId(const std::string& name)
 
 int* CounterProvider::GetLocation(int counter_id)
 {
-    int slot_id = impl_->GetSlotId();
-    return impl_->GetLocation(counter_id, slot_id);
+    return impl_->GetLocation(counter_id);
 }
 
 int CounterProvider::GetCounterValue(const std::string& name)
@@ -0,0 +1,126 @@
+#include <claire/common/base/BlockingQueue.h>
+#include <claire/common/base/BoundedBlockingQueue.h>
+#include <claire/common/threading/Thread.h>
+#include <claire/common/time/Timestamp.h>
+
+#include <boost/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include <stdio.h>
+
+#include <atomic>
+
+using namespace claire;
+
+const int kThreads = 4;
+const int kItems = 200000; // per producer
+
+std::atomic<int64_t> g_sum(0);
+
+template<typename Queue>
+void Produce(Queue* queue)
+{
+    for (int i = 1; i <= kItems; i++)
+    {
+        queue->Put(i);
+    }
+}
+
+void Consume(BlockingQueue<int>* queue)
+{
+    int64_t sum = 0;
+    for (int i = 0; i < kItems; i++)
+    {
+        sum += queue->Take();
+    }
+    g_sum += sum;
+}
+
+void Consume(BoundedBlockingQueue<int>* queue)
+{
+    int64_t sum = 0;
+    int taken = 0;
+    std::vector<int> items;
+    while (taken < kItems)
+    {
+        items.clear();
+        taken += static_cast<int>(queue->TakeBatch(&items, kItems - taken, -1));
+        for (auto it = items.begin(); it != items.end(); ++it)
+        {
+            sum += *it;
+        }
+    }
+    g_sum += sum;
+}
+
+template<typename Queue>
+void Bench(const char* name, Queue* queue)
+{
+    g_sum = 0;
+    boost::ptr_vector<Thread> threads;
+
+    auto start = Timestamp::Now();
+    for (int i = 0; i < kThreads; i++)
+    {
+        threads.push_back(new Thread(boost::bind(&Produce<Queue>, queue), "producer"));
+        threads.push_back(new Thread(boost::bind(
+            static_cast<void (*)(Queue*)>(&Consume), queue), "consumer"));
+    }
+    for (auto it = threads.begin(); it != threads.end(); ++it)
+    {
+        (*it).Start();
+    }
+    for (auto it = threads.begin(); it != threads.end(); ++it)
+    {
+        (*it).Join();
+    }
+    auto elapsed = TimeDifference(Timestamp::Now(), start);
+
+    int64_t expected = int64_t(kThreads) * kItems * (kItems + 1) / 2;
+    printf("%-20s %d items by %d producers and consumers in %ld ms, sum %s\n",
+           name, kThreads * kItems, kThreads, elapsed / 1000,
+           g_sum == expected ? "ok" : "WRONG");
+}
+
+void CheckPolicies()
+{
+    BoundedBlockingQueue<int> newest(4, BoundedBlockingQueue<int>::kDropNewest);
+    BoundedBlockingQueue<int> oldest(4, BoundedBlockingQueue<int>::kDropOldest);
+    for (int i = 0; i < 6; i++)
+    {
+        newest.Put(i);
+        oldest.Put(i);
+    }
+
+    std::vector<int> a, b;
+    newest.TakeBatch(&a, 10, 0);
+    oldest.TakeBatch(&b, 10, 0);
+    printf("drop newest keeps %d..%d dropped %ld, drop oldest keeps %d..%d dropped %ld\n",
+           a.front(), a.back(), newest.dropped(), b.front(), b.back(), oldest.dropped());
+
+    std::vector<int> batch;
+    for (int i = 0; i < 3; i++)
+    {
+        batch.push_back(i);
+    }
+    auto put = newest.PutBatch(std::move(batch));
+
+    std::vector<int> c;
+    auto start = Timestamp::Now();
+    auto taken = newest.TakeBatch(&c, 10, 0);
+    taken += newest.TakeBatch(&c, 10, 50);
+    printf("PutBatch %zu, TakeBatch %zu then timeout after %ld ms\n",
+           put, taken, TimeDifference(Timestamp::Now(), start) / 1000);
+}
+
+int main()
+{
+    BlockingQueue<int> unbounded;
+    Bench("BlockingQueue", &unbounded);
+
+    BoundedBlockingQueue<int> bounded(1 << 20);
+    Bench("BoundedBlockingQueue", &bounded);
+
+    CheckPolicies();
+    return 0;
+}
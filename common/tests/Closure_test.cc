@@ -0,0 +1,151 @@
+#include <claire/common/base/Closure.h>
+#include <claire/common/time/Timestamp.h>
+#include <claire/common/logging/Logging.h>
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <deque>
+#include <string>
+#include <utility>
+#include <functional>
+
+using namespace claire;
+
+const int kTasks = 1000000;
+
+int64_t allocations = 0;
+
+void* operator new(size_t size)
+{
+    allocations++;
+    auto p = malloc(size);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+struct Connection
+{
+    Connection() : sent(0) {}
+
+    void Send(int64_t id, int length)
+    {
+        sent += id + length;
+    }
+
+    void SendData(const std::string& data, int64_t id)
+    {
+        sent += id + static_cast<int64_t>(data.size());
+    }
+
+    int64_t sent;
+};
+
+// like ThreadPool, every task is queued with its trace context then taken out
+template<typename Task>
+void Bench(const char* name, const boost::shared_ptr<Connection>& connection)
+{
+    std::deque<std::pair<int64_t, Task> > queue;
+
+    auto start_allocations = allocations;
+    auto start = Timestamp::Now();
+    for (int i = 0; i < kTasks; i++)
+    {
+        queue.push_back(std::make_pair(int64_t(i),
+                                       Task(boost::bind(&Connection::Send, connection, int64_t(i), 100))));
+        std::pair<int64_t, Task> entry(std::move(queue.front()));
+        queue.pop_front();
+        entry.second();
+    }
+    auto elapsed = TimeDifference(Timestamp::Now(), start);
+
+    printf("%-16s %.1f ns, %.2f allocations per task\n",
+           name,
+           static_cast<double>(elapsed) * 1000 / kTasks,
+           static_cast<double>(allocations - start_allocations) / kTasks);
+}
+
+void Nothing()
+{
+}
+
+void CheckMove()
+{
+    auto connection = boost::make_shared<Connection>();
+    std::string large(200, 'x');
+
+    // a copy of the string makes the functor too large to be inlined
+    auto bound = boost::bind(&Connection::SendData, connection, large, int64_t(3));
+    static_assert(sizeof(bound) > Closure::kInlineSize, "functor should be allocated");
+
+    auto start_allocations = allocations;
+    Closure inlined(boost::bind(&Connection::Send, connection, int64_t(1), 2));
+    CHECK_EQ(allocations - start_allocations, 0);
+    Closure allocated(std::move(bound));
+    CHECK_EQ(allocations - start_allocations, 1);
+
+    Closure moved(std::move(inlined));
+    Closure relocated(std::move(allocated));
+    CHECK_EQ(allocations - start_allocations, 1) << "moves should not allocate";
+    CHECK(!inlined && !allocated) << "moved from should be empty";
+    moved();
+    relocated();
+
+    Closure empty;
+    empty = std::move(moved);
+    CHECK(!moved && empty);
+    empty();
+    CHECK_EQ(connection->sent, (1+2)*2 + 200+3);
+
+    // bound copies of connection are released with the closures
+    CHECK_EQ(connection.use_count(), 3);
+    empty.reset();
+    relocated.reset();
+    CHECK_EQ(connection.use_count(), 1);
+
+    printf("moved, sent %ld, use_count %ld\n",
+           connection->sent,
+           connection.use_count());
+}
+
+void CheckEmptySources()
+{
+    CHECK(!Closure(boost::function<void()>()));
+    CHECK(!Closure(std::function<void()>()));
+    CHECK(!Closure(static_cast<void (*)()>(NULL)));
+
+    CHECK(Closure(boost::function<void()>(&Nothing)));
+    CHECK(Closure(std::function<void()>(&Nothing)));
+    CHECK(Closure(&Nothing));
+    CHECK(Closure(Nothing));
+    printf("empty sources make empty closures\n");
+}
+
+int main()
+{
+    CheckMove();
+    CheckEmptySources();
+
+    auto connection = boost::make_shared<Connection>();
+    Bench<boost::function<void()> >("boost::function", connection);
+    Bench<Closure>("Closure", connection);
+    return 0;
+}
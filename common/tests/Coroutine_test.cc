@@ -0,0 +1,161 @@
+#include <claire/common/events/Coroutine.h>
+#include <claire/common/events/EventLoopThread.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <string>
+#include <stdexcept>
+
+#include <boost/make_shared.hpp>
+
+#include <claire/netty/Socket.h>
+#include <claire/netty/ConnectionReader.h>
+#include <claire/common/logging/Logging.h>
+
+using namespace claire;
+
+const int kCalls = 1000000;
+
+int64_t allocations = 0;
+
+void* operator new(size_t size)
+{
+    allocations++;
+    auto p = malloc(size);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+Task<int> Add(int a, int b)
+{
+    co_return a + b;
+}
+
+Task<int> Fail()
+{
+    throw std::runtime_error("failed");
+    co_return 0;
+}
+
+Task<void> Sum(int64_t* sum)
+{
+    for (int i = 0; i < kCalls; i++)
+    {
+        *sum += co_await Add(i, 1);
+    }
+}
+
+Task<void> Sleeper(EventLoop* loop, int ms, int* finished)
+{
+    co_await Sleep(loop, ms);
+    ++*finished;
+}
+
+Task<void> ReadBeforeClose(EventLoop* loop, TcpConnectionPtr connection, int peer)
+{
+    ConnectionReader reader(connection);
+    ::write(peer, "hello", 5);
+    ::close(peer);
+
+    // data and close both arrive while the reader is busy
+    co_await Sleep(loop, 50);
+    auto buffer = co_await reader.Read();
+    CHECK(buffer != NULL) << "data lost when followed by close";
+    CHECK_EQ(std::string(buffer->Peek(), buffer->ReadableBytes()), "hello");
+    buffer->ConsumeAll();
+
+    buffer = co_await reader.Read();
+    CHECK(buffer == NULL) << "closed connection still readable";
+    printf("data followed by close read before NULL\n");
+    connection->ConnectDestroyed();
+}
+
+Task<void> Run(EventLoop* loop, EventLoop* other)
+{
+    // nested calls, frames come from the pool after the first one
+    int64_t sum = 0;
+    co_await Sum(&sum);
+    auto start_allocations = allocations;
+    auto start = Timestamp::Now();
+    co_await Sum(&sum);
+    auto elapsed = TimeDifference(Timestamp::Now(), start);
+    printf("%d co_await calls: %.1f ns, %.3f allocations per call, sum %ld\n",
+           kCalls,
+           static_cast<double>(elapsed) * 1000 / kCalls,
+           static_cast<double>(allocations - start_allocations) / kCalls,
+           sum);
+
+    // fan-out, all sleepers wait together
+    int finished = 0;
+    start = Timestamp::Now();
+    for (int i = 0; i < 100; i++)
+    {
+        Spawn(loop, Sleeper(loop, 50, &finished));
+    }
+    co_await Sleep(loop, 100);
+    printf("%d of 100 sleepers finished in %ld ms\n",
+           finished, TimeDifference(Timestamp::Now(), start) / 1000);
+
+    // fan-out, children sleep at the same time
+    std::vector<Task<void> > children;
+    finished = 0;
+    for (int i = 0; i < 10; i++)
+    {
+        children.push_back(Sleeper(loop, 50, &finished));
+    }
+    start = Timestamp::Now();
+    co_await WhenAll(std::move(children));
+    printf("WhenAll of %d sleepers took %ld ms\n",
+           finished, TimeDifference(Timestamp::Now(), start) / 1000);
+
+    co_await SwitchTo(other);
+    bool in_other = other->IsInLoopThread();
+    co_await SwitchTo(loop);
+    printf("switched to other loop %s, back %s\n",
+           in_other ? "yes" : "NO", loop->IsInLoopThread() ? "yes" : "NO");
+
+    try
+    {
+        co_await Fail();
+        printf("exception NOT propagated\n");
+    }
+    catch (const std::exception& e)
+    {
+        printf("exception propagated: %s\n", e.what());
+    }
+
+    int fds[2];
+    ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds);
+    auto connection = boost::make_shared<TcpConnection>(loop, Socket(fds[0]), 1);
+    connection->ConnectEstablished();
+    co_await ReadBeforeClose(loop, connection, fds[1]);
+
+    loop->quit();
+}
+
+int main()
+{
+    EventLoop loop;
+    EventLoopThread thread((EventLoopThread::ThreadInitCallback()));
+    auto other = thread.StartLoop();
+
+    Spawn(&loop, Run(&loop, other));
+    loop.loop();
+    return 0;
+}
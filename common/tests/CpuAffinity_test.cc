@@ -0,0 +1,160 @@
+#include <claire/common/threading/CpuAffinity.h>
+#include <claire/common/threading/Thread.h>
+#include <claire/common/threading/ThisThread.h>
+#include <claire/common/logging/Logging.h>
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/bind.hpp>
+
+using namespace claire;
+
+// cpus of the first count threads, a cpu list gives one each
+std::vector<int> CpusOf(const CpuAffinity& affinity, int count)
+{
+    std::vector<int> cpus;
+    for (int i = 0; i < count; i++)
+    {
+        auto cpu = affinity.CpusOf(i);
+        CHECK_EQ(cpu.size(), 1u);
+        cpus.push_back(cpu.front());
+    }
+    return cpus;
+}
+
+void TestCpuList(const char* spec, const char* formatted, int count, const char* assigned)
+{
+    CpuAffinity affinity;
+    CHECK(CpuAffinity::Parse(spec, &affinity)) << spec;
+    CHECK_EQ(affinity.policy(), CpuAffinity::kCpuList);
+    CHECK_EQ(affinity.ToString(), formatted);
+
+    // round-robin over the list, which keeps its order
+    auto cpus = CpusOf(affinity, count);
+    CHECK_EQ(CpuAffinity::FormatCpuList(cpus), assigned) << spec;
+
+    // formatted list parses to the same one
+    CpuAffinity again;
+    CHECK(CpuAffinity::Parse(affinity.ToString(), &again));
+    CHECK(CpusOf(again, count) == cpus) << spec;
+
+    printf("%-12s -> %-10s threads on %s\n", spec, formatted, assigned);
+}
+
+void TestMalformed(const char* spec)
+{
+    // left unchanged if failed
+    CpuAffinity affinity(CpuAffinity::kNumaNode);
+    CHECK(!CpuAffinity::Parse(spec, &affinity)) << spec;
+    CHECK_EQ(affinity.policy(), CpuAffinity::kNumaNode);
+    printf("'%s' rejected\n", spec);
+}
+
+void TestPolicy(const char* spec, CpuAffinity::Policy policy, const char* formatted)
+{
+    CpuAffinity affinity(std::vector<int>(1, 0));
+    CHECK(CpuAffinity::Parse(spec, &affinity)) << spec;
+    CHECK_EQ(affinity.policy(), policy);
+    CHECK_EQ(affinity.ToString(), formatted);
+    printf("'%s' -> %s\n", spec, formatted);
+}
+
+void TestFormat(const std::vector<int>& cpus, const char* formatted)
+{
+    CHECK_EQ(CpuAffinity::FormatCpuList(cpus), formatted);
+    printf("formatted %s\n", formatted);
+}
+
+void TestReserve()
+{
+    CpuAffinity first, second;
+    CHECK(CpuAffinity::Parse("0-3", &first));
+    CHECK(CpuAffinity::Parse("0-3", &second));
+    first.Reserve(2);
+    second.Reserve(2);
+
+    // the second group goes on where the first one ended
+    CHECK_EQ((first.CpusOf(0).front() + 2) % 4, second.CpusOf(0).front());
+    CHECK_EQ((first.CpusOf(1).front() + 2) % 4, second.CpusOf(1).front());
+    printf("second group starts at cpu %d\n", second.CpusOf(0).front());
+}
+
+bool Mapped(pid_t tid)
+{
+    auto mappings = CpuAffinity::GetMappings();
+    for (auto it = mappings.begin(); it != mappings.end(); ++it)
+    {
+        if ((*it).tid == tid)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Pin(pid_t* tid)
+{
+    CHECK(CpuAffinity(CpuAffinity::kPhysicalCore).Apply(0));
+    *tid = ThisThread::tid();
+    CHECK(Mapped(*tid));
+}
+
+void TestMappingErased()
+{
+    pid_t tid = 0;
+    Thread thread(boost::bind(&Pin, &tid), "pinned");
+    thread.Start();
+    thread.Join();
+
+    CHECK(!Mapped(tid)) << "mapping of exited thread " << tid << " left";
+    printf("mapping of exited thread erased\n");
+}
+
+int main()
+{
+    TestCpuList("0-3,8", "0-3,8", 6, "0-3,8,0");
+    TestCpuList("5", "5", 2, "5,5");
+    TestCpuList("1,2,3", "1-3", 3, "1-3");
+    TestCpuList("0-0", "0", 1, "0");
+    TestCpuList("3,1,2", "3,1-2", 3, "3,1-2");
+    TestCpuList("0,2,4-5", "0,2,4-5", 4, "0,2,4-5");
+    TestCpuList("7-9,0", "7-9,0", 5, "7-9,0,7");
+
+    TestMalformed("abc");
+    TestMalformed("1-");
+    TestMalformed("-1");
+    TestMalformed("3-1");
+    TestMalformed("1,");
+    TestMalformed(",1");
+    TestMalformed("1,,2");
+    TestMalformed("1 2");
+    TestMalformed(" 1");
+    TestMalformed("+1");
+    TestMalformed("1-+2");
+    TestMalformed("1-2-3");
+    TestMalformed("1.5");
+    TestMalformed("99999");
+    TestMalformed("0-99999");
+    TestMalformed("core");
+
+    TestPolicy("", CpuAffinity::kNone, "none");
+    TestPolicy("none", CpuAffinity::kNone, "none");
+    TestPolicy("cores", CpuAffinity::kPhysicalCore, "cores");
+    TestPolicy("numa", CpuAffinity::kNumaNode, "numa");
+
+    TestFormat(std::vector<int>(), "");
+    int gaps[] = { 0, 2, 4 };
+    TestFormat(std::vector<int>(gaps, gaps + 3), "0,2,4");
+    int runs[] = { 0, 1, 3, 4, 5, 9 };
+    TestFormat(std::vector<int>(runs, runs + 6), "0-1,3-5,9");
+
+    // not pinned
+    CHECK(CpuAffinity().CpusOf(0).empty());
+
+    TestReserve();
+    TestMappingErased();
+    return 0;
+}
@@ -0,0 +1,125 @@
+#include <claire/common/events/EventLoop.h>
+#include <claire/common/events/EventLoopThread.h>
+#include <claire/common/events/Channel.h>
+#include <claire/common/threading/CountDownLatch.h>
+#include <claire/common/logging/Logging.h>
+#include <claire/common/metrics/CounterProvider.h>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+using namespace claire;
+
+const int kBusyPollMs = 20;
+
+int g_fd;
+boost::scoped_ptr<Channel> g_channel;
+
+int CounterValue(const char* name)
+{
+    return CounterProvider::instance()->GetCounterValue(name);
+}
+
+void OnRead()
+{
+    uint64_t value;
+    ::read(g_fd, &value, sizeof value);
+}
+
+void Setup(int busy_poll_us, EventLoop* loop)
+{
+    loop->SetBusyPoll(busy_poll_us);
+    g_channel.reset(new Channel(loop, g_fd));
+    g_channel->set_read_callback(&OnRead);
+    g_channel->EnableReading();
+}
+
+void TearDown(CountDownLatch* latch)
+{
+    g_channel->DisableAll();
+    g_channel->Remove();
+    g_channel.reset();
+    latch->CountDown();
+}
+
+struct PollCounts
+{
+    PollCounts()
+        : spin(CounterValue("claire.EventLoop.spin_polls")),
+          idle_spin(CounterValue("claire.EventLoop.idle_spin_polls")),
+          blocking(CounterValue("claire.EventLoop.blocking_polls"))
+    {}
+
+    int spin;
+    int idle_spin;
+    int blocking;
+};
+
+// one read is the only activity, then the loop stays idle for a while
+void RunOneActivity(int busy_poll_us, PollCounts* before, PollCounts* spun, PollCounts* idle)
+{
+    g_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    EventLoopThread thread(boost::bind(&Setup, busy_poll_us, _1));
+    auto loop = thread.StartLoop();
+
+    // let the loop settle into blocking poll first
+    ::usleep(kBusyPollMs*3*1000);
+    *before = PollCounts();
+
+    uint64_t one = 1;
+    ::write(g_fd, &one, sizeof one);
+    ::usleep(kBusyPollMs*3*1000);
+    *spun = PollCounts();
+
+    ::usleep(kBusyPollMs*3*1000);
+    *idle = PollCounts();
+
+    CountDownLatch latch(1);
+    loop->Run(boost::bind(&TearDown, &latch));
+    latch.Wait();
+    ::close(g_fd);
+}
+
+void TestSpinAfterActivity()
+{
+    PollCounts before, spun, idle;
+    RunOneActivity(kBusyPollMs*1000, &before, &spun, &idle);
+
+    // a blocking poll wakes for the read, then spins in the window
+    // after it, finding nothing as the read is the only activity
+    CHECK_GT(spun.blocking, before.blocking);
+    CHECK_GT(spun.spin - before.spin, 10);
+    CHECK_EQ(spun.idle_spin - before.idle_spin, spun.spin - before.spin);
+
+    // then falls back to blocking poll with the loop idle
+    CHECK_EQ(idle.spin, spun.spin);
+    CHECK_EQ(idle.idle_spin, spun.idle_spin);
+    CHECK_GT(idle.blocking, spun.blocking);
+
+    printf("busy poll %d ms: %d spin polls, then %d blocking polls\n",
+           kBusyPollMs, spun.spin - before.spin, idle.blocking - spun.blocking);
+}
+
+void TestNoSpinWhenDisabled()
+{
+    PollCounts before, spun, idle;
+    RunOneActivity(0, &before, &spun, &idle);
+
+    CHECK_EQ(idle.spin, before.spin);
+    CHECK_EQ(idle.idle_spin, before.idle_spin);
+    CHECK_GT(spun.blocking, before.blocking);
+    CHECK_GT(idle.blocking, spun.blocking);
+    printf("busy poll disabled: %d blocking polls, no spin\n", idle.blocking - before.blocking);
+}
+
+int main()
+{
+    TestSpinAfterActivity();
+    TestNoSpinWhenDisabled();
+    return 0;
+}
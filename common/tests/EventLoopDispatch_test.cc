@@ -0,0 +1,88 @@
+#include <claire/common/events/EventLoop.h>
+#include <claire/common/events/Channel.h>
+
+#include <boost/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+
+#include <vector>
+
+using namespace claire;
+
+const int kRounds = 200;
+
+int64_t dispatched = 0;
+int64_t expected = 0;
+EventLoop* g_loop;
+
+void OnRead()
+{
+    // eventfd stays readable, every poll returns all of them
+    if (++dispatched == expected)
+    {
+        g_loop->quit();
+    }
+}
+
+void Dispatch(int num_fds, bool mixed)
+{
+    EventLoop loop;
+    g_loop = &loop;
+
+    std::vector<int> fds;
+    boost::ptr_vector<Channel> channels;
+    for (int i = 0; i < num_fds; i++)
+    {
+        auto fd = ::eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+        fds.push_back(fd);
+
+        channels.push_back(new Channel(&loop, fd));
+        auto& channel = channels.back();
+        channel.set_read_callback(&OnRead);
+        if (mixed && i % 100 == 0)
+        {
+            channel.set_priority(Channel::Priority::kHigh);
+        }
+        channel.EnableReading();
+    }
+
+    dispatched = 0;
+    expected = static_cast<int64_t>(num_fds) * kRounds;
+
+    auto start = Timestamp::Now();
+    loop.loop();
+    auto elapsed = TimeDifference(Timestamp::Now(), start);
+
+    printf("%5d ready fds, %s: %.1f us per iteration, %.1f ns per channel\n",
+           num_fds, mixed ? "1% high priority" : "all normal       ",
+           static_cast<double>(elapsed) / kRounds,
+           static_cast<double>(elapsed) * 1000 / expected);
+
+    for (auto it = channels.begin(); it != channels.end(); ++it)
+    {
+        (*it).DisableAll();
+        (*it).Remove();
+    }
+    for (auto it = fds.begin(); it != fds.end(); ++it)
+    {
+        ::close(*it);
+    }
+}
+
+int main()
+{
+    struct rlimit limit;
+    ::getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    ::setrlimit(RLIMIT_NOFILE, &limit);
+
+    Dispatch(1000, false);
+    Dispatch(1000, true);
+    Dispatch(10000, false);
+    Dispatch(10000, true);
+    return 0;
+}
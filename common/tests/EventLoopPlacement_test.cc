@@ -0,0 +1,116 @@
+#include <claire/common/events/EventLoop.h>
+#include <claire/common/events/EventLoopThread.h>
+#include <claire/common/events/EventLoopThreadPool.h>
+#include <claire/common/logging/Logging.h>
+
+#include <stdio.h>
+
+#include <set>
+#include <vector>
+
+using namespace claire;
+
+const int kThreads = 4;
+
+void ResetLoads(const std::vector<EventLoop*>& loops)
+{
+    for (auto it = loops.begin(); it != loops.end(); ++it)
+    {
+        auto& load = (*it)->load();
+        load.connections = 0;
+        load.pending_bytes = 0;
+        load.busy_permille = 0;
+    }
+}
+
+// every pick is the least loaded loop, wherever round-robin is
+void CheckLeast(EventLoopThreadPool* pool,
+                const std::vector<EventLoop*>& loops,
+                EventLoopThreadPool::Placement placement,
+                const char* name,
+                int least)
+{
+    pool->set_placement(placement);
+    for (int i = 0; i < kThreads*2; i++)
+    {
+        CHECK_EQ(pool->NextLoop(), loops[least]) << name << " pick " << i;
+    }
+    printf("%-20s picks loop %d\n", name, least);
+    ResetLoads(loops);
+}
+
+void TestRoundRobin(EventLoopThreadPool* pool, const std::vector<EventLoop*>& loops)
+{
+    pool->set_placement(EventLoopThreadPool::kRoundRobin);
+
+    // loads are not looked at
+    loops[0]->load().connections = 100;
+    auto first = pool->NextLoop();
+    auto start = 0;
+    while (loops[start] != first)
+    {
+        start++;
+    }
+    for (int i = 1; i < kThreads*2; i++)
+    {
+        CHECK_EQ(pool->NextLoop(), loops[(start + i) % kThreads]);
+    }
+    printf("%-20s picks every loop in turn\n", "round_robin");
+    ResetLoads(loops);
+}
+
+void TestTies(EventLoopThreadPool* pool, const std::vector<EventLoop*>& loops)
+{
+    pool->set_placement(EventLoopThreadPool::kLeastConnections);
+    loops[0]->load().connections = 1;
+    loops[3]->load().connections = 1;
+
+    std::set<EventLoop*> picked;
+    for (int i = 0; i < kThreads*2; i++)
+    {
+        auto loop = pool->NextLoop();
+        CHECK(loop == loops[1] || loop == loops[2]);
+        picked.insert(loop);
+    }
+    CHECK_EQ(picked.size(), 2u) << "ties should be broken round-robin";
+    printf("%-20s spreads over the least loaded loops\n", "ties");
+    ResetLoads(loops);
+}
+
+int main()
+{
+    EventLoopThreadPool::Placement placement;
+    CHECK(EventLoopThreadPool::ParsePlacement("least_busy_time", &placement));
+    CHECK_EQ(placement, EventLoopThreadPool::kLeastBusyTime);
+    CHECK(!EventLoopThreadPool::ParsePlacement("least_load", &placement));
+
+    EventLoop loop;
+    EventLoopThreadPool pool(&loop);
+    pool.set_num_threads(kThreads);
+    pool.Start();
+    auto loops = pool.GetAllLoops();
+    CHECK_EQ(static_cast<int>(loops.size()), kThreads);
+    ResetLoads(loops);
+
+    TestRoundRobin(&pool, loops);
+
+    loops[0]->load().connections = 3;
+    loops[1]->load().connections = 1;
+    loops[2]->load().connections = 2;
+    loops[3]->load().connections = 5;
+    CheckLeast(&pool, loops, EventLoopThreadPool::kLeastConnections, "least_connections", 1);
+
+    loops[0]->load().pending_bytes = 4096;
+    loops[1]->load().pending_bytes = 1024;
+    loops[3]->load().pending_bytes = 512;
+    CheckLeast(&pool, loops, EventLoopThreadPool::kLeastPendingBytes, "least_pending_bytes", 2);
+
+    loops[0]->load().busy_permille = 500;
+    loops[1]->load().busy_permille = 900;
+    loops[2]->load().busy_permille = 300;
+    loops[3]->load().busy_permille = 100;
+    CheckLeast(&pool, loops, EventLoopThreadPool::kLeastBusyTime, "least_busy_time", 3);
+
+    TestTies(&pool, loops);
+    return 0;
+}
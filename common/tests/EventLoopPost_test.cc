@@ -0,0 +1,122 @@
+// Copyright (c) 2013 The claire-common Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+
+#include <new>
+
+#include <boost/bind.hpp>
+#include <boost/atomic.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include <claire/common/events/EventLoop.h>
+#include <claire/common/threading/Thread.h>
+#include <claire/common/time/Timestamp.h>
+
+using namespace claire;
+
+const int kThreads = 4;
+const int kPostsPerThread = 1000000;
+
+int g_count = 0;
+int g_last[kThreads];
+bool g_ordered = true;
+boost::atomic<int> g_done[kThreads]; // tasks of each producer run
+
+boost::atomic<int64_t> g_allocations(0);
+
+void* operator new(size_t size)
+{
+    g_allocations.fetch_add(1, boost::memory_order_relaxed);
+    auto p = malloc(size);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+void OnTask(EventLoop* loop, int thread, int seq)
+{
+    if (seq != g_last[thread] + 1)
+    {
+        g_ordered = false;
+    }
+    g_last[thread] = seq;
+    g_done[thread].store(seq+1, boost::memory_order_release);
+
+    if (++g_count == kThreads * kPostsPerThread)
+    {
+        loop->quit();
+    }
+}
+
+// window 0 posts as fast as it can, otherwise keeps at most window
+// tasks of this thread not run yet
+void Producer(EventLoop* loop, int thread, int window)
+{
+    for (int i = 0; i < kPostsPerThread; i++)
+    {
+        while (window > 0 && i - g_done[thread].load(boost::memory_order_acquire) >= window)
+        {
+            sched_yield();
+        }
+        loop->Post(boost::bind(&OnTask, loop, thread, i));
+    }
+}
+
+void RunRound(int window)
+{
+    EventLoop loop;
+    g_count = 0;
+    for (int i = 0; i < kThreads; i++)
+    {
+        g_last[i] = -1;
+        g_done[i] = 0;
+    }
+
+    auto start_allocations = g_allocations.load();
+    auto start = Timestamp::Now();
+    boost::ptr_vector<Thread> threads;
+    for (int i = 0; i < kThreads; i++)
+    {
+        threads.push_back(new Thread(boost::bind(&Producer, &loop, i, window), "producer"));
+        threads.back().Start();
+    }
+
+    loop.loop();
+    for (auto it = threads.begin(); it != threads.end(); ++it)
+    {
+        (*it).Join();
+    }
+
+    // nodes of tasks run are reused by later posts, unless producers
+    // run too far ahead of the loop
+    auto elapsed = TimeDifference(Timestamp::Now(), start);
+    printf("window %d: %d tasks in %.3f seconds, %.3f allocations per post, %s\n",
+           window,
+           g_count,
+           static_cast<double>(elapsed) / 1000000,
+           static_cast<double>(g_allocations.load() - start_allocations) / g_count,
+           g_ordered ? "in order" : "OUT OF ORDER");
+}
+
+int main()
+{
+    RunRound(0);
+    RunRound(256);
+    return g_ordered ? 0 : 1;
+}
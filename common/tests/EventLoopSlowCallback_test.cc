@@ -0,0 +1,120 @@
+#include <claire/common/events/EventLoop.h>
+#include <claire/common/events/Channel.h>
+#include <claire/common/logging/Logging.h>
+#include <claire/common/logging/LogMessage.h>
+#include <claire/common/metrics/CounterProvider.h>
+
+#include <boost/bind.hpp>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include <string>
+
+DECLARE_int32(eventloop_slow_callback_ms);
+
+using namespace claire;
+
+const int kSlowMs = 60;
+
+std::string g_log;
+
+void CaptureOutput(const char* msg, size_t len)
+{
+    g_log.append(msg, len);
+}
+
+void StdoutOutput(const char* msg, size_t len)
+{
+    ::fwrite(msg, 1, len, stdout);
+}
+
+int CounterValue(const char* name)
+{
+    return CounterProvider::instance()->GetCounterValue(name);
+}
+
+void SlowTask()
+{
+    ::usleep(kSlowMs*1000);
+}
+
+void SlowRead(int fd)
+{
+    uint64_t value;
+    ::read(fd, &value, sizeof value);
+    ::usleep(kSlowMs*1000);
+}
+
+// one slow task and one slow channel callback, then idle in poll
+void RunSlowCallbacks()
+{
+    EventLoop loop;
+    int fd = ::eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+    Channel channel(&loop, fd);
+    channel.set_read_callback(boost::bind(&SlowRead, fd));
+    channel.EnableReading();
+
+    loop.Post(&SlowTask);
+    loop.Post(&SlowTask);
+    loop.RunAfter(kSlowMs*4, boost::bind(&EventLoop::quit, &loop));
+    loop.loop();
+
+    channel.DisableAll();
+    channel.Remove();
+    ::close(fd);
+}
+
+void TestSlowCallbacksLogged()
+{
+    FLAGS_eventloop_slow_callback_ms = kSlowMs/2;
+    int slow = CounterValue("claire.EventLoop.slow_callbacks");
+    int poll_ms = CounterValue("claire.EventLoop.poll_ms");
+    int callback_ms = CounterValue("claire.EventLoop.callback_ms");
+    int task_ms = CounterValue("claire.EventLoop.task_ms");
+
+    g_log.clear();
+    LogMessage::SetOutput(&CaptureOutput);
+    RunSlowCallbacks();
+    LogMessage::SetOutput(&StdoutOutput);
+
+    CHECK_EQ(CounterValue("claire.EventLoop.slow_callbacks") - slow, 3);
+    CHECK(g_log.find("Slow channel callback of EventLoop") != std::string::npos) << g_log;
+    CHECK(g_log.find("Slow task of EventLoop") != std::string::npos) << g_log;
+    // the callback and the task are named by their types
+    CHECK(g_log.find("void (*)(int)") != std::string::npos) << g_log;
+    CHECK(g_log.find("task void (*)()") != std::string::npos) << g_log;
+
+    // each phase is counted in the counter of it
+    CHECK_GE(CounterValue("claire.EventLoop.callback_ms") - callback_ms, kSlowMs);
+    CHECK_GE(CounterValue("claire.EventLoop.task_ms") - task_ms, kSlowMs*2);
+    CHECK_GE(CounterValue("claire.EventLoop.poll_ms") - poll_ms, kSlowMs/2);
+    printf("slow callbacks logged, callback %d ms, task %d ms, poll %d ms\n",
+           CounterValue("claire.EventLoop.callback_ms") - callback_ms,
+           CounterValue("claire.EventLoop.task_ms") - task_ms,
+           CounterValue("claire.EventLoop.poll_ms") - poll_ms);
+}
+
+void TestSlowCallbacksNotLogged()
+{
+    FLAGS_eventloop_slow_callback_ms = 0;
+    int slow = CounterValue("claire.EventLoop.slow_callbacks");
+
+    g_log.clear();
+    LogMessage::SetOutput(&CaptureOutput);
+    RunSlowCallbacks();
+    LogMessage::SetOutput(&StdoutOutput);
+
+    CHECK_EQ(CounterValue("claire.EventLoop.slow_callbacks"), slow);
+    CHECK(g_log.find("Slow ") == std::string::npos) << g_log;
+    printf("slow callbacks not logged when disabled\n");
+}
+
+int main()
+{
+    TestSlowCallbacksLogged();
+    TestSlowCallbacksNotLogged();
+    return 0;
+}
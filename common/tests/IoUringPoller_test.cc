@@ -0,0 +1,221 @@
+#include <claire/common/events/EventLoop.h>
+#include <claire/common/events/Channel.h>
+#include <claire/common/logging/Logging.h>
+
+#include <boost/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+
+#include <vector>
+
+#include "thirdparty/gflags/gflags.h"
+
+DECLARE_string(poller);
+
+using namespace claire;
+
+// more channels than entries of submission queue, so arming them
+// at once submits a full queue
+const int kManyChannels = 1000;
+
+void Drain(int fd, int* count)
+{
+    uint64_t value;
+    ::read(fd, &value, sizeof value);
+    ++*count;
+}
+
+void Count(int* count)
+{
+    ++*count;
+}
+
+void Notify(int fd)
+{
+    uint64_t value = 1;
+    ::write(fd, &value, sizeof value);
+}
+
+void CountAndQuit(int* count, int expected, EventLoop* loop)
+{
+    if (++*count == expected)
+    {
+        loop->quit();
+    }
+}
+
+void DrainAndQuit(int fd, int* count, int expected, EventLoop* loop)
+{
+    Drain(fd, count);
+    if (*count == expected)
+    {
+        loop->quit();
+    }
+}
+
+// one-shot poll request is armed again after every event
+void TestRearm()
+{
+    EventLoop loop;
+    auto fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    int count = 0;
+    Channel channel(&loop, fd);
+    channel.set_read_callback(boost::bind(&Drain, fd, &count));
+    channel.EnableReading();
+
+    for (int i = 1; i <= 5; i++)
+    {
+        loop.RunAfter(i * 20, boost::bind(&Notify, fd));
+    }
+    loop.RunAfter(200, boost::bind(&EventLoop::quit, &loop));
+    loop.loop();
+
+    CHECK_EQ(count, 5);
+    channel.DisableAll();
+    channel.Remove();
+    ::close(fd);
+    printf("rearm: %d events of 5 notifies\n", count);
+}
+
+// not drained fd is reported by every poll, like epoll
+void TestLevelTriggered()
+{
+    EventLoop loop;
+    auto fd = ::eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    int count = 0;
+    Channel channel(&loop, fd);
+    channel.set_read_callback(boost::bind(&CountAndQuit, &count, 10, &loop));
+    channel.EnableReading();
+    loop.loop();
+
+    CHECK_EQ(count, 10);
+    channel.DisableAll();
+    channel.Remove();
+    ::close(fd);
+    printf("level triggered: %d events\n", count);
+}
+
+// interest changed while the request is armed, the old one is canceled
+void TestInterestChange()
+{
+    EventLoop loop;
+    auto fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    int reads = 0;
+    int writes = 0;
+    Channel channel(&loop, fd);
+    channel.set_read_callback(boost::bind(&Count, &reads));
+    channel.set_write_callback(boost::bind(&CountAndQuit, &writes, 1, &loop));
+    channel.EnableReading();
+
+    // eventfd is always writable, but never readable
+    loop.RunAfter(20, boost::bind(&Channel::DisableReading, &channel));
+    loop.RunAfter(20, boost::bind(&Channel::EnableWriting, &channel));
+    loop.loop();
+
+    CHECK_EQ(reads, 0);
+    CHECK_EQ(writes, 1);
+    channel.DisableAll();
+    channel.Remove();
+    ::close(fd);
+    printf("interest change: %d reads, %d writes\n", reads, writes);
+}
+
+// removes the channel of a readable fd, and watches a new fd which
+// takes the same number, the request of the old one is stale
+void Replace(EventLoop* loop, Channel* removed, Channel** channel, int* count)
+{
+    removed->DisableAll();
+    removed->Remove();
+    ::close(removed->fd());
+
+    auto fd = ::eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+    CHECK_EQ(fd, removed->fd());
+    *channel = new Channel(loop, fd);
+    (*channel)->set_read_callback(boost::bind(&DrainAndQuit, fd, count, 1, loop));
+    (*channel)->EnableReading();
+}
+
+// removed channel gets nothing, even if its fd is reused at once
+void TestRemove()
+{
+    EventLoop loop;
+    auto fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    int removed = 0;
+    Channel channel(&loop, fd);
+    channel.set_read_callback(boost::bind(&Count, &removed));
+    channel.EnableReading();
+
+    int count = 0;
+    Channel* reused = NULL;
+    loop.RunAfter(20, boost::bind(&Notify, fd));
+    loop.RunAfter(20, boost::bind(&Replace, &loop, &channel, &reused, &count));
+    loop.loop();
+
+    CHECK_EQ(removed, 0);
+    CHECK_EQ(count, 1);
+    reused->DisableAll();
+    reused->Remove();
+    ::close(reused->fd());
+    delete reused;
+    printf("remove: %d events after removed, %d of fd reused\n", removed, count);
+}
+
+void TestManyChannels()
+{
+    EventLoop loop;
+
+    int count = 0;
+    std::vector<int> fds;
+    boost::ptr_vector<Channel> channels;
+    for (int i = 0; i < kManyChannels; i++)
+    {
+        auto fd = ::eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+        fds.push_back(fd);
+
+        channels.push_back(new Channel(&loop, fd));
+        channels.back().set_read_callback(
+            boost::bind(&DrainAndQuit, fd, &count, kManyChannels, &loop));
+        channels.back().EnableReading();
+    }
+    loop.loop();
+
+    CHECK_EQ(count, kManyChannels);
+    for (auto it = channels.begin(); it != channels.end(); ++it)
+    {
+        (*it).DisableAll();
+        (*it).Remove();
+    }
+    for (auto it = fds.begin(); it != fds.end(); ++it)
+    {
+        ::close(*it);
+    }
+    printf("many channels: %d events of %d\n", count, kManyChannels);
+}
+
+// runs with io_uring, unless --poller is given
+int main(int argc, char* argv[])
+{
+    FLAGS_poller = "io_uring";
+    ::google::ParseCommandLineFlags(&argc, &argv, true);
+
+    struct rlimit limit;
+    ::getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    ::setrlimit(RLIMIT_NOFILE, &limit);
+
+    TestRearm();
+    TestLevelTriggered();
+    TestInterestChange();
+    TestRemove();
+    TestManyChannels();
+    return 0;
+}
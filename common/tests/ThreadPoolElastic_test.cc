@@ -0,0 +1,141 @@
+#include <claire/common/threading/ThreadPool.h>
+#include <claire/common/threading/CountDownLatch.h>
+#include <claire/common/threading/ThisThread.h>
+#include <claire/common/time/Timestamp.h>
+#include <claire/common/logging/Logging.h>
+
+#include <boost/bind.hpp>
+
+#include <stdio.h>
+
+using namespace claire;
+
+const int kTasks = 400;
+
+// like a handler blocked on IO
+void BlockingCall(CountDownLatch* latch)
+{
+    ThisThread::SleepForMicroSeconds(5000);
+    latch->CountDown();
+}
+
+void Print(const char* when, const ThreadPool& pool)
+{
+    auto stats = pool.stats();
+    printf("%-12s threads %d (min %d max %d), grown %ld, retired %ld\n",
+           when, stats.num_threads, stats.min_threads, stats.max_threads,
+           stats.grown, stats.retired);
+}
+
+// tasks wait longer than target queue time, taken workers add more
+void TestGrowByWorkers()
+{
+    ThreadPool pool("elastic");
+    pool.set_max_threads(32);
+    pool.set_target_queue_time(2000);
+    pool.set_keep_alive(200);
+    pool.Start(2);
+    Print("started", pool);
+
+    CountDownLatch latch(kTasks);
+    auto start = Timestamp::Now();
+    for (int i = 0; i < kTasks; i++)
+    {
+        pool.Run(boost::bind(&BlockingCall, &latch));
+    }
+    latch.Wait();
+
+    // 2 fixed workers would take 1000 ms
+    printf("%d tasks of 5 ms took %ld ms\n",
+           kTasks, TimeDifference(Timestamp::Now(), start) / 1000);
+    Print("at peak", pool);
+    CHECK_GT(pool.stats().num_threads, 2);
+
+    // counted by every worker, also beyond the first few
+    CHECK_EQ(pool.stats().completed, kTasks);
+
+    ThisThread::SleepForMicroSeconds(1000 * 1000);
+    Print("after idle", pool);
+    CHECK_EQ(pool.stats().num_threads, 2);
+    CHECK_EQ(pool.stats().retired, pool.stats().grown);
+
+    pool.Stop();
+}
+
+void Finish(Timestamp* finished, CountDownLatch* latch)
+{
+    *finished = Timestamp::Now();
+    latch->CountDown();
+}
+
+// the only worker is stuck in a long task, so no one takes queued
+// tasks, the pool grows when tasks are run
+void TestGrowByProducer()
+{
+    ThreadPool pool("producer");
+    pool.set_max_threads(4);
+    pool.set_target_queue_time(10000);
+    pool.Start(1);
+
+    CountDownLatch done(2);
+    pool.Run(boost::bind(&ThisThread::SleepForMicroSeconds, 500 * 1000));
+
+    auto start = Timestamp::Now();
+    Timestamp finished;
+    pool.Run(boost::bind(&Finish, &finished, &done));
+    ThisThread::SleepForMicroSeconds(20 * 1000);
+    pool.Run(boost::bind(&Finish, &finished, &done));
+    done.Wait();
+
+    // not waiting for the stuck one
+    printf("queued behind stuck worker finished in %ld ms\n",
+           TimeDifference(finished, start) / 1000);
+    Print("producer", pool);
+    CHECK_LT(TimeDifference(finished, start), 250 * 1000);
+    CHECK_EQ(pool.stats().grown, 1);
+
+    pool.Stop();
+}
+
+void RecordThread(int* tid, CountDownLatch* latch)
+{
+    *tid = ThisThread::tid();
+    latch->CountDown();
+}
+
+// started with no worker, which are added on demand and retired to none
+void TestStartWithoutThreads()
+{
+    ThreadPool pool("on demand");
+    pool.set_max_threads(4);
+    pool.set_keep_alive(100);
+    pool.Start(0);
+
+    int tid = 0;
+    CountDownLatch latch(1);
+    pool.Run(boost::bind(&RecordThread, &tid, &latch));
+    latch.Wait();
+    CHECK_NE(tid, ThisThread::tid());
+    Print("on demand", pool);
+    CHECK_EQ(pool.stats().num_threads, 1);
+
+    ThisThread::SleepForMicroSeconds(500 * 1000);
+    Print("after idle", pool);
+    CHECK_EQ(pool.stats().num_threads, 0);
+
+    // grows again from none
+    CountDownLatch again(1);
+    pool.Run(boost::bind(&RecordThread, &tid, &again));
+    again.Wait();
+    CHECK_EQ(pool.stats().num_threads, 1);
+
+    pool.Stop();
+}
+
+int main()
+{
+    TestGrowByWorkers();
+    TestGrowByProducer();
+    TestStartWithoutThreads();
+    return 0;
+}
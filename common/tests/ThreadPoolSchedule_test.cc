@@ -0,0 +1,168 @@
+#include <claire/common/threading/ThreadPool.h>
+#include <claire/common/threading/CountDownLatch.h>
+#include <claire/common/threading/Thread.h>
+#include <claire/common/events/EventLoop.h>
+#include <claire/common/logging/Logging.h>
+#include <claire/netty/InetAddress.h>
+#include <claire/netty/http/HttpServer.h>
+#include <claire/netty/inspect/ThreadPoolsInspector.h>
+
+#include <boost/bind.hpp>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <string>
+
+using namespace claire;
+
+std::string g_order;
+
+void Append(char c)
+{
+    g_order += c;
+}
+
+void Block(CountDownLatch* started, CountDownLatch* release)
+{
+    started->CountDown();
+    release->Wait();
+}
+
+// body of GET path, read by Content-Length
+std::string Fetch(int port, const std::string& path)
+{
+    struct sockaddr_in address;
+    ::memset(&address, 0, sizeof address);
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    auto fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    CHECK_EQ(::connect(fd, reinterpret_cast<const struct sockaddr*>(&address), sizeof address), 0);
+    auto request = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    CHECK_EQ(::write(fd, request.data(), request.size()), static_cast<ssize_t>(request.size()));
+
+    std::string response;
+    size_t body_start = std::string::npos;
+    size_t length = 0;
+    char buf[4096];
+    while (body_start == std::string::npos || response.size() < body_start + length)
+    {
+        auto n = ::read(fd, buf, sizeof buf);
+        CHECK_GT(n, 0);
+        response.append(buf, n);
+
+        auto headers_end = response.find("\r\n\r\n");
+        if (body_start == std::string::npos && headers_end != std::string::npos)
+        {
+            body_start = headers_end + 4;
+            auto field = response.find("Content-Length: ");
+            CHECK(field != std::string::npos && field < headers_end) << response;
+            length = ::atoi(response.c_str() + field + 16);
+        }
+    }
+    ::close(fd);
+    return response.substr(body_start, length);
+}
+
+void FetchThreadPools(int port, std::string* body)
+{
+    *body = Fetch(port, "/threadpools");
+}
+
+// quits once the fetching connection is gone, not to destroy the server with it
+void OnConnection(EventLoop* loop, const HttpConnectionPtr& connection)
+{
+    if (!connection->connected())
+    {
+        loop->quit();
+    }
+}
+
+// the /threadpools page as served
+std::string ThreadPoolsPage()
+{
+    EventLoop loop;
+    HttpServer server(&loop, InetAddress("127.0.0.1", 0), "inspect");
+    ThreadPoolsInspector inspector(&server);
+    server.set_connection_callback(boost::bind(&OnConnection, &loop, _1));
+    server.Start();
+
+    std::string body;
+    Thread client(boost::bind(&FetchThreadPools, server.listen_address().port(), &body),
+                  "client");
+    client.Start();
+    loop.loop();
+    client.Join();
+    return body;
+}
+
+int main()
+{
+    ThreadPool pool("schedule");
+    pool.set_max_queue_size(5);
+    pool.Start(1);
+
+    // holds the only worker, so the rest is queued
+    CountDownLatch started(1), release(1);
+    pool.Run(boost::bind(&Block, &started, &release));
+    started.Wait();
+
+    auto past = Timestamp::Now();
+    auto future = AddTime(past, 10 * Timestamp::kMicroSecondsPerSecond);
+
+    pool.Run(boost::bind(&Append, 'l'), ThreadPool::kLow);
+    pool.Run(boost::bind(&Append, 'n'));
+    pool.Run(boost::bind(&Append, 'h'), ThreadPool::kHigh, future);
+    pool.Run(boost::bind(&Append, 'x'), ThreadPool::kHigh, past, boost::bind(&Append, 'e'));
+    pool.Run(boost::bind(&Append, 'N'), ThreadPool::kNormal);
+
+    // the queue is full
+    bool rejected = !pool.TryRun(boost::bind(&Append, 'r'));
+    CHECK(rejected);
+    CHECK_EQ(pool.queue_size(), 5u);
+
+    CountDownLatch done(1);
+    release.CountDown();
+    pool.Run(boost::bind(&CountDownLatch::CountDown, &done), ThreadPool::kLow);
+    done.Wait();
+
+    // high first with the expired one dropped, then normal and low FIFO
+    CHECK_EQ(g_order, "henNl");
+
+    // stops first, the worker may be still finishing the last task
+    pool.Stop();
+
+    auto stats = pool.stats();
+    CHECK_EQ(stats.name, "schedule");
+    CHECK_EQ(stats.min_threads, 1);
+    CHECK_EQ(stats.max_threads, 1);
+    CHECK_EQ(stats.active_threads, 0);
+    CHECK_EQ(stats.queue_size, 0u);
+    CHECK_EQ(stats.max_queue_size, 5u);
+    CHECK_EQ(stats.completed, 6);
+    CHECK_EQ(stats.rejected, 1);
+    CHECK_EQ(stats.expired, 1);
+    CHECK_GT(stats.queue_time, 0);
+    CHECK_GE(stats.run_time, 0);
+    CHECK_EQ(stats.grown, 0);
+    CHECK_EQ(stats.retired, 0);
+    printf("completed %ld, rejected %ld, expired %ld, queue time %ld us, run time %ld us\n",
+           stats.completed, stats.rejected, stats.expired, stats.queue_time, stats.run_time);
+
+    // the pool is listed with the same numbers, averaged over 6 completed and 1 expired
+    char row[256];
+    snprintf(row, sizeof row, "schedule\t%d\t1\t1\t0\t0\t5\t6\t1\t1\t%ld\t%ld\t0\t0\n",
+             stats.num_threads, stats.queue_time / 7, stats.run_time / 7);
+    auto page = ThreadPoolsPage();
+    CHECK_EQ(page.find("name\tthreads\tmin\tmax\tactive\tqueued\tmax_queue\t"), 0u) << page;
+    CHECK(page.find(row) != std::string::npos) << "no " << row << " in " << page;
+    printf("%s", page.c_str());
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include <claire/common/events/EventLoop.h>
+#include <claire/common/logging/Logging.h>
+
+#include <boost/bind.hpp>
+
+#include <stdio.h>
+
+#include <vector>
+#include <algorithm>
+
+DECLARE_int32(timer_wheel_tick_ms);
+
+using namespace claire;
+
+const int kTimers = 500000;
+
+int fired = 0;
+int64_t late = 0;
+
+void OnTimeout(int64_t expiration)
+{
+    fired++;
+    late = std::max(late, Timestamp::Now().MicroSecondsSinceEpoch() - expiration);
+}
+
+void Noop() {}
+
+// like rpc deadlines, every request adds a timer and cancels it on response
+double AddAndCancel(int tick_ms)
+{
+    FLAGS_timer_wheel_tick_ms = tick_ms;
+    EventLoop loop;
+
+    std::vector<TimerId> ids;
+    ids.reserve(kTimers);
+
+    auto start = Timestamp::Now();
+    for (int i = 0; i < kTimers; i++)
+    {
+        ids.push_back(loop.RunAfter(1000 + i % 30000, &Noop));
+    }
+    for (int i = 0; i < kTimers; i++)
+    {
+        loop.Cancel(ids[(i * 7919LL) % kTimers]);
+    }
+    return static_cast<double>(TimeDifference(Timestamp::Now(), start))
+        / Timestamp::kMicroSecondsPerSecond;
+}
+
+void CheckFiring()
+{
+    FLAGS_timer_wheel_tick_ms = 10;
+    EventLoop loop;
+
+    fired = 0;
+    late = 0;
+    auto now = Timestamp::Now().MicroSecondsSinceEpoch();
+    for (int i = 0; i < 100; i++)
+    {
+        auto delay = 5 + i * 13;
+        loop.RunAfter(delay, boost::bind(&OnTimeout, now + delay*1000));
+    }
+    auto id = loop.RunAfter(500, boost::bind(&OnTimeout, 0));
+    loop.Cancel(id);
+    loop.RunAfter(1500, boost::bind(&EventLoop::quit, &loop));
+    loop.loop();
+
+    printf("fired %d of 100, latest by %ld us\n", fired, late);
+}
+
+int main()
+{
+    CheckFiring();
+
+    // precise set only vs timing wheel
+    auto set_seconds = AddAndCancel(0);
+    auto wheel_seconds = AddAndCancel(10);
+    printf("%d RunAfter + Cancel: set %.3fs, wheel %.3fs\n",
+           kTimers, set_seconds, wheel_seconds);
+    return 0;
+}
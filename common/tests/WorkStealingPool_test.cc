@@ -0,0 +1,160 @@
+#include <claire/common/threading/ThreadPool.h>
+#include <claire/common/threading/WorkStealingPool.h>
+#include <claire/common/threading/CountDownLatch.h>
+#include <claire/common/tracing/TraceContext.h>
+#include <claire/common/time/Timestamp.h>
+
+#include <boost/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+
+using namespace claire;
+
+const int kThreads = 8;
+const int kSubmitters = 4;
+const int kTasks = 200000; // per submitter
+
+std::atomic<int64_t> g_done(0);
+
+void Count(CountDownLatch* latch)
+{
+    if (g_done.fetch_add(1, std::memory_order_relaxed) + 1 == kSubmitters * kTasks)
+    {
+        latch->CountDown();
+    }
+}
+
+template<typename Pool>
+void Submit(Pool* pool, CountDownLatch* latch)
+{
+    for (int i = 0; i < kTasks; i++)
+    {
+        pool->Run(boost::bind(&Count, latch));
+    }
+}
+
+// tiny tasks from several threads, where the shared lock contends most
+template<typename Pool>
+void Bench(const char* name)
+{
+    Pool pool(name);
+    pool.Start(kThreads);
+
+    g_done = 0;
+    CountDownLatch latch(1);
+    boost::ptr_vector<Thread> submitters;
+
+    auto start = Timestamp::Now();
+    for (int i = 0; i < kSubmitters; i++)
+    {
+        submitters.push_back(new Thread(boost::bind(&Submit<Pool>, &pool, &latch), "submitter"));
+        submitters.back().Start();
+    }
+    latch.Wait();
+    auto elapsed = TimeDifference(Timestamp::Now(), start);
+
+    for (auto it = submitters.begin(); it != submitters.end(); ++it)
+    {
+        (*it).Join();
+    }
+
+    printf("%-16s %d tasks by %d threads in %ld ms, %.1f ns per task\n",
+           name, kSubmitters * kTasks, kSubmitters, elapsed / 1000,
+           static_cast<double>(elapsed) * 1000 / (kSubmitters * kTasks));
+}
+
+struct Square
+{
+    void operator()(int64_t i) const
+    {
+        (*sums)[i % 64] += i * i;
+    }
+
+    std::vector<std::atomic<int64_t> >* sums;
+};
+
+struct Cell
+{
+    void operator()(int64_t j) const
+    {
+        total->fetch_add(j, std::memory_order_relaxed);
+    }
+
+    std::atomic<int64_t>* total;
+};
+
+struct Row
+{
+    void operator()(int64_t) const
+    {
+        // nested fork/join from a task of the pool
+        pool->ParallelFor(0, 1000, Cell{total});
+    }
+
+    WorkStealingPool* pool;
+    std::atomic<int64_t>* total;
+};
+
+void CheckTrace(std::atomic<int>* matched)
+{
+    if (ThisThread::GetTraceContext() == std::make_pair(int64_t(7), int64_t(9)))
+    {
+        (*matched)++;
+    }
+}
+
+int main()
+{
+    Bench<ThreadPool>("ThreadPool");
+    Bench<WorkStealingPool>("WorkStealingPool");
+
+    WorkStealingPool pool("ws");
+    pool.Start(kThreads);
+
+    const int64_t kCount = 1000000;
+    std::vector<std::atomic<int64_t> > sums(64);
+    for (auto it = sums.begin(); it != sums.end(); ++it)
+    {
+        *it = 0;
+    }
+
+    auto start = Timestamp::Now();
+    pool.ParallelFor(0, kCount, Square{&sums});
+    auto elapsed = TimeDifference(Timestamp::Now(), start);
+
+    int64_t sum = 0, expected = 0;
+    for (int64_t i = 0; i < kCount; i++)
+    {
+        expected += i * i;
+    }
+    for (auto it = sums.begin(); it != sums.end(); ++it)
+    {
+        sum += *it;
+    }
+    printf("ParallelFor of %ld in %ld us, sum %s\n",
+           kCount, elapsed, sum == expected ? "ok" : "WRONG");
+
+    std::atomic<int64_t> total(0);
+    pool.ParallelFor(0, 100, Row{&pool, &total});
+    printf("nested ParallelFor total %ld %s\n",
+           total.load(), total == 100 * (999 * 1000 / 2) ? "ok" : "WRONG");
+
+    std::atomic<int> matched(0);
+    std::vector<WorkStealingPool::Task> tasks;
+    for (int i = 0; i < 100; i++)
+    {
+        tasks.push_back(boost::bind(&CheckTrace, &matched));
+    }
+    {
+        TraceContextGuard guard(7, 9);
+        pool.WhenAll(std::move(tasks));
+    }
+    printf("trace context in %d of 100 tasks\n", matched.load());
+
+    pool.Stop();
+    return 0;
+}
@@ -44,6 +44,18 @@ public:
         return ETIMEDOUT == pthread_cond_timedwait(&pcond_, &(mutex_.mutex_), &abstime);
     }
 
+    // return true if timeout, otherwise return false
+    bool WaitForMilliseconds(int64_t milliseconds)
+    {
+        struct timespec abstime;
+        ::clock_gettime(CLOCK_REALTIME, &abstime);
+        auto nanoseconds = abstime.tv_nsec + (milliseconds % 1000) * 1000 * 1000;
+        abstime.tv_sec += static_cast<time_t>(milliseconds / 1000 + nanoseconds / (1000 * 1000 * 1000));
+        abstime.tv_nsec = static_cast<long>(nanoseconds % (1000 * 1000 * 1000));
+        Mutex::UnAssignGuard ug(mutex_);
+        return ETIMEDOUT == pthread_cond_timedwait(&pcond_, &(mutex_.mutex_), &abstime);
+    }
+
     void Notify()
     {
         DCHECK_ERR(pthread_cond_signal(&pcond_));
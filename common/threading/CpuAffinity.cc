@@ -0,0 +1,399 @@
+// Copyright (c) 2013 The claire-common Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <claire/common/threading/CpuAffinity.h>
+
+#include <ctype.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include <map>
+#include <algorithm>
+
+#include <boost/atomic.hpp>
+
+#include <claire/common/threading/Mutex.h>
+#include <claire/common/threading/Singleton.h>
+#include <claire/common/threading/ThisThread.h>
+#include <claire/common/logging/Logging.h>
+
+#ifndef MPOL_LOCAL
+#define MPOL_LOCAL 4
+#endif
+
+namespace claire {
+
+namespace {
+
+// sysfs files may be missing, like numa nodes on single node hosts
+bool ReadSysFile(const std::string& path, std::string* content)
+{
+    auto fp = ::fopen(path.c_str(), "r");
+    if (!fp)
+    {
+        return false;
+    }
+
+    char buf[4096];
+    auto n = ::fread(buf, 1, sizeof buf, fp);
+    ::fclose(fp);
+
+    content->assign(buf, n);
+    while (!content->empty() && isspace(content->back()))
+    {
+        content->resize(content->size()-1);
+    }
+    return true;
+}
+
+bool ParseCpuList(const std::string& spec, std::vector<int>* cpus)
+{
+    std::vector<int> result;
+    const char* p = spec.c_str();
+    while (*p)
+    {
+        // strtol takes spaces and signs, which are not in a cpu list
+        char* end;
+        auto first = isdigit(*p) ? strtol(p, &end, 10) : -1;
+        if (first < 0 || first >= CPU_SETSIZE)
+        {
+            return false;
+        }
+
+        auto last = first;
+        p = end;
+        if (*p == '-')
+        {
+            last = isdigit(*++p) ? strtol(p, &end, 10) : -1;
+            if (last < first || last >= CPU_SETSIZE)
+            {
+                return false;
+            }
+            p = end;
+        }
+
+        for (auto cpu = first; cpu <= last; cpu++)
+        {
+            result.push_back(static_cast<int>(cpu));
+        }
+
+        if (*p == ',' && *(p+1))
+        {
+            p++;
+        }
+        else if (*p)
+        {
+            return false;
+        }
+    }
+
+    if (result.empty())
+    {
+        return false;
+    }
+    cpus->swap(result);
+    return true;
+}
+
+int ReadSysInt(const std::string& path, int default_value)
+{
+    std::string content;
+    if (!ReadSysFile(path, &content) || content.empty())
+    {
+        return default_value;
+    }
+    return atoi(content.c_str());
+}
+
+// cpus the process may run on, grouped by physical core and numa node
+struct Topology
+{
+    Topology()
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (::sched_getaffinity(0, sizeof set, &set) < 0)
+        {
+            PLOG(ERROR) << "sched_getaffinity failed";
+        }
+
+        std::map<std::pair<int, int>, size_t> core_index;
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            if (!CPU_ISSET(cpu, &set))
+            {
+                continue;
+            }
+
+            char path[128];
+            snprintf(path, sizeof path, "/sys/devices/system/cpu/cpu%d/topology/", cpu);
+            auto package = ReadSysInt(std::string(path) + "physical_package_id", 0);
+            auto core = ReadSysInt(std::string(path) + "core_id", cpu);
+
+            auto key = std::make_pair(package, core);
+            auto it = core_index.find(key);
+            if (it == core_index.end())
+            {
+                core_index[key] = cores.size();
+                cores.push_back(std::vector<int>(1, cpu));
+            }
+            else
+            {
+                cores[it->second].push_back(cpu);
+            }
+            allowed.push_back(cpu);
+        }
+
+        for (int node = 0; ; node++)
+        {
+            char path[128];
+            snprintf(path, sizeof path, "/sys/devices/system/node/node%d/cpulist", node);
+
+            std::string content;
+            if (!ReadSysFile(path, &content))
+            {
+                break;
+            }
+
+            std::vector<int> cpus;
+            ParseCpuList(content, &cpus); // memory only node has no cpu
+
+            std::vector<int> node_cpus;
+            for (auto it = cpus.begin(); it != cpus.end(); ++it)
+            {
+                node_of[*it] = node;
+                if (CPU_ISSET(*it, &set))
+                {
+                    node_cpus.push_back(*it);
+                }
+            }
+            if (!node_cpus.empty())
+            {
+                nodes.push_back(node_cpus);
+            }
+        }
+
+        if (nodes.empty() && !allowed.empty())
+        {
+            nodes.push_back(allowed);
+        }
+    }
+
+    std::vector<int> allowed;
+    std::vector<std::vector<int> > cores;
+    std::vector<std::vector<int> > nodes;
+    std::map<int, int> node_of;
+};
+
+struct MappingTable
+{
+    Mutex mutex;
+    std::map<pid_t, CpuAffinity::Mapping> mappings; // @GUARDBY mutex
+};
+
+boost::atomic<int> g_next_offset(0);
+
+pthread_once_t g_mapping_key_once = PTHREAD_ONCE_INIT;
+pthread_key_t g_mapping_key;
+
+// runs when a pinned thread exits
+void EraseMapping(void* table)
+{
+    auto mapping_table = static_cast<MappingTable*>(table);
+    MutexLock lock(mapping_table->mutex);
+    mapping_table->mappings.erase(ThisThread::tid());
+}
+
+void CreateMappingKey()
+{
+    ::pthread_key_create(&g_mapping_key, &EraseMapping);
+}
+
+} // namespace
+
+bool CpuAffinity::Parse(const std::string& spec, CpuAffinity* affinity)
+{
+    if (spec.empty() || spec == "none")
+    {
+        *affinity = CpuAffinity();
+    }
+    else if (spec == "cores")
+    {
+        *affinity = CpuAffinity(kPhysicalCore);
+    }
+    else if (spec == "numa")
+    {
+        *affinity = CpuAffinity(kNumaNode);
+    }
+    else
+    {
+        std::vector<int> cpus;
+        if (!ParseCpuList(spec, &cpus))
+        {
+            return false;
+        }
+        *affinity = CpuAffinity(cpus);
+    }
+    return true;
+}
+
+void CpuAffinity::Reserve(int num_threads)
+{
+    if (policy_ != kNone)
+    {
+        offset_ = g_next_offset.fetch_add(num_threads, boost::memory_order_relaxed);
+    }
+}
+
+std::vector<int> CpuAffinity::CpusOf(int index) const
+{
+    DCHECK(index >= 0);
+    auto slot = static_cast<size_t>(index + offset_);
+
+    std::vector<int> cpus;
+    auto topology = Singleton<Topology>::instance();
+    switch (policy_)
+    {
+        case kCpuList:
+            if (!cpus_.empty())
+            {
+                cpus.push_back(cpus_[slot % cpus_.size()]);
+            }
+            break;
+        case kPhysicalCore:
+            if (!topology->cores.empty())
+            {
+                cpus.push_back(topology->cores[slot % topology->cores.size()].front());
+            }
+            break;
+        case kNumaNode:
+            if (!topology->nodes.empty())
+            {
+                cpus = topology->nodes[slot % topology->nodes.size()];
+            }
+            break;
+        default:
+            break;
+    }
+    return cpus;
+}
+
+bool CpuAffinity::Apply(int index) const
+{
+    auto cpus = CpusOf(index);
+    if (cpus.empty())
+    {
+        return policy_ == kNone;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto it = cpus.begin(); it != cpus.end(); ++it)
+    {
+        CPU_SET(*it, &set);
+    }
+
+    if (::sched_setaffinity(0, sizeof set, &set) < 0)
+    {
+        PLOG(ERROR) << "sched_setaffinity " << FormatCpuList(cpus) << " failed";
+        return false;
+    }
+
+    // pages are placed at first touch, overrides policy inherited from
+    // numactl so loops and buffers created later are on the local node
+    if (::syscall(__NR_set_mempolicy, MPOL_LOCAL, NULL, 0) < 0)
+    {
+        LOG_FIRST_N(WARNING, 1) << "set_mempolicy MPOL_LOCAL failed, errno " << errno;
+    }
+
+    Mapping mapping;
+    mapping.tid = ThisThread::tid();
+    mapping.name = ThisThread::thread_name() ? ThisThread::thread_name() : "";
+    mapping.cpus = cpus;
+
+    auto table = Singleton<MappingTable>::instance();
+    {
+        MutexLock lock(table->mutex);
+        table->mappings[mapping.tid] = mapping;
+    }
+    ::pthread_once(&g_mapping_key_once, &CreateMappingKey);
+    ::pthread_setspecific(g_mapping_key, table);
+
+    LOG(INFO) << "Thread " << mapping.tid << " pinned to cpus " << FormatCpuList(cpus)
+              << " of node " << NodeOf(cpus.front());
+    return true;
+}
+
+std::string CpuAffinity::ToString() const
+{
+    switch (policy_)
+    {
+        case kCpuList:
+            return FormatCpuList(cpus_);
+        case kPhysicalCore:
+            return "cores";
+        case kNumaNode:
+            return "numa";
+        default:
+            return "none";
+    }
+}
+
+std::vector<CpuAffinity::Mapping> CpuAffinity::GetMappings()
+{
+    std::vector<Mapping> result;
+    auto table = Singleton<MappingTable>::instance();
+
+    MutexLock lock(table->mutex);
+    for (auto it = table->mappings.begin(); it != table->mappings.end(); ++it)
+    {
+        result.push_back((*it).second);
+    }
+    return result;
+}
+
+std::string CpuAffinity::FormatCpuList(const std::vector<int>& cpus)
+{
+    std::string result;
+    size_t i = 0;
+    while (i < cpus.size())
+    {
+        auto j = i;
+        while (j+1 < cpus.size() && cpus[j+1] == cpus[j]+1)
+        {
+            j++;
+        }
+
+        char buf[32];
+        if (j > i)
+        {
+            snprintf(buf, sizeof buf, "%s%d-%d", result.empty() ? "" : ",", cpus[i], cpus[j]);
+        }
+        else
+        {
+            snprintf(buf, sizeof buf, "%s%d", result.empty() ? "" : ",", cpus[i]);
+        }
+        result += buf;
+        i = j+1;
+    }
+    return result;
+}
+
+int CpuAffinity::NodeOf(int cpu)
+{
+    auto topology = Singleton<Topology>::instance();
+    auto it = topology->node_of.find(cpu);
+    if (it == topology->node_of.end())
+    {
+        return 0;
+    }
+    return (*it).second;
+}
+
+} // namespace claire
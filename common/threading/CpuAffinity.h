@@ -0,0 +1,83 @@
+// Copyright (c) 2013 The claire-common Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef _CLAIRE_COMMON_THREADING_CPUAFFINITY_H_
+#define _CLAIRE_COMMON_THREADING_CPUAFFINITY_H_
+
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+namespace claire {
+
+/// Affinity policy of a group of threads, like IO loops of a pool,
+/// the index-th thread of the group is pinned by Apply(index).
+///
+/// Topology is read from sysfs once, limited to cpus the process
+/// is allowed to run on.
+class CpuAffinity
+{
+public:
+    enum Policy
+    {
+        kNone,         // not pinned
+        kCpuList,      // one cpu of the list each, round-robin
+        kPhysicalCore, // one physical core each, hyper-threads left idle
+        kNumaNode      // all cpus of one numa node each, round-robin
+    };
+
+    /// A pinned thread, for inspecting
+    struct Mapping
+    {
+        pid_t tid;
+        std::string name;
+        std::vector<int> cpus;
+    };
+
+    CpuAffinity() : policy_(kNone), offset_(0) {}
+    explicit CpuAffinity(Policy policy__) : policy_(policy__), offset_(0) {}
+    explicit CpuAffinity(const std::vector<int>& cpus__)
+        : policy_(kCpuList),
+          cpus_(cpus__),
+          offset_(0)
+    {}
+
+    /// Parses none, cores, numa or a cpu list like 0-3,8
+    static bool Parse(const std::string& spec, CpuAffinity* affinity);
+
+    Policy policy() const { return policy_; }
+
+    /// Takes num_threads slots of a process-wide cursor before the group
+    /// starts, so groups sharing a policy begin where the last one ended
+    /// instead of all pinning their first thread to the same cpu
+    void Reserve(int num_threads);
+
+    /// Cpus of the index-th thread, empty if not pinned
+    std::vector<int> CpusOf(int index) const;
+
+    /// Pins calling thread as the index-th one, memory it allocates
+    /// from now on comes from its local node. Returns false if failed.
+    bool Apply(int index) const;
+
+    std::string ToString() const;
+
+    /// Threads pinned by Apply and not exited yet
+    static std::vector<Mapping> GetMappings();
+
+    /// Formats cpus like 0-3,8
+    static std::string FormatCpuList(const std::vector<int>& cpus);
+
+    /// Numa node of cpu, 0 if unknown
+    static int NodeOf(int cpu);
+
+private:
+    Policy policy_;
+    std::vector<int> cpus_;
+    int offset_;
+};
+
+} // namespace claire
+
+#endif // _CLAIRE_COMMON_THREADING_CPUAFFINITY_H_
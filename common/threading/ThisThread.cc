@@ -73,7 +73,7 @@ bool IsMainThread()
 void SleepForMicroSeconds(int64_t microseconds)
 {
     struct timespec ts = {0, 0};
-    ts.tv_sec = static_cast<time_t>(microseconds/10000000);
+    ts.tv_sec = static_cast<time_t>(microseconds/1000000);
     ts.tv_nsec = static_cast<long>(microseconds%1000000 * 1000);
     ::nanosleep(&ts, NULL);
 }
@@ -4,24 +4,86 @@
 
 #include <claire/common/threading/ThreadPool.h>
 
+#include <set>
+#include <algorithm>
+
 #include <boost/bind.hpp>
 
 #include <claire/common/base/Exception.h>
+#include <claire/common/metrics/Histogram.h>
+#include <claire/common/metrics/CounterProvider.h>
+#include <claire/common/strings/StringPrintf.h>
+#include <claire/common/threading/Singleton.h>
 #include <claire/common/logging/Logging.h>
 
+DEFINE_string(threadpool_affinity, "none",
+              "pins threads of each ThreadPool, none, cores, numa or a cpu list like 0-3,8");
+DEFINE_int64(threadpool_target_queue_time_us, 10000,
+             "elastic ThreadPool adds a worker when tasks wait longer, at most one each such interval");
+DEFINE_int64(threadpool_keep_alive_ms, 60000,
+             "elastic ThreadPool retires a worker idle so long");
+
 namespace claire {
 
+namespace {
+
+std::string MetricName(const std::string& pool, const char* name)
+{
+    return StringPrintf("claire.ThreadPool.%s.%s", pool.c_str(), name);
+}
+
+// pools alive, for GetAllStats
+struct PoolTable
+{
+    Mutex mutex;
+    std::set<const ThreadPool*> pools; // @GUARDBY mutex
+};
+
+} // namespace
+
 ThreadPool::ThreadPool(const std::string& name)
     : mutex_(),
       not_empty_(mutex_),
       not_full_(mutex_),
       name_(name),
+      next_thread_index_(0),
+      queue_size_(0),
       max_queue_size_(0),
-      running_(false)
-{}
+      running_(false),
+      min_threads_(0),
+      max_threads_(0),
+      target_queue_time_(FLAGS_threadpool_target_queue_time_us),
+      keep_alive_(FLAGS_threadpool_keep_alive_ms),
+      num_threads_(0),
+      active_threads_(0),
+      queue_time_(0),
+      run_time_(0),
+      queue_time_histogram_(Histogram::FactoryGet(MetricName(name, "QueueTime"), 1, 10000000, 50)),
+      run_time_histogram_(Histogram::FactoryGet(MetricName(name, "RunTime"), 1, 10000000, 50)),
+      completed_counter_(MetricName(name, "Completed")),
+      rejected_counter_(MetricName(name, "Rejected")),
+      expired_counter_(MetricName(name, "Expired")),
+      grown_counter_(MetricName(name, "Grown")),
+      retired_counter_(MetricName(name, "Retired"))
+{
+    if (!CpuAffinity::Parse(FLAGS_threadpool_affinity, &affinity_))
+    {
+        LOG(ERROR) << "Unknown affinity " << FLAGS_threadpool_affinity << ", threads not pinned";
+    }
+
+    auto table = Singleton<PoolTable>::instance();
+    MutexLock lock(table->mutex);
+    table->pools.insert(this);
+}
 
 ThreadPool::~ThreadPool()
 {
+    {
+        auto table = Singleton<PoolTable>::instance();
+        MutexLock lock(table->mutex);
+        table->pools.erase(this);
+    }
+
     if (running_)
     {
         Stop();
@@ -30,119 +92,381 @@ ThreadPool::~ThreadPool()
 
 void ThreadPool::Start(int num_threads)
 {
+    MutexLock lock(mutex_);
     if (running_)
     {
         return ;
     }
     running_ = true;
 
-    threads_.reserve(num_threads);
+    min_threads_ = num_threads;
+    max_threads_ = std::max(max_threads_, num_threads);
+    affinity_.Reserve(max_threads_);
     for (int i = 0;i < num_threads;i++)
     {
-        char id[32];
-        snprintf(id, sizeof id, "%d", i);
-        threads_.push_back(new claire::Thread(
-            boost::bind(&ThreadPool::RunInThread, this), name_+id));
-        threads_[i].Start();
+        SpawnThread();
     }
 }
 
 void ThreadPool::Stop()
 {
-    if (!running_)
-    {
-        return ;
-    }
-    running_ = false;
-
+    std::vector<Thread*> threads;
     {
         MutexLock lock(mutex_);
+        if (!running_)
+        {
+            return ;
+        }
+        running_ = false;
         not_empty_.NotifyAll();
+
+        for (auto it = threads_.begin(); it != threads_.end(); ++it)
+        {
+            threads.push_back((*it).second);
+        }
+        threads_.clear();
     }
 
-    for_each(threads_.begin(),
-             threads_.end(),
-             boost::bind(&Thread::Join, _1));
+    for (auto it = threads.begin(); it != threads.end(); ++it)
+    {
+        (*it)->Join();
+        delete *it;
+    }
+    JoinExitedThreads();
+}
 
+void ThreadPool::Run(Task&& task)
+{
+    Run(std::move(task), kNormal);
 }
 
-void ThreadPool::Run(const Task& task)
+void ThreadPool::Run(Task&& task,
+                     Priority priority,
+                     Timestamp deadline,
+                     Task&& expired)
 {
-    if (threads_.empty())
+    if (RunsInline())
     {
-        task();
+        RunNow(std::move(task), deadline, std::move(expired));
+        return ;
     }
-    else
+
+    bool grown;
     {
         MutexLock lock(mutex_);
         while (IsFull())
         {
             not_full_.Wait();
         }
+        grown = Push(std::move(task), priority, deadline, std::move(expired));
+    }
 
-        queue_.push_back(std::make_pair(ThisThread::GetTraceContext(), task));
-        not_empty_.Notify();
+    if (grown)
+    {
+        JoinExitedThreads();
     }
 }
 
-void ThreadPool::Run(Task&& task)
+bool ThreadPool::TryRun(Task&& task)
+{
+    return TryRun(std::move(task), kNormal);
+}
+
+bool ThreadPool::TryRun(Task&& task,
+                        Priority priority,
+                        Timestamp deadline,
+                        Task&& expired)
 {
-    if (threads_.empty())
+    if (RunsInline())
     {
-        task();
+        RunNow(std::move(task), deadline, std::move(expired));
+        return true;
     }
-    else
+
+    bool grown;
     {
         MutexLock lock(mutex_);
-        while (IsFull())
+        if (IsFull())
         {
-            not_full_.Wait();
+            rejected_counter_.Increment();
+            return false;
         }
+        grown = Push(std::move(task), priority, deadline, std::move(expired));
+    }
 
-        queue_.push_back(std::make_pair(ThisThread::GetTraceContext(), std::move(task)));
-        not_empty_.Notify();
+    if (grown)
+    {
+        JoinExitedThreads();
     }
+    return true;
 }
 
-ThreadPool::Entry ThreadPool::Take()
+size_t ThreadPool::queue_size() const
 {
     MutexLock lock(mutex_);
-    while (queue_.empty() && running_)
+    return queue_size_;
+}
+
+ThreadPool::Stats ThreadPool::stats() const
+{
+    Stats stats;
+    stats.name = name_;
+    stats.num_threads = num_threads_;
+    stats.min_threads = min_threads_;
+    stats.max_threads = max_threads_;
+    stats.active_threads = active_threads_;
+    stats.queue_size = queue_size();
+    stats.max_queue_size = max_queue_size_;
+    stats.completed = CounterValue("Completed");
+    stats.rejected = CounterValue("Rejected");
+    stats.expired = CounterValue("Expired");
+    stats.queue_time = queue_time_;
+    stats.run_time = run_time_;
+    stats.grown = CounterValue("Grown");
+    stats.retired = CounterValue("Retired");
+    return stats;
+}
+
+// summed over threads, not only the calling one as Counter::get
+int64_t ThreadPool::CounterValue(const char* name) const
+{
+    return CounterProvider::instance()->GetCounterValue(MetricName(name_, name));
+}
+
+std::vector<ThreadPool::Stats> ThreadPool::GetAllStats()
+{
+    std::vector<Stats> result;
+    auto table = Singleton<PoolTable>::instance();
+
+    MutexLock lock(table->mutex);
+    for (auto it = table->pools.begin(); it != table->pools.end(); ++it)
     {
-        not_empty_.Wait();
+        result.push_back((*it)->stats());
     }
+    return result;
+}
 
+bool ThreadPool::RunNow(Task&& task, Timestamp deadline, Task&& expired)
+{
+    if (deadline.Valid() && deadline < Timestamp::Now())
+    {
+        expired_counter_.Increment();
+        if (expired)
+        {
+            expired();
+        }
+        return false;
+    }
+
+    task();
+    completed_counter_.Increment();
+    return true;
+}
+
+// returns true if a worker is added
+bool ThreadPool::Push(Task&& task,
+                      Priority priority,
+                      Timestamp deadline,
+                      Task&& expired)
+{
+    mutex_.AssertLocked();
+    DCHECK(priority >= kHigh && priority < kNumPriorities);
+
+    auto now = Timestamp::Now();
     Entry entry;
-    if (!queue_.empty())
+    entry.context = ThisThread::GetTraceContext();
+    entry.task = std::move(task);
+    entry.deadline = deadline;
+    entry.expired = std::move(expired);
+    entry.enqueued = now;
+
+    queues_[priority].push_back(std::move(entry));
+    queue_size_++;
+    not_empty_.Notify();
+
+    // workers busy with long tasks take nothing, so queue time is
+    // checked here too, by the oldest entry still queued
+    if (num_threads_ >= max_threads_)
     {
-        entry = queue_.front();
-        queue_.pop_front();
-        if (max_queue_size_ > 0)
+        return false;
+    }
+
+    int64_t oldest = 0;
+    for (int i = 0; i < kNumPriorities; i++)
+    {
+        if (!queues_[i].empty())
+        {
+            oldest = std::max(oldest, TimeDifference(now, queues_[i].front().enqueued));
+        }
+    }
+    return GrowLocked(oldest);
+}
+
+// returns false if the worker is retired
+bool ThreadPool::Take(int index, Entry* entry)
+{
+    MutexLock lock(mutex_);
+    while (queue_size_ == 0 && running_)
+    {
+        if (num_threads_ <= min_threads_)
+        {
+            not_empty_.Wait();
+        }
+        else if (not_empty_.WaitForMilliseconds(keep_alive_)
+                 && running_
+                 && queue_size_ == 0
+                 && num_threads_ > min_threads_)
+        {
+            // idle for keep alive, joined by next grow or Stop
+            auto it = threads_.find(index);
+            exited_threads_.push_back((*it).second);
+            threads_.erase(it);
+            num_threads_--;
+            retired_counter_.Increment();
+            LOG(DEBUG) << "ThreadPool " << name_ << " retires worker " << index
+                       << ", " << num_threads_ << " left";
+            return false;
+        }
+    }
+
+    for (int i = 0; i < kNumPriorities; i++)
+    {
+        if (!queues_[i].empty())
         {
-            not_full_.Notify();
+            *entry = std::move(queues_[i].front());
+            queues_[i].pop_front();
+            queue_size_--;
+            if (max_queue_size_ > 0)
+            {
+                not_full_.Notify();
+            }
+            break;
         }
     }
-    return entry;
+    return true;
+}
+
+void ThreadPool::SpawnThread()
+{
+    mutex_.AssertLocked();
+
+    auto index = next_thread_index_++;
+    char id[32];
+    snprintf(id, sizeof id, "%d", index);
+
+    auto thread = new claire::Thread(
+        boost::bind(&ThreadPool::RunInThread, this, index), name_+id);
+    threads_[index] = thread;
+    num_threads_++;
+    thread->Start();
+}
+
+void ThreadPool::MaybeGrow(int64_t queue_time)
+{
+    if (queue_time < target_queue_time_ || num_threads_ >= max_threads_)
+    {
+        return ;
+    }
+
+    bool grown;
+    {
+        MutexLock lock(mutex_);
+        grown = GrowLocked(queue_time);
+    }
+
+    if (grown)
+    {
+        JoinExitedThreads();
+    }
+}
+
+bool ThreadPool::GrowLocked(int64_t queue_time)
+{
+    mutex_.AssertLocked();
+
+    if (!running_ || queue_size_ == 0 || num_threads_ >= max_threads_)
+    {
+        return false;
+    }
+
+    // no worker to take the task at all, add one at once. Otherwise one
+    // worker each target queue time, so the new one is counted in queue
+    // time of later tasks before growing again
+    auto now = Timestamp::Now();
+    if (num_threads_ > 0
+        && (queue_time < target_queue_time_
+            || (last_grow_.Valid() && TimeDifference(now, last_grow_) < target_queue_time_)))
+    {
+        return false;
+    }
+    last_grow_ = now;
+
+    SpawnThread();
+    grown_counter_.Increment();
+    LOG(DEBUG) << "ThreadPool " << name_ << " grows to " << num_threads_
+               << " workers, queue time " << queue_time << " us";
+    return true;
+}
+
+void ThreadPool::JoinExitedThreads()
+{
+    std::vector<Thread*> threads;
+    {
+        MutexLock lock(mutex_);
+        threads.swap(exited_threads_);
+    }
+
+    for (auto it = threads.begin(); it != threads.end(); ++it)
+    {
+        (*it)->Join();
+        delete *it;
+    }
+}
+
+bool ThreadPool::RunsInline() const
+{
+    // elastic pool started with no worker spawns them on demand
+    return num_threads_ == 0 && (max_threads_ == 0 || !running_);
 }
 
 bool ThreadPool::IsFull() const
 {
     mutex_.AssertLocked();
-    return max_queue_size_ > 0 && queue_.size() >= max_queue_size_;
+    return max_queue_size_ > 0 && queue_size_ >= max_queue_size_;
 }
 
-void ThreadPool::RunInThread()
+void ThreadPool::RunInThread(int index)
 {
+    affinity_.Apply(index);
+
     try
     {
         while (running_)
         {
-            Entry entry(Take());
-            if (entry.second)
+            Entry entry;
+            if (!Take(index, &entry))
+            {
+                break; // retired
+            }
+
+            if (entry.task)
             {
-                ThisThread::SetTraceContext(entry.first);
-                entry.second();
+                auto start = Timestamp::Now();
+                auto queue_time = TimeDifference(start, entry.enqueued);
+                queue_time_ += queue_time;
+                queue_time_histogram_->Add(static_cast<int>(queue_time));
+                MaybeGrow(queue_time);
+
+                // checked when taken, the queue is not scanned for expired tasks
+                active_threads_++;
+                ThisThread::SetTraceContext(entry.context);
+                RunNow(std::move(entry.task), entry.deadline, std::move(entry.expired));
                 ThisThread::ResetTraceContext();
+                active_threads_--;
+
+                auto run_time = TimeDifference(Timestamp::Now(), start);
+                run_time_ += run_time;
+                run_time_histogram_->Add(static_cast<int>(run_time));
             }
         }
     }
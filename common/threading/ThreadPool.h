@@ -5,24 +5,67 @@
 #ifndef _CLAIRE_COMMON_THREADING_THREADPOOL_H_
 #define _CLAIRE_COMMON_THREADING_THREADPOOL_H_
 
+#include <map>
 #include <deque>
 #include <string>
+#include <vector>
 
 #include <boost/atomic.hpp>
 #include <boost/noncopyable.hpp>
-#include <boost/ptr_container/ptr_vector.hpp>
 
+#include <claire/common/base/Closure.h>
+#include <claire/common/metrics/Counter.h>
 #include <claire/common/threading/Mutex.h>
 #include <claire/common/threading/Thread.h>
 #include <claire/common/threading/Condition.h>
+#include <claire/common/threading/CpuAffinity.h>
+#include <claire/common/time/Timestamp.h>
 #include <claire/common/tracing/TraceContext.h>
 
 namespace claire {
 
+class Histogram;
+
+/// Tasks of higher priority run first, FIFO in the same priority.
+/// Elastic if max threads is set above threads of Start, workers are
+/// added when tasks wait longer than target queue time, and retired
+/// down to threads of Start after idle for keep alive. Elastic pool
+/// started with 0 threads adds a worker as soon as a task is queued.
+///
+/// A task with a deadline is dropped if it is still queued after the
+/// deadline, its expired callback runs instead, like replying timeout
+/// to a client that gave up waiting.
 class ThreadPool : boost::noncopyable
 {
 public:
-    typedef boost::function<void()> Task;
+    typedef Closure Task; // move-only, functors up to 64 bytes are not allocated
+
+    enum Priority
+    {
+        kHigh,   // interactive work
+        kNormal,
+        kLow,    // batch work, starves while others are queued
+        kNumPriorities
+    };
+
+    /// Snapshot of a pool, times in microseconds
+    struct Stats
+    {
+        std::string name;
+        int num_threads;
+        int min_threads;
+        int max_threads;
+        int active_threads;
+        size_t queue_size;
+        size_t max_queue_size; // 0 if unbounded
+        int64_t completed;
+        int64_t rejected;      // by TryRun
+        int64_t expired;
+        int64_t queue_time;    // total from Run to start
+        int64_t run_time;      // total of tasks and expired callbacks
+        int64_t grown;         // workers added by elastic sizing
+        int64_t retired;       // workers retired by elastic sizing
+    };
 
     explicit ThreadPool(const std::string& name);
     ~ThreadPool();
@@ -30,28 +73,97 @@ public:
     // must called before Start
     void set_max_queue_size(int max_size) { max_queue_size_ = max_size; }
 
+    // must called before Start, overrides --threadpool_affinity
+    void set_affinity(const CpuAffinity& affinity) { affinity_ = affinity; }
+
+    // must called before Start, elastic between num_threads of Start and it
+    void set_max_threads(int max_threads) { max_threads_ = max_threads; }
+
+    // must called before Start, overrides --threadpool_target_queue_time_us
+    void set_target_queue_time(int64_t microseconds) { target_queue_time_ = microseconds; }
+
+    // must called before Start, overrides --threadpool_keep_alive_ms
+    void set_keep_alive(int64_t milliseconds) { keep_alive_ = milliseconds; }
+
+    /// Starts num_threads workers, kept at least so if elastic
     void Start(int num_threads);
     void Stop();
 
-    void Run(const Task& task);
+    /// Waits while the queue is full
     void Run(Task&& task);
+    void Run(Task&& task,
+             Priority priority,
+             Timestamp deadline = Timestamp::Invalid(),
+             Task&& expired = Task());
 
-private:
-    typedef std::pair<TraceContext, Task> Entry;
+    /// Returns false at once if the queue is full, task is left untouched
+    bool TryRun(Task&& task);
+    bool TryRun(Task&& task,
+                Priority priority,
+                Timestamp deadline = Timestamp::Invalid(),
+                Task&& expired = Task());
 
-    bool IsFull() const;
-    Entry Take();
-    void RunInThread();
+    size_t queue_size() const;
+    const std::string& name() const { return name_; }
 
-    Mutex mutex_;
+    Stats stats() const;
+
+    /// Stats of all pools alive, for inspecting
+    static std::vector<Stats> GetAllStats();
+
+private:
+    struct Entry
+    {
+        TraceContext context;
+        Task task;
+        Timestamp deadline;
+        Task expired; // runs instead of task after deadline
+        Timestamp enqueued;
+    };
+
+    int64_t CounterValue(const char* name) const;
+    bool RunsInline() const;
+    bool IsFull() const;
+    bool Push(Task&& task, Priority priority, Timestamp deadline, Task&& expired);
+    bool RunNow(Task&& task, Timestamp deadline, Task&& expired);
+    bool Take(int index, Entry* entry);
+    void SpawnThread();
+    void MaybeGrow(int64_t queue_time);
+    bool GrowLocked(int64_t queue_time);
+    void JoinExitedThreads();
+    void RunInThread(int index);
+
+    mutable Mutex mutex_;
     Condition not_empty_;
     Condition not_full_;
 
     const std::string name_;
-    boost::ptr_vector<Thread> threads_;
-    std::deque<Entry> queue_;
+    std::map<int, Thread*> threads_; // @GUARDBY mutex_
+    std::vector<Thread*> exited_threads_; // retired, to join, @GUARDBY mutex_
+    int next_thread_index_; // @GUARDBY mutex_
+    Timestamp last_grow_; // @GUARDBY mutex_
+    std::deque<Entry> queues_[kNumPriorities]; // @GUARDBY mutex_
+    size_t queue_size_; // @GUARDBY mutex_
     size_t max_queue_size_;
+    CpuAffinity affinity_;
     boost::atomic<bool> running_;
+
+    int min_threads_;
+    int max_threads_;
+    int64_t target_queue_time_; // microseconds
+    int64_t keep_alive_; // milliseconds
+    boost::atomic<int> num_threads_;
+
+    boost::atomic<int> active_threads_;
+    boost::atomic<int64_t> queue_time_;
+    boost::atomic<int64_t> run_time_;
+    Histogram* queue_time_histogram_;
+    Histogram* run_time_histogram_;
+    Counter completed_counter_;
+    Counter rejected_counter_;
+    Counter expired_counter_;
+    Counter grown_counter_;
+    Counter retired_counter_;
 };
 
 } // namespace claire
@@ -0,0 +1,522 @@
+// Copyright (c) 2013 The claire-common Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <claire/common/threading/WorkStealingPool.h>
+
+#include <limits.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+
+#include <claire/common/base/Exception.h>
+#include <claire/common/base/PaddedAtomic.h>
+#include <claire/common/threading/Condition.h>
+#include <claire/common/threading/ThisThread.h>
+#include <claire/common/tracing/TraceContext.h>
+#include <claire/common/logging/Logging.h>
+
+DECLARE_string(threadpool_affinity);
+DEFINE_int32(workstealing_spin_rounds, 128, "rounds an idle WorkStealingPool worker looks for work before parking");
+
+namespace claire {
+
+// waiter of WhenAll, shared by its tasks so the last one may notify
+// after the waiter returned
+class WorkStealingPool::Join : boost::noncopyable
+{
+public:
+    explicit Join(int count)
+        : pending_(count),
+          finished_(mutex_)
+    {}
+
+    bool finished() const
+    {
+        return pending_.load(boost::memory_order_acquire) == 0;
+    }
+
+    void Done()
+    {
+        MutexLock lock(mutex_);
+        if (pending_.fetch_sub(1, boost::memory_order_acq_rel) == 1)
+        {
+            finished_.NotifyAll();
+        }
+    }
+
+    void Wait()
+    {
+        MutexLock lock(mutex_);
+        while (!finished())
+        {
+            finished_.Wait();
+        }
+    }
+
+private:
+    boost::atomic<int> pending_;
+    Mutex mutex_;
+    Condition finished_;
+};
+
+struct WorkStealingPool::Entry
+{
+    Entry(Task&& task__, const boost::shared_ptr<Join>& join__)
+        : context(ThisThread::GetTraceContext()),
+          task(std::move(task__)),
+          join(join__)
+    {}
+
+    TraceContext context;
+    Task task;
+    boost::shared_ptr<Join> join;
+};
+
+// Chase-Lev deque of fixed capacity, the owner pushes and pops at bottom,
+// thieves take from top. See "Correct and Efficient Work-Stealing for Weak
+// Memory Models", Le et al. 2013.
+class WorkStealingPool::WorkDeque : boost::noncopyable
+{
+public:
+    static const int64_t kCapacity = 4096;
+
+    WorkDeque()
+        : top_(0),
+          bottom_(0)
+    {
+        for (int64_t i = 0; i < kCapacity; i++)
+        {
+            buffer_[i].store(NULL, boost::memory_order_relaxed);
+        }
+    }
+
+    /// Called by owner, false if full
+    bool Push(Entry* entry)
+    {
+        auto b = bottom_.load(boost::memory_order_relaxed);
+        auto t = top_.load(boost::memory_order_acquire);
+        if (b - t >= kCapacity)
+        {
+            return false;
+        }
+
+        buffer_[b & (kCapacity-1)].store(entry, boost::memory_order_relaxed);
+        boost::atomic_thread_fence(boost::memory_order_release);
+        bottom_.store(b+1, boost::memory_order_relaxed);
+        return true;
+    }
+
+    /// Called by owner, newest entry first
+    Entry* Pop()
+    {
+        auto b = bottom_.load(boost::memory_order_relaxed) - 1;
+        bottom_.store(b, boost::memory_order_relaxed);
+        boost::atomic_thread_fence(boost::memory_order_seq_cst);
+        auto t = top_.load(boost::memory_order_relaxed);
+
+        if (t > b)
+        {
+            bottom_.store(b+1, boost::memory_order_relaxed);
+            return NULL;
+        }
+
+        auto entry = buffer_[b & (kCapacity-1)].load(boost::memory_order_relaxed);
+        if (t == b)
+        {
+            // last one, races with thieves
+            if (!top_.compare_exchange_strong(t, t+1,
+                                              boost::memory_order_seq_cst,
+                                              boost::memory_order_relaxed))
+            {
+                entry = NULL;
+            }
+            bottom_.store(b+1, boost::memory_order_relaxed);
+        }
+        return entry;
+    }
+
+    /// Called by other threads, oldest entry first, NULL if empty or
+    /// lost the race to another thief
+    Entry* Steal()
+    {
+        auto t = top_.load(boost::memory_order_acquire);
+        boost::atomic_thread_fence(boost::memory_order_seq_cst);
+        auto b = bottom_.load(boost::memory_order_acquire);
+        if (t >= b)
+        {
+            return NULL;
+        }
+
+        auto entry = buffer_[t & (kCapacity-1)].load(boost::memory_order_relaxed);
+        if (!top_.compare_exchange_strong(t, t+1,
+                                          boost::memory_order_seq_cst,
+                                          boost::memory_order_relaxed))
+        {
+            return NULL;
+        }
+        return entry;
+    }
+
+    bool empty() const
+    {
+        return top_.load(boost::memory_order_acquire) >= bottom_.load(boost::memory_order_acquire);
+    }
+
+private:
+    // thieves write top_, owner writes bottom_
+    PaddedAtomic<int64_t> top_;
+    PaddedAtomic<int64_t> bottom_;
+    boost::atomic<Entry*> buffer_[kCapacity];
+};
+
+namespace {
+
+// worker of which pool the current thread is, for Run from tasks
+__thread WorkStealingPool* t_pool = NULL;
+__thread int t_index = -1;
+__thread unsigned int t_seed = 0;
+
+const size_t kMaxInjectedBatch = 32;
+
+static_assert(sizeof(boost::atomic<int>) == sizeof(int),
+              "futex word must be a plain int");
+
+void FutexWait(boost::atomic<int>* word, int value)
+{
+    ::syscall(SYS_futex, reinterpret_cast<int*>(word), FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+void FutexWake(boost::atomic<int>* word, int count)
+{
+    ::syscall(SYS_futex, reinterpret_cast<int*>(word), FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+} // namespace
+
+WorkStealingPool::WorkStealingPool(const std::string& name)
+    : name_(name),
+      running_(false),
+      num_injected_(0),
+      epoch_(0),
+      num_parked_(0)
+{
+    if (!CpuAffinity::Parse(FLAGS_threadpool_affinity, &affinity_))
+    {
+        LOG(ERROR) << "Unknown affinity " << FLAGS_threadpool_affinity << ", threads not pinned";
+    }
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    if (running_)
+    {
+        Stop();
+    }
+
+    for (auto it = deques_.begin(); it != deques_.end(); ++it)
+    {
+        Entry* entry;
+        while ((entry = (*it).Pop()) != NULL)
+        {
+            delete entry;
+        }
+    }
+
+    for (auto it = injected_.begin(); it != injected_.end(); ++it)
+    {
+        delete *it;
+    }
+}
+
+void WorkStealingPool::Start(int num_threads)
+{
+    if (running_)
+    {
+        return ;
+    }
+    running_ = true;
+
+    affinity_.Reserve(num_threads);
+
+    // deques are ready before any worker may steal
+    for (int i = 0; i < num_threads; i++)
+    {
+        deques_.push_back(new WorkDeque());
+    }
+
+    threads_.reserve(num_threads);
+    for (int i = 0; i < num_threads; i++)
+    {
+        char id[32];
+        snprintf(id, sizeof id, "%d", i);
+        threads_.push_back(new claire::Thread(
+            boost::bind(&WorkStealingPool::RunInThread, this, i), name_+id));
+        threads_[i].Start();
+    }
+}
+
+void WorkStealingPool::Stop()
+{
+    if (!running_)
+    {
+        return ;
+    }
+    running_ = false;
+
+    epoch_.fetch_add(1, boost::memory_order_seq_cst);
+    FutexWake(&epoch_, INT_MAX);
+
+    for_each(threads_.begin(),
+             threads_.end(),
+             boost::bind(&Thread::Join, _1));
+}
+
+void WorkStealingPool::Run(Task&& task)
+{
+    if (threads_.empty())
+    {
+        task();
+        return ;
+    }
+
+    Submit(new Entry(std::move(task), boost::shared_ptr<Join>()));
+}
+
+void WorkStealingPool::WhenAll(std::vector<Task>&& tasks)
+{
+    if (tasks.empty())
+    {
+        return ;
+    }
+
+    if (threads_.empty())
+    {
+        for (auto it = tasks.begin(); it != tasks.end(); ++it)
+        {
+            (*it)();
+        }
+        return ;
+    }
+
+    // the last task runs in calling thread, others are left to steal
+    auto join = boost::make_shared<Join>(static_cast<int>(tasks.size()-1));
+    for (size_t i = 0; i+1 < tasks.size(); i++)
+    {
+        Submit(new Entry(std::move(tasks[i]), join));
+    }
+    tasks.back()();
+
+    while (!join->finished())
+    {
+        if (!RunOne())
+        {
+            if (t_pool == this)
+            {
+                // a parked worker would deadlock when all workers wait
+                sched_yield();
+            }
+            else
+            {
+                join->Wait();
+            }
+        }
+    }
+}
+
+void WorkStealingPool::Submit(Entry* entry)
+{
+    if (t_pool != this || !deques_[t_index].Push(entry))
+    {
+        MutexLock lock(mutex_);
+        injected_.push_back(entry);
+        num_injected_.fetch_add(1, boost::memory_order_relaxed);
+    }
+
+    // pairs with fence of Park, either the worker sees the entry or
+    // it is counted as parked here
+    boost::atomic_thread_fence(boost::memory_order_seq_cst);
+    if (num_parked_.load(boost::memory_order_relaxed) > 0)
+    {
+        WakeOne();
+    }
+}
+
+WorkStealingPool::Entry* WorkStealingPool::FindWork(int index)
+{
+    if (index >= 0)
+    {
+        auto entry = deques_[index].Pop();
+        if (entry)
+        {
+            return entry;
+        }
+    }
+
+    if (num_injected_.load(boost::memory_order_relaxed) > 0)
+    {
+        MutexLock lock(mutex_);
+        if (!injected_.empty())
+        {
+            auto entry = injected_.front();
+            injected_.pop_front();
+
+            // workers take a share at once, others steal it if idle
+            size_t taken = 1;
+            auto share = std::min(kMaxInjectedBatch, injected_.size() / deques_.size());
+            while (index >= 0 && taken <= share && deques_[index].Push(injected_.front()))
+            {
+                injected_.pop_front();
+                taken++;
+            }
+            num_injected_.fetch_sub(taken, boost::memory_order_relaxed);
+            return entry;
+        }
+    }
+
+    return Steal(index);
+}
+
+WorkStealingPool::Entry* WorkStealingPool::Steal(int index)
+{
+    auto n = static_cast<int>(deques_.size());
+    auto start = static_cast<int>(rand_r(&t_seed) % n);
+    for (int i = 0; i < n; i++)
+    {
+        auto victim = (start + i) % n;
+        if (victim == index)
+        {
+            continue;
+        }
+
+        auto entry = deques_[victim].Steal();
+        if (entry)
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+bool WorkStealingPool::RunOne()
+{
+    auto entry = FindWork(t_pool == this ? t_index : -1);
+    if (!entry)
+    {
+        return false;
+    }
+
+    Execute(entry);
+    return true;
+}
+
+void WorkStealingPool::Execute(Entry* entry)
+{
+    // task may be run by a thread helping in WhenAll, keep its context
+    auto context = ThisThread::GetTraceContext();
+    ThisThread::SetTraceContext(entry->context);
+    entry->task();
+    ThisThread::SetTraceContext(context);
+
+    if (entry->join)
+    {
+        entry->join->Done();
+    }
+    delete entry;
+}
+
+bool WorkStealingPool::HasWork() const
+{
+    if (num_injected_.load(boost::memory_order_relaxed) > 0)
+    {
+        return true;
+    }
+
+    for (auto it = deques_.begin(); it != deques_.end(); ++it)
+    {
+        if (!(*it).empty())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::Park()
+{
+    auto epoch = epoch_.load(boost::memory_order_acquire);
+    num_parked_.fetch_add(1, boost::memory_order_seq_cst);
+
+    // pairs with fence of Submit
+    boost::atomic_thread_fence(boost::memory_order_seq_cst);
+    if (running_ && !HasWork())
+    {
+        FutexWait(&epoch_, epoch);
+    }
+    num_parked_.fetch_sub(1, boost::memory_order_relaxed);
+}
+
+void WorkStealingPool::WakeOne()
+{
+    epoch_.fetch_add(1, boost::memory_order_release);
+    FutexWake(&epoch_, 1);
+}
+
+void WorkStealingPool::RunInThread(int index)
+{
+    affinity_.Apply(index);
+    t_pool = this;
+    t_index = index;
+    t_seed = static_cast<unsigned int>(ThisThread::tid());
+
+    try
+    {
+        while (running_)
+        {
+            Entry* entry = NULL;
+            for (int i = 0; i < FLAGS_workstealing_spin_rounds && running_; i++)
+            {
+                entry = FindWork(index);
+                if (entry)
+                {
+                    break;
+                }
+                sched_yield();
+            }
+
+            if (entry)
+            {
+                Execute(entry);
+            }
+            else
+            {
+                Park();
+            }
+        }
+    }
+    catch (const Exception& e)
+    {
+        fprintf(stderr, "exception caught in WorkStealingPool %s\n", name_.c_str());
+        fprintf(stderr, "reason: %s\n", e.what());
+        fprintf(stderr, "stack trace: %s\n", e.stack_trace());
+        abort();
+    }
+    catch(const std::exception& e)
+    {
+        fprintf(stderr, "exception caught in WorkStealingPool %s\n", name_.c_str());
+        fprintf(stderr, "reason: %s\n", e.what());
+        abort();
+    }
+    catch (...)
+    {
+        fprintf(stderr, "unknown exception caught in WorkStealingPool %s\n", name_.c_str());
+        throw; // rethrow
+    }
+}
+
+} // namespace claire
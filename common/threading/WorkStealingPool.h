@@ -0,0 +1,137 @@
+// Copyright (c) 2013 The claire-common Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef _CLAIRE_COMMON_THREADING_WORKSTEALINGPOOL_H_
+#define _CLAIRE_COMMON_THREADING_WORKSTEALINGPOOL_H_
+
+#include <stdint.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include <claire/common/base/Closure.h>
+#include <claire/common/threading/Mutex.h>
+#include <claire/common/threading/Thread.h>
+#include <claire/common/threading/CpuAffinity.h>
+
+namespace claire {
+
+/// Pool for cpu bound work, like ThreadPool but without a shared lock.
+///
+/// Each worker has its own deque, tasks run by a worker go to its deque
+/// and idle workers steal from others. Tasks from other threads go to
+/// an injection queue. Idle workers spin a while before parking.
+///
+/// Unlike ThreadPool the queue is not bounded, tasks left at Stop are
+/// dropped.
+class WorkStealingPool : boost::noncopyable
+{
+public:
+    typedef Closure Task;
+
+    explicit WorkStealingPool(const std::string& name);
+    ~WorkStealingPool();
+
+    // must called before Start, overrides --threadpool_affinity
+    void set_affinity(const CpuAffinity& affinity) { affinity_ = affinity; }
+
+    void Start(int num_threads);
+    void Stop();
+
+    int num_threads() const { return static_cast<int>(threads_.size()); }
+
+    /// Runs task in a worker with trace context of caller, in calling
+    /// thread if not started.
+    void Run(Task&& task);
+
+    /// Runs tasks in parallel and returns when all are finished. The
+    /// calling thread runs tasks meanwhile, so it may be called by tasks
+    /// of the pool for nested fork/join.
+    void WhenAll(std::vector<Task>&& tasks);
+
+    /// Calls body(i) for each i in [begin, end) in parallel, grain indexes
+    /// per task, 0 splits the range into 4 tasks for each worker.
+    template<typename Body>
+    void ParallelFor(int64_t begin, int64_t end, const Body& body, int64_t grain = 0)
+    {
+        if (begin >= end)
+        {
+            return ;
+        }
+
+        if (grain <= 0)
+        {
+            grain = std::max<int64_t>(1, (end - begin) / (4 * std::max(1, num_threads())));
+        }
+
+        std::vector<Task> tasks;
+        tasks.reserve(static_cast<size_t>((end - begin + grain - 1) / grain));
+        for (auto i = begin; i < end; i += grain)
+        {
+            tasks.push_back(ForRange<Body>(&body, i, std::min(i + grain, end)));
+        }
+        WhenAll(std::move(tasks));
+    }
+
+private:
+    struct Entry;
+    class Join;
+    class WorkDeque;
+
+    template<typename Body>
+    struct ForRange
+    {
+        ForRange(const Body* body__, int64_t begin__, int64_t end__)
+            : body(body__),
+              begin(begin__),
+              end(end__)
+        {}
+
+        void operator()()
+        {
+            for (auto i = begin; i < end; i++)
+            {
+                (*body)(i);
+            }
+        }
+
+        const Body* body;
+        int64_t begin;
+        int64_t end;
+    };
+
+    void Submit(Entry* entry);
+    Entry* FindWork(int index);
+    Entry* Steal(int index);
+    bool RunOne();
+    void Execute(Entry* entry);
+    bool HasWork() const;
+    void Park();
+    void WakeOne();
+    void RunInThread(int index);
+
+    const std::string name_;
+    boost::ptr_vector<Thread> threads_;
+    boost::ptr_vector<WorkDeque> deques_;
+    CpuAffinity affinity_;
+    boost::atomic<bool> running_;
+
+    Mutex mutex_;
+    std::deque<Entry*> injected_; // @GUARDBY mutex_
+    boost::atomic<size_t> num_injected_;
+
+    // parked workers wait on futex of epoch_, waked by Submit
+    boost::atomic<int> epoch_;
+    boost::atomic<int> num_parked_;
+};
+
+} // namespace claire
+
+#endif // _CLAIRE_COMMON_THREADING_WORKSTEALINGPOOL_H_
@@ -4,14 +4,21 @@
 
 #include <claire/netty/Acceptor.h>
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
 #include <boost/bind.hpp>
 
 #include <claire/common/events/Channel.h>
 #include <claire/common/events/EventLoop.h>
 #include <claire/common/logging/Logging.h>
+#include <claire/common/metrics/Histogram.h>
 #include <claire/netty/Socket.h>
 #include <claire/netty/InetAddress.h>
 
+DEFINE_int32(acceptor_batch_size, 64, "max connections accepted by acceptor per wakeup");
+
 namespace claire {
 
 Acceptor::Acceptor(EventLoop* loop,
@@ -20,11 +27,15 @@ Acceptor::Acceptor(EventLoop* loop,
     : loop_(loop),
       accept_socket_(Socket::NewNonBlockingSocket(true)),
       accept_channel_(new Channel(loop, accept_socket_->fd())),
-      listenning_(false)
+      listenning_(false),
+      reserved_fd_(-1),
+      accepted_counter_("claire.Acceptor.accepted"),
+      overload_counter_("claire.Acceptor.overload")
 {
     accept_socket_->SetReuseAddr(true);
     accept_socket_->SetReusePort(reuse_port);
     accept_socket_->BindOrDie(listen_address);
+    ReserveFd();
 
     accept_channel_->set_read_callback(
         boost::bind(&Acceptor::OnRead, this));
@@ -34,6 +45,20 @@ Acceptor::~Acceptor()
 {
     accept_channel_->DisableAll();
     accept_channel_->Remove();
+    if (reserved_fd_ >= 0)
+    {
+        ::close(reserved_fd_);
+    }
+}
+
+const InetAddress Acceptor::listen_address() const
+{
+    return accept_socket_->local_address();
+}
+
+void Acceptor::set_edge_triggered(bool on)
+{
+    accept_channel_->set_edge_triggered(on);
 }
 
 void Acceptor::Listen()
@@ -52,23 +77,96 @@ void Acceptor::OnRead()
 {
     loop_->AssertInLoopThread();
 
-    InetAddress from;
-    Socket socket(accept_socket_->AcceptOrDie(&from));
-    if (socket.fd() >= 0)
+    if (reserved_fd_ < 0)
     {
-        if (new_connection_callback_)
-        {
-            new_connection_callback_(socket);
-        }
+        // before accept takes the fds freed since
+        ReserveFd();
     }
-    else
+
+    // edge-triggered channel is not notified again until EAGAIN,
+    // level-triggered one just saves the wakeups
+    int accepted = 0;
+    bool overload = false;
+    bool drained = false;
+    for (int i = 0; i < FLAGS_acceptor_batch_size; i++)
     {
-        if (errno == EMFILE)
+        InetAddress from;
+        Socket socket(accept_socket_->AcceptOrDie(&from));
+        if (socket.fd() >= 0)
+        {
+            accepted++;
+            if (new_connection_callback_)
+            {
+                new_connection_callback_(socket);
+            }
+            continue;
+        }
+
+        if (errno == EAGAIN)
+        {
+            drained = true;
+            break;
+        }
+
+        if (errno == EMFILE || errno == ENFILE)
         {
-            // In multi-thread env, no good solution
-            PLOG(ERROR) << "accept overload";
+            if (!overload)
+            {
+                // once per wakeup, it can be a flood
+                PLOG(ERROR) << "accept overload";
+                overload = true;
+            }
+            // fd is allocated before the queue is checked, so EMFILE is
+            // returned even for an empty queue, which Shed tells
+            if (!Shed())
+            {
+                drained = true;
+                break;
+            }
         }
     }
+
+    accepted_counter_.Add(accepted);
+    HISTOGRAM_COUNTS_100("claire.Acceptor.BatchSize", accepted);
+
+    if (!drained && accept_channel_->edge_triggered())
+    {
+        // batch is used up, accept the rest in next poll
+        accept_channel_->Rearm();
+    }
+}
+
+bool Acceptor::Shed()
+{
+    if (reserved_fd_ < 0)
+    {
+        // one may be freed since accept failed, then accept may
+        // succeed again, so try it before shedding
+        ReserveFd();
+        return reserved_fd_ >= 0;
+    }
+
+    // frees one fd to take the connection off the queue, otherwise
+    // listen socket keeps readable and the loop spins on it
+    ::close(reserved_fd_);
+    auto fd = ::accept(accept_socket_->fd(), NULL, NULL);
+    if (fd >= 0)
+    {
+        ::close(fd);
+        overload_counter_.Increment();
+    }
+    ReserveFd();
+    return fd >= 0;
+}
+
+void Acceptor::ReserveFd()
+{
+    reserved_fd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (reserved_fd_ < 0)
+    {
+        LOG_FIRST_N(ERROR, 1) << "reserve fd for shedding failed, errno " << errno
+                              << ", retried when accepting again";
+    }
 }
 
 } // namespace claire
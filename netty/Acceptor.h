@@ -7,6 +7,7 @@
 #include <boost/noncopyable.hpp>
 
 #include <claire/netty/Callbacks.h>
+#include <claire/common/metrics/Counter.h>
 
 namespace claire {
 
@@ -43,6 +44,19 @@ public:
         new_connection_callback_ = callback;
     }
 
+    ///
+    /// Watches listen socket edge-triggered, every wakeup accepts until
+    /// EAGAIN or --acceptor_batch_size connections
+    ///
+    void set_edge_triggered(bool on);
+
+    EventLoop* loop() const { return loop_; }
+
+    ///
+    /// Address bound, with the port picked by kernel if it was 0
+    ///
+    const InetAddress listen_address() const;
+
     ///
     /// Is acceptor listening
     ///
@@ -59,11 +73,27 @@ private:
     ///
     void OnRead();
 
+    ///
+    /// Accepts and closes one pending connection by the reserved fd,
+    /// when process runs out of fds. Returns false if none is pending,
+    /// or no fd can be reserved
+    ///
+    bool Shed();
+
+    ///
+    /// Opens the fd given up by Shed, -1 if fds are used up
+    ///
+    void ReserveFd();
+
     EventLoop* loop_;
     std::unique_ptr<Socket> accept_socket_;
     std::unique_ptr<Channel> accept_channel_;
     NewConnectionCallback new_connection_callback_;
     bool listenning_;
+    int reserved_fd_;
+
+    Counter accepted_counter_;
+    Counter overload_counter_;
 };
 
 } // namespace claire
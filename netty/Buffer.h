@@ -11,6 +11,7 @@
 #include <algorithm>
 
 #include <claire/netty/Endian.h>
+#include <claire/netty/BufferPool.h>
 #include <claire/common/strings/StringPiece.h>
 #include <claire/common/logging/Logging.h>
 
@@ -33,26 +34,65 @@ public:
     static const size_t kInitialSize = 1024;
 
     Buffer()
-        : buffer_(kCheapPrepend+kInitialSize),
-          reader_index_(kCheapPrepend),
+        : reader_index_(kCheapPrepend),
           writer_index_(kCheapPrepend)
     {
+        BufferPool::instance().Take(kCheapPrepend+kInitialSize, &buffer_);
         DCHECK(ReadableBytes() == 0);
         DCHECK(WritableBytes() == kInitialSize);
         DCHECK(PrependableBytes() == kCheapPrepend);
     }
 
+    /// Empty buffer with initial_size writable bytes
+    explicit Buffer(size_t initial_size)
+        : reader_index_(kCheapPrepend),
+          writer_index_(kCheapPrepend)
+    {
+        BufferPool::instance().Take(kCheapPrepend+initial_size, &buffer_);
+        DCHECK(ReadableBytes() == 0);
+        DCHECK(WritableBytes() == initial_size);
+        DCHECK(PrependableBytes() == kCheapPrepend);
+    }
+
     Buffer(const void* data, size_t length)
-        : buffer_(kCheapPrepend),
-          reader_index_(kCheapPrepend),
+        : reader_index_(kCheapPrepend),
           writer_index_(kCheapPrepend)
     {
+        BufferPool::instance().Take(kCheapPrepend+length, &buffer_);
         DCHECK(ReadableBytes() == 0);
-        DCHECK(WritableBytes() == 0);
+        DCHECK(WritableBytes() == length);
         DCHECK(PrependableBytes() == kCheapPrepend);
         Append(data, length);
     }
 
+    Buffer(const Buffer& rhs)
+        : reader_index_(kCheapPrepend),
+          writer_index_(kCheapPrepend)
+    {
+        BufferPool::instance().Take(kCheapPrepend+rhs.ReadableBytes(), &buffer_);
+        Append(rhs.Peek(), rhs.ReadableBytes());
+    }
+
+    /// rhs is left without storage, which is taken again when written
+    Buffer(Buffer&& rhs)
+        : buffer_(),
+          reader_index_(0),
+          writer_index_(0)
+    {
+        swap(rhs);
+    }
+
+    ~Buffer()
+    {
+        BufferPool::instance().Give(&buffer_);
+    }
+
+    Buffer& operator=(Buffer rhs)
+    {
+        swap(rhs);
+        return *this;
+    }
+
     void swap(Buffer& rhs)
     {
         buffer_.swap(rhs.buffer_);
@@ -64,6 +104,9 @@ public:
     size_t WritableBytes() const { return buffer_.size() - writer_index_; }
     size_t PrependableBytes() const { return reader_index_; }
 
+    /// Bytes of memory held by the buffer
+    size_t Capacity() const { return buffer_.capacity(); }
+
     const char* FindCRLF() const
     {
         const char* crlf = std::search(Peek(), BeginWrite(), kCRLF, kCRLF+2);
@@ -257,13 +300,31 @@ public:
         DCHECK(WritableBytes() >= length);
     }
 
+    /// Moves readable bytes into storage just large enough for them
+    /// and reserve bytes more, the old storage is released.
+    void Shrink(size_t reserve)
+    {
+        Buffer other(ReadableBytes()+reserve);
+        other.Append(Peek(), ReadableBytes());
+        swap(other);
+    }
+
 private:
-    char* begin() { return &buffer_[0]; }
-    const char* begin() const { return &buffer_[0]; }
+    friend class ChainBuffer;
+
+    char* begin() { return buffer_.data(); }
+    const char* begin() const { return buffer_.data(); }
 
     void Reserve(size_t length)
     {
-        if ((WritableBytes()+PrependableBytes()) < (length+kCheapPrepend))
+        if (buffer_.empty())
+        {
+            // moved from
+            BufferPool::instance().Take(kCheapPrepend+length, &buffer_);
+            reader_index_ = kCheapPrepend;
+            writer_index_ = kCheapPrepend;
+        }
+        else if ((WritableBytes()+PrependableBytes()) < (length+kCheapPrepend))
         {
             buffer_.resize(writer_index_+length);
         }
@@ -0,0 +1,120 @@
+// Copyright (c) 2013 The claire-netty Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <claire/netty/BufferPool.h>
+
+#include <pthread.h>
+
+#include "thirdparty/gflags/gflags.h"
+
+#include <claire/netty/Buffer.h>
+#include <claire/netty/ChainBuffer.h>
+#include <claire/common/logging/Logging.h>
+
+DEFINE_int32(buffer_pool_max_bytes, 4*1024*1024, "max bytes held by buffer pool of one thread");
+
+namespace claire {
+
+namespace {
+
+__thread BufferPool* t_buffer_pool = NULL;
+
+pthread_once_t g_pool_key_once = PTHREAD_ONCE_INIT;
+pthread_key_t g_pool_key;
+
+void DestroyBufferPool(void* pool)
+{
+    t_buffer_pool = NULL;
+    delete static_cast<BufferPool*>(pool);
+}
+
+void CreateBufferPoolKey()
+{
+    ::pthread_key_create(&g_pool_key, &DestroyBufferPool);
+}
+
+} // namespace
+
+const size_t BufferPool::kClassSizes[BufferPool::kClasses] = {
+    Buffer::kCheapPrepend + Buffer::kInitialSize,
+    ChainBuffer::kBlockSize,
+    64*1024
+};
+
+BufferPool& BufferPool::instance()
+{
+    if (!t_buffer_pool)
+    {
+        ::pthread_once(&g_pool_key_once, &CreateBufferPoolKey);
+        t_buffer_pool = new BufferPool();
+        ::pthread_setspecific(g_pool_key, t_buffer_pool);
+    }
+    return *t_buffer_pool;
+}
+
+BufferPool::BufferPool()
+    : pooled_bytes_(0),
+      hit_counter_("claire.BufferPool.hit"),
+      miss_counter_("claire.BufferPool.miss")
+{}
+
+BufferPool::~BufferPool() {}
+
+void BufferPool::Take(size_t size, Storage* storage)
+{
+    DCHECK(storage->empty());
+
+    for (int i = 0; i < kClasses; i++)
+    {
+        if (size > kClassSizes[i])
+        {
+            continue;
+        }
+
+        if (free_[i].empty())
+        {
+            miss_counter_.Increment();
+            storage->reserve(kClassSizes[i]);
+        }
+        else
+        {
+            hit_counter_.Increment();
+            storage->swap(free_[i].back());
+            free_[i].pop_back();
+            pooled_bytes_ -= storage->capacity();
+        }
+
+        storage->resize(size);
+        return ;
+    }
+
+    miss_counter_.Increment();
+    storage->resize(size);
+}
+
+void BufferPool::Give(Storage* storage)
+{
+    auto capacity = storage->capacity();
+    if (capacity < kClassSizes[0]
+        || capacity >= 2*kClassSizes[kClasses-1]
+        || pooled_bytes_ + capacity > static_cast<size_t>(FLAGS_buffer_pool_max_bytes))
+    {
+        Storage().swap(*storage);
+        return ;
+    }
+
+    // the largest class fits in the storage
+    auto i = kClasses - 1;
+    while (capacity < kClassSizes[i])
+    {
+        i--;
+    }
+
+    storage->clear();
+    free_[i].push_back(Storage());
+    free_[i].back().swap(*storage);
+    pooled_bytes_ += capacity;
+}
+
+} // namespace claire
@@ -0,0 +1,58 @@
+// Copyright (c) 2013 The claire-netty Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef _CLAIRE_NETTY_BUFFERPOOL_H_
+#define _CLAIRE_NETTY_BUFFERPOOL_H_
+
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include <claire/common/metrics/Counter.h>
+
+namespace claire {
+
+/// A thread local pool of buffer storage, so every EventLoop thread
+/// recycles the storage of its Buffer and ChainBuffer blocks without
+/// going through malloc and contending with other IO threads.
+///
+/// Storage is recycled by size class: small (the initial size of Buffer),
+/// block (ChainBuffer::kBlockSize) and large (64KB). Storage larger than
+/// twice of the large class is never pooled, and the bytes held by one
+/// pool are limited by --buffer_pool_max_bytes.
+class BufferPool : boost::noncopyable
+{
+public:
+    typedef std::vector<char> Storage;
+
+    /// The pool of current thread
+    static BufferPool& instance();
+
+    ~BufferPool();
+
+    /// Resizes the empty storage to size bytes, reuses pooled storage
+    /// of the fit size class if any.
+    void Take(size_t size, Storage* storage);
+
+    /// Gives the storage back to pool, storage is empty after return.
+    void Give(Storage* storage);
+
+    size_t pooled_bytes() const { return pooled_bytes_; }
+
+private:
+    BufferPool();
+
+    static const int kClasses = 3;
+    static const size_t kClassSizes[kClasses];
+
+    std::vector<Storage> free_[kClasses];
+    size_t pooled_bytes_;
+
+    Counter hit_counter_;
+    Counter miss_counter_;
+};
+
+} // namespace claire
+
+#endif // _CLAIRE_NETTY_BUFFERPOOL_H_
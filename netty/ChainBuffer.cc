@@ -0,0 +1,252 @@
+// Copyright (c) 2013 The claire-netty Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <claire/netty/ChainBuffer.h>
+
+#include <string.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+
+#include <boost/make_shared.hpp>
+
+#include <claire/netty/Buffer.h>
+#include <claire/common/logging/Logging.h>
+
+namespace claire {
+
+const size_t ChainBuffer::kCheapPrepend;
+const size_t ChainBuffer::kBlockSize;
+
+size_t ChainBuffer::WritableBytes() const
+{
+    if (slices_.empty())
+    {
+        return 0;
+    }
+
+    const auto& tail = slices_.back();
+    if (!tail.block.unique())
+    {
+        return 0;
+    }
+    return tail.block->size() - tail.end;
+}
+
+void ChainBuffer::Append(const void* data, size_t length)
+{
+    auto p = static_cast<const char*>(data);
+
+    auto writable = std::min(WritableBytes(), length);
+    if (writable > 0)
+    {
+        ::memcpy(BeginWrite(), p, writable);
+        HasWritten(writable);
+        p += writable;
+        length -= writable;
+    }
+
+    if (length > 0)
+    {
+        EnsureWritableBytes(length);
+        ::memcpy(BeginWrite(), p, length);
+        HasWritten(length);
+    }
+}
+
+void ChainBuffer::Append(Buffer* buffer)
+{
+    auto length = buffer->ReadableBytes();
+    if (length <= WritableBytes())
+    {
+        Append(buffer->Peek(), length);
+        buffer->ConsumeAll();
+        return ;
+    }
+
+    Buffer adopted;
+    adopted.swap(*buffer);
+
+    auto block = boost::make_shared<Block>();
+    block->storage.swap(adopted.buffer_);
+    slices_.push_back(Slice(block, adopted.reader_index_, adopted.writer_index_));
+    readable_bytes_ += length;
+}
+
+void ChainBuffer::Append(ChainBuffer* chain)
+{
+    if (chain == this)
+    {
+        return ;
+    }
+
+    if (slices_.empty())
+    {
+        swap(*chain);
+        return ;
+    }
+
+    slices_.insert(slices_.end(), chain->slices_.begin(), chain->slices_.end());
+    readable_bytes_ += chain->readable_bytes_;
+    chain->ConsumeAll();
+}
+
+void ChainBuffer::Prepend(const void* data, size_t length)
+{
+    if (!slices_.empty())
+    {
+        auto& head = slices_.front();
+        if (head.block.unique() && head.begin >= length)
+        {
+            head.begin -= length;
+            ::memcpy(head.block->data() + head.begin, data, length);
+            readable_bytes_ += length;
+            return ;
+        }
+    }
+
+    // reserve room in front of the new block for further prepending
+    auto size = std::max(length, kCheapPrepend);
+    auto block = boost::make_shared<Block>(size);
+    ::memcpy(block->data() + size - length, data, length);
+    slices_.push_front(Slice(block, size - length, size));
+    readable_bytes_ += length;
+}
+
+ChainBuffer ChainBuffer::Split(size_t length)
+{
+    CHECK(length <= ReadableBytes());
+
+    ChainBuffer result;
+    while (length > 0)
+    {
+        auto& head = slices_.front();
+        if (head.size() <= length)
+        {
+            length -= head.size();
+            result.readable_bytes_ += head.size();
+            readable_bytes_ -= head.size();
+            result.slices_.push_back(head);
+            slices_.pop_front();
+        }
+        else
+        {
+            result.slices_.push_back(Slice(head.block, head.begin, head.begin + length));
+            result.readable_bytes_ += length;
+            readable_bytes_ -= length;
+            head.begin += length;
+            length = 0;
+        }
+    }
+
+    return result;
+}
+
+void ChainBuffer::Consume(size_t length)
+{
+    CHECK(length <= ReadableBytes());
+    if (length == ReadableBytes())
+    {
+        ConsumeAll();
+        return ;
+    }
+
+    readable_bytes_ -= length;
+    while (length > 0)
+    {
+        auto& head = slices_.front();
+        if (head.size() <= length)
+        {
+            length -= head.size();
+            slices_.pop_front();
+        }
+        else
+        {
+            head.begin += length;
+            length = 0;
+        }
+    }
+}
+
+void ChainBuffer::ConsumeAll()
+{
+    slices_.clear();
+    readable_bytes_ = 0;
+}
+
+size_t ChainBuffer::Read(void* data, size_t length)
+{
+    auto readable_length = std::min(ReadableBytes(), length);
+
+    auto p = static_cast<char*>(data);
+    auto left = readable_length;
+    for (auto it = slices_.begin(); left > 0 && it != slices_.end(); ++it)
+    {
+        auto n = std::min(left, (*it).size());
+        ::memcpy(p, (*it).data(), n);
+        p += n;
+        left -= n;
+    }
+
+    Consume(readable_length);
+    return readable_length;
+}
+
+std::string ChainBuffer::ToString() const
+{
+    std::string result;
+    result.reserve(ReadableBytes());
+    for (auto it = slices_.begin(); it != slices_.end(); ++it)
+    {
+        result.append((*it).data(), (*it).size());
+    }
+    return result;
+}
+
+int ChainBuffer::Peek(struct iovec* vec, int count) const
+{
+    int n = 0;
+    for (auto it = slices_.begin(); n < count && it != slices_.end(); ++it)
+    {
+        if ((*it).size() == 0)
+        {
+            continue;
+        }
+
+        vec[n].iov_base = const_cast<char*>((*it).data());
+        vec[n].iov_len = (*it).size();
+        n++;
+    }
+    return n;
+}
+
+void ChainBuffer::EnsureWritableBytes(size_t length)
+{
+    if (WritableBytes() >= length)
+    {
+        return ;
+    }
+
+    // the first block of chain keeps kCheapPrepend bytes for Prepend
+    auto offset = slices_.empty() ? kCheapPrepend : 0;
+    auto size = std::max(kBlockSize, length + offset);
+    slices_.push_back(Slice(boost::make_shared<Block>(size), offset, offset));
+    DCHECK(WritableBytes() >= length);
+}
+
+char* ChainBuffer::BeginWrite()
+{
+    DCHECK(!slices_.empty());
+    auto& tail = slices_.back();
+    return tail.block->data() + tail.end;
+}
+
+void ChainBuffer::HasWritten(size_t length)
+{
+    DCHECK(length <= WritableBytes());
+    slices_.back().end += length;
+    readable_bytes_ += length;
+}
+
+} // namespace claire
@@ -0,0 +1,168 @@
+// Copyright (c) 2013 The claire-netty Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef _CLAIRE_NETTY_CHAINBUFFER_H_
+#define _CLAIRE_NETTY_CHAINBUFFER_H_
+
+#include <deque>
+#include <string>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <claire/netty/Endian.h>
+#include <claire/netty/BufferPool.h>
+#include <claire/common/strings/StringPiece.h>
+
+struct iovec;
+
+namespace claire {
+
+class Buffer;
+
+/// A buffer made of a chain of reference counted blocks,
+/// modeled after org.jboss.netty.buffer.CompositeChannelBuffer
+///
+/// @code
+/// +-----------------+    +-----------------+    +-----------------+
+/// |     slice 0     | -> |     slice 1     | -> |     slice 2     |
+/// +-----------------+    +-----------------+    +-----------------+
+///   [begin, end) of        [begin, end) of        [begin, end) of
+///       block A                block A                block B
+/// @endcode
+///
+/// Split, Append(ChainBuffer*) and Prepend never copy the payload, slices
+/// only hold references of the blocks. Copying a ChainBuffer shares blocks.
+/// A block is written in place only when one slice references it, so shared
+/// data is never modified.
+class ChainBuffer
+{
+public:
+    static const size_t kCheapPrepend = 8;
+    static const size_t kBlockSize = 8192;
+
+    ChainBuffer()
+        : readable_bytes_(0)
+    {}
+
+    ChainBuffer(const void* data, size_t length)
+        : readable_bytes_(0)
+    {
+        Append(data, length);
+    }
+
+    void swap(ChainBuffer& rhs)
+    {
+        slices_.swap(rhs.slices_);
+        std::swap(readable_bytes_, rhs.readable_bytes_);
+    }
+
+    size_t ReadableBytes() const { return readable_bytes_; }
+
+    /// Contiguous writable bytes at the tail
+    size_t WritableBytes() const;
+
+    /// Number of slices, which is the number of iovec needed by writev
+    size_t SliceCount() const { return slices_.size(); }
+
+    /// Copies data at the end of the chain
+    void Append(const void* data, size_t length);
+
+    void Append(const StringPiece& s)
+    {
+        Append(s.data(), s.size());
+    }
+
+    void AppendInt32(int32_t x)
+    {
+        int32_t be32 = HostToNetwork32(x);
+        Append(&be32, sizeof be32);
+    }
+
+    /// Moves the content of buffer to the end of the chain.
+    /// Small content is copied into the writable tail, otherwise
+    /// the storage of buffer is taken over without copying.
+    /// buffer is empty after return.
+    void Append(Buffer* buffer);
+
+    /// Moves all slices of chain to the end of this one, without copying.
+    /// chain is empty after return.
+    void Append(ChainBuffer* chain);
+
+    void Prepend(const void* data, size_t length);
+
+    void PrependInt32(int32_t x)
+    {
+        auto be32 = HostToNetwork32(static_cast<uint32_t>(x));
+        Prepend(&be32, sizeof be32);
+    }
+
+    /// Cuts the first length bytes into a new chain, without copying.
+    ChainBuffer Split(size_t length);
+
+    void Consume(size_t length);
+    void ConsumeAll();
+
+    /// Copies at most length bytes into data, and consumes them
+    size_t Read(void* data, size_t length);
+
+    std::string ToString() const;
+
+    /// Fills at most count iovec with readable slices,
+    /// returns the number of iovec filled.
+    int Peek(struct iovec* vec, int count) const;
+
+    /// Makes sure at least length contiguous bytes are writable at the tail
+    void EnsureWritableBytes(size_t length);
+
+    char* BeginWrite();
+
+    void HasWritten(size_t length);
+
+private:
+    /// Storage of block is recycled by BufferPool of the releasing thread
+    struct Block : boost::noncopyable
+    {
+        Block() {}
+
+        explicit Block(size_t size)
+        {
+            BufferPool::instance().Take(size, &storage);
+        }
+
+        ~Block()
+        {
+            BufferPool::instance().Give(&storage);
+        }
+
+        size_t size() const { return storage.size(); }
+        char* data() { return storage.data(); }
+
+        BufferPool::Storage storage;
+    };
+    typedef boost::shared_ptr<Block> BlockPtr;
+
+    struct Slice
+    {
+        Slice(const BlockPtr& block__, size_t begin__, size_t end__)
+            : block(block__),
+              begin(begin__),
+              end(end__)
+        {}
+
+        size_t size() const { return end - begin; }
+        const char* data() const { return block->data() + begin; }
+
+        BlockPtr block;
+        size_t begin;
+        size_t end;
+    };
+
+    std::deque<Slice> slices_;
+    size_t readable_bytes_;
+};
+
+} // namespace claire
+
+#endif // _CLAIRE_NETTY_CHAINBUFFER_H_
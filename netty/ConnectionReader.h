@@ -0,0 +1,157 @@
+// Copyright (c) 2013 The claire-netty Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef _CLAIRE_NETTY_CONNECTIONREADER_H_
+#define _CLAIRE_NETTY_CONNECTIONREADER_H_
+
+// Reads a TcpConnection from a coroutine, needs -std=c++20.
+//
+//   Task<void> Echo(TcpConnectionPtr connection)
+//   {
+//       ConnectionReader reader(connection);
+//       Buffer* buffer;
+//       while ((buffer = co_await reader.Read()) != NULL)
+//       {
+//           connection->Send(buffer);
+//       }
+//   }
+//
+//   // in connection callback, runs in the loop of connection
+//   Spawn(connection->loop(), Echo(connection));
+
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <claire/netty/Buffer.h>
+#include <claire/netty/Callbacks.h>
+#include <claire/netty/TcpConnection.h>
+#include <claire/common/events/Coroutine.h>
+
+namespace claire {
+
+/// Takes over message callback of connection, must be created and used
+/// in the loop thread of connection. After the reader is destroyed input
+/// goes to the message callback the connection had before.
+class ConnectionReader : boost::noncopyable
+{
+    struct State;
+
+public:
+    explicit ConnectionReader(const TcpConnectionPtr& connection)
+        : state_(boost::make_shared<State>())
+    {
+        connection->loop()->AssertInLoopThread();
+        state_->closed = !connection->connected();
+        state_->previous_message_callback = connection->message_callback();
+
+        // callbacks are not replaced back, they may be running the coroutine
+        // destroying the reader
+        connection->set_message_callback(
+            boost::bind(&State::OnMessage, state_, _1, _2));
+        connection->set_connection_callback(
+            boost::bind(&State::OnConnection, state_, connection->connection_callback(), _1));
+    }
+
+    ~ConnectionReader()
+    {
+        state_->detached = true;
+        state_->waiter = nullptr;
+    }
+
+    class ReadAwaiter
+    {
+    public:
+        explicit ReadAwaiter(State* state__) : state_(state__) {}
+
+        /// Ready if data came before, or connection is closed
+        bool await_ready() const noexcept
+        {
+            return state_->unread || state_->closed;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle) noexcept
+        {
+            state_->waiter = handle;
+        }
+
+        /// Input of connection, consume what is used and leave the
+        /// rest for next Read, NULL once connection is closed and the
+        /// data came before close is read.
+        Buffer* await_resume() noexcept
+        {
+            state_->waiter = nullptr;
+            if (state_->unread)
+            {
+                state_->unread = false;
+                return state_->buffer;
+            }
+            return NULL;
+        }
+
+    private:
+        State* state_;
+    };
+
+    /// Resumes when new data arrives
+    ReadAwaiter Read()
+    {
+        return ReadAwaiter(state_.get());
+    }
+
+private:
+    // bound to callbacks of connection, outlives reader
+    struct State
+    {
+        void OnMessage(const TcpConnectionPtr& connection, Buffer* buffer__)
+        {
+            if (detached)
+            {
+                if (previous_message_callback)
+                {
+                    previous_message_callback(connection, buffer__);
+                }
+                return ;
+            }
+
+            buffer = buffer__;
+            unread = true;
+            if (waiter)
+            {
+                waiter.resume();
+            }
+        }
+
+        void OnConnection(const ConnectionCallback& previous, const TcpConnectionPtr& connection)
+        {
+            if (previous)
+            {
+                previous(connection);
+            }
+
+            if (!connection->connected() && !detached)
+            {
+                closed = true;
+                if (waiter)
+                {
+                    waiter.resume();
+                }
+            }
+        }
+
+        Buffer* buffer = NULL;
+        bool unread = false;
+        bool closed = false;
+        bool detached = false;
+        std::coroutine_handle<> waiter;
+        MessageCallback previous_message_callback;
+    };
+
+    boost::shared_ptr<State> state_;
+};
+
+} // namespace claire
+
+#endif // _CLAIRE_NETTY_CONNECTIONREADER_H_
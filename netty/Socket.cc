@@ -7,12 +7,37 @@
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 
+#include <limits.h>
 #include <stdio.h>
 #include <strings.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <linux/errqueue.h>
 
 #include <claire/common/base/Types.h>
 #include <claire/common/logging/Logging.h>
 #include <claire/netty/Buffer.h>
+#include <claire/netty/ChainBuffer.h>
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46
+#endif
+
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
 
 namespace claire {
 
@@ -95,7 +120,11 @@ int Socket::AcceptOrDie(InetAddress *peer_address__)
     if (nfd < 0)
     {
         int saved_errno = errno;
-        PLOG(ERROR) << "accept failed ";
+        // running out of fds is handled by caller
+        if (saved_errno != EAGAIN && saved_errno != EMFILE && saved_errno != ENFILE)
+        {
+            PLOG(ERROR) << "accept failed ";
+        }
 
         switch (saved_errno)
         {
@@ -105,6 +134,9 @@ int Socket::AcceptOrDie(InetAddress *peer_address__)
             case EPROTO:
             case EPERM:
             case EMFILE:
+            case ENFILE:
+            case ENOBUFS:
+            case ENOMEM:
                 errno = saved_errno;
                 break;
             default:
@@ -187,7 +219,10 @@ ssize_t Socket::Read(Buffer* buffer, InetAddress* peer_address__)
     ssize_t n = ::recvmsg(fd_, &hdr, 0);
     if (n < 0)
     {
-        PLOG(ERROR) << "recvmsg failed ";
+        if (errno != EAGAIN)
+        {
+            PLOG(ERROR) << "recvmsg failed ";
+        }
         return n;
     }
 
@@ -214,6 +249,113 @@ ssize_t Socket::Write(Buffer* buffer)
     return ::write(fd_, buffer->Peek(), buffer->ReadableBytes());
 }
 
+ssize_t Socket::Read(ChainBuffer* buffer)
+{
+    char extra[65536];
+    if (buffer->WritableBytes() == 0)
+    {
+        buffer->EnsureWritableBytes(ChainBuffer::kBlockSize);
+    }
+    size_t writable = buffer->WritableBytes();
+
+    struct iovec vec[2];
+    vec[0].iov_base = buffer->BeginWrite();
+    vec[0].iov_len = writable;
+    vec[1].iov_base = extra;
+    vec[1].iov_len = sizeof extra;
+
+    ssize_t n = ::readv(fd_, vec, (writable < sizeof extra) ? 2 : 1);
+    if (n < 0)
+    {
+        if (errno != EAGAIN)
+        {
+            PLOG(ERROR) << "readv failed ";
+        }
+        return n;
+    }
+
+    if (implicit_cast<size_t>(n) <= writable)
+    {
+        buffer->HasWritten(static_cast<size_t>(n));
+    }
+    else
+    {
+        buffer->HasWritten(writable);
+        buffer->Append(extra, static_cast<size_t>(n) - writable);
+    }
+
+    return n;
+}
+
+ssize_t Socket::Write(ChainBuffer* buffer)
+{
+    struct iovec vec[IOV_MAX];
+    auto count = buffer->Peek(vec, IOV_MAX);
+    return ::writev(fd_, vec, count);
+}
+
+ssize_t Socket::SendFile(int in_fd, off_t* offset, size_t length)
+{
+    return ::sendfile(fd_, in_fd, offset, length);
+}
+
+ssize_t Socket::WriteZeroCopy(ChainBuffer* buffer)
+{
+    struct iovec vec[IOV_MAX];
+
+    struct msghdr hdr;
+    ::bzero(&hdr, sizeof hdr);
+    hdr.msg_iov = vec;
+    hdr.msg_iovlen = buffer->Peek(vec, IOV_MAX);
+
+    return ::sendmsg(fd_, &hdr, MSG_ZEROCOPY);
+}
+
+bool Socket::ReadZeroCopyCompletion(uint32_t* low, uint32_t* high, bool* copied)
+{
+    // other errors are queued too, e.g. ICMP ones, skips them until a
+    // completion or the queue is empty, otherwise the completions behind
+    // them are never read in edge-triggered mode
+    for (;;)
+    {
+        char control[128];
+
+        struct msghdr hdr;
+        ::bzero(&hdr, sizeof hdr);
+        hdr.msg_control = control;
+        hdr.msg_controllen = sizeof control;
+
+        if (::recvmsg(fd_, &hdr, MSG_ERRQUEUE) < 0)
+        {
+            if (errno != EAGAIN)
+            {
+                PLOG(ERROR) << "recvmsg MSG_ERRQUEUE failed ";
+            }
+            return false;
+        }
+
+        for (auto cmsg = CMSG_FIRSTHDR(&hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(&hdr, cmsg))
+        {
+            if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR)
+                && !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))
+            {
+                continue;
+            }
+
+            auto serr = reinterpret_cast<struct sock_extended_err*>(CMSG_DATA(cmsg));
+            if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+            {
+                continue;
+            }
+
+            *low = serr->ee_info;
+            *high = serr->ee_data;
+            *copied = (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0;
+            return true;
+        }
+    }
+}
+
 ssize_t Socket::sendto(const void * data, size_t length, const InetAddress& server_address)
 {
     return ::sendto(fd_, data, length, 0, sockaddr_cast(&server_address.sockaddr()), sizeof(server_address.sockaddr()));
@@ -255,11 +397,24 @@ void Socket::SetKeepAlive(bool on)
                  &option, static_cast<socklen_t>(sizeof option));
 }
 
+bool Socket::SetZeroCopy(bool on)
+{
+    int option = on ? 1 : 0;
+    return ::setsockopt(fd_, SOL_SOCKET, SO_ZEROCOPY,
+                        &option, static_cast<socklen_t>(sizeof option)) == 0;
+}
+
+bool Socket::SetBusyPoll(int microseconds)
+{
+    return ::setsockopt(fd_, SOL_SOCKET, SO_BUSY_POLL,
+                        &microseconds, static_cast<socklen_t>(sizeof microseconds)) == 0;
+}
+
 void Socket::SetReusePort(bool on)
 {
 #ifdef SO_REUSEPORT
     int option = on ? 1: 0;
-    ::setsockopt(fd_, SOL_SOCKET, SO_KEEPALIVE,
+    ::setsockopt(fd_, SOL_SOCKET, SO_REUSEPORT,
                  &option, static_cast<socklen_t>(sizeof option));
 #else
     LOG(ERROR) << "Not Support SO_REUSEPORT";
@@ -17,6 +17,7 @@ struct tcp_info;
 namespace claire {
 
 class Buffer;
+class ChainBuffer;
 
 /// Wrapper of socket file descriptor.
 /// It closes the sockfd when desctructs.
@@ -66,6 +67,29 @@ public:
     ssize_t Read(Buffer* buffer, InetAddress* peer_address);
     ssize_t Write(const void* buffer, size_t length);
     ssize_t Write(Buffer* buffer);
+
+    /// Scatter read into the writable tail of buffer,
+    /// chains new blocks when the tail is not enough.
+    ssize_t Read(ChainBuffer* buffer);
+
+    /// Gather write at most IOV_MAX slices of buffer in one writev,
+    /// it does not consume buffer.
+    ssize_t Write(ChainBuffer* buffer);
+
+    /// Sends at most length bytes of in_fd from *offset by sendfile,
+    /// *offset is advanced by the bytes sent.
+    ssize_t SendFile(int in_fd, off_t* offset, size_t length);
+
+    /// Like Write(ChainBuffer*) but sends with MSG_ZEROCOPY, the data
+    /// must be kept unchanged until its completion is read.
+    ssize_t WriteZeroCopy(ChainBuffer* buffer);
+
+    /// Reads one MSG_ZEROCOPY completion from the error queue, which
+    /// covers sends numbered [*low, *high]. *copied is set if kernel
+    /// fell back to copying. Other queued errors are skipped.
+    /// Returns false if there is no completion.
+    bool ReadZeroCopyCompletion(uint32_t* low, uint32_t* high, bool* copied);
+
     ssize_t sendto(const void* buffer, size_t length, const InetAddress& server_address);
 
     /// Get local InetAddress
@@ -85,6 +109,14 @@ public:
 
     void SetReusePort(bool on);
 
+    /// Returns false if MSG_ZEROCOPY is not supported
+    bool SetZeroCopy(bool on);
+
+    /// SO_BUSY_POLL, blocking reads busy poll the device queue for
+    /// @c microseconds. Returns false if not permitted, raising it above
+    /// net.core.busy_read needs CAP_NET_ADMIN.
+    bool SetBusyPoll(int microseconds);
+
     bool GetTcpInfo(struct tcp_info*) const;
     bool GetTcpInfoString(char* buffer, int length) const;
 private:
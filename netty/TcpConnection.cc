@@ -5,30 +5,106 @@
 #include <claire/netty/TcpConnection.h>
 
 #include <errno.h>
+#include <limits.h>
 #include <stdio.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/socket.h>
 
 #include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
 
 #include <claire/netty/Socket.h>
 #include <claire/common/events/EventLoop.h>
 #include <claire/common/events/Channel.h>
+#include <claire/common/base/WeakCallback.h>
 #include <claire/common/logging/Logging.h>
 #include <claire/common/metrics/Histogram.h>
 
 DEFINE_int32(connection_watermark, 64*1024*1024, "tcp connection high watermark");
+DEFINE_int32(connection_buffer_idle_ms, 30*1000, "release input buffer of connection idle for such milliseconds, 0 means never");
+DEFINE_int32(connection_buffer_shrink_bytes, 64*1024, "release input buffer of connection larger than such bytes once drained");
+DEFINE_int32(connection_drain_budget, 256*1024, "max bytes read or written by edge-triggered connection per wakeup");
+DEFINE_int32(connection_zerocopy_threshold, 0, "send output not less than such bytes by MSG_ZEROCOPY, 0 means never");
 
 namespace claire {
 
 namespace {
 
-size_t OutputBufferSize(const boost::ptr_vector<Buffer>& v)
+// pops the pinned chains completed, the front one is numbered
+// next - pinned->size(), returns bytes released
+size_t ReleaseCompleted(Socket* socket,
+                        std::deque<ChainBuffer>* pinned,
+                        uint32_t next,
+                        Counter* copied_counter)
 {
-    size_t n = 0;
-    for (auto it = v.begin(); it != v.end(); ++it)
+    size_t released = 0;
+    uint32_t low, high;
+    bool copied;
+    while (!pinned->empty()
+           && socket->ReadZeroCopyCompletion(&low, &high, &copied))
     {
-        n += (*it).ReadableBytes();
+        if (copied)
+        {
+            // kernel copied the data anyway, e.g. loopback or no NIC support
+            copied_counter->Add(static_cast<int>(high - low + 1));
+        }
+
+        // completions arrive in order, a range releases all buffers up to high
+        auto front = next - static_cast<uint32_t>(pinned->size());
+        while (!pinned->empty() && static_cast<int32_t>(high - front) >= 0)
+        {
+            released += pinned->front().ReadableBytes();
+            pinned->pop_front();
+            front++;
+        }
     }
-    return n;
+    return released;
+}
+
+// chains still pinned when the connection is destroyed, kept with a dup
+// of its socket until they are completed, otherwise BufferPool would
+// reuse their blocks while the kernel still sends them
+struct ZeroCopyParking
+{
+    explicit ZeroCopyParking(int fd)
+        : socket(fd),
+          next(0),
+          checks(0)
+    {}
+
+    Socket socket;
+    std::deque<ChainBuffer> pinned;
+    uint32_t next;
+    int checks;
+};
+
+const int kParkingCheckMs = 100;
+const int kParkingMaxChecks = 600;
+
+Counter g_parking_copied_counter("claire.TcpConnection.ZeroCopyCopied");
+
+void CheckParking(EventLoop* loop, const boost::shared_ptr<ZeroCopyParking>& parking)
+{
+    ReleaseCompleted(&parking->socket, &parking->pinned, parking->next, &g_parking_copied_counter);
+    if (parking->pinned.empty())
+    {
+        return ; // the dup is closed with the last reference
+    }
+
+    if (++parking->checks == kParkingMaxChecks)
+    {
+        // peer stops reading, disconnecting drops the queued data, so
+        // its completions are raised even if another fd holds the socket
+        LOG(WARNING) << "disconnect fd " << parking->socket.fd()
+                     << " whose zerocopy buffers are not completed";
+        struct sockaddr address;
+        ::bzero(&address, sizeof address);
+        address.sa_family = AF_UNSPEC;
+        ::connect(parking->socket.fd(), &address, sizeof address);
+    }
+
+    loop->RunAfter(kParkingCheckMs, boost::bind(&CheckParking, loop, parking));
 }
 
 } // namespace
@@ -43,10 +119,20 @@ TcpConnection::TcpConnection(EventLoop *loop__,
       channel_(new Channel(loop_, socket_->fd())),
       local_address_(socket_->local_address()),
       peer_address_(socket_->peer_address()),
+      zerocopy_next_(0),
+      zerocopy_enabled_(false),
+      zerocopy_disabled_(false),
       received_bytes_(0),
       sent_bytes_(0),
+      buffer_bytes_(0),
+      pending_bytes_(0),
+      queued_bytes_(0),
+      zerocopy_pinned_bytes_(0),
       received_bytes_counter_("claire.TcpConnection.ReceivedBytes"),
-      sent_bytes_counter_("claire.TcpConnection.SentBytes")
+      sent_bytes_counter_("claire.TcpConnection.SentBytes"),
+      buffer_bytes_counter_("claire.TcpConnection.BufferBytes"),
+      zerocopy_bytes_counter_("claire.TcpConnection.ZeroCopyBytes"),
+      zerocopy_copied_counter_("claire.TcpConnection.ZeroCopyCopied")
 {
     channel_->set_read_callback(
         boost::bind(&TcpConnection::OnRead, this));
@@ -63,6 +149,8 @@ TcpConnection::TcpConnection(EventLoop *loop__,
 
     socket_->SetKeepAlive(true);
 
+    // counted at once, so a burst of connections is spread by it
+    loop_->load().connections++;
     Counter("claire.TcpConnection.connected").Increment();
 }
 
@@ -71,12 +159,32 @@ TcpConnection::~TcpConnection()
     HISTOGRAM_MEMORY_KB("claire.TcpConnection.SentBytes", sent_bytes_);
     HISTOGRAM_MEMORY_KB("claire.TcpConnection.ReceivedBytes", received_bytes_);
     Counter("claire.TcpConnection.disconnected").Increment();
+    buffer_bytes_counter_.Subtract(static_cast<int>(buffer_bytes_));
+    loop_->load().connections--;
+    loop_->load().pending_bytes -= pending_bytes_;
 
     LOG(DEBUG) << "TcpConnection::TcpConnection " << peer_address_.ToString()
                << " -> " << local_address_.ToString() << " : id=" << id_
                << " fd=" << channel_->fd();
 }
 
+template<typename B>
+struct TcpConnection::SendTask
+{
+    SendTask(const TcpConnectionPtr& connection__, B&& buffer__)
+        : connection(connection__),
+          buffer(std::move(buffer__))
+    {}
+
+    void operator()()
+    {
+        connection->SendInLoop(buffer);
+    }
+
+    TcpConnectionPtr connection;
+    B buffer;
+};
+
 void TcpConnection::Send(Buffer* buffer)
 {
     if (loop_->IsInLoopThread())
@@ -85,10 +193,7 @@ void TcpConnection::Send(Buffer* buffer)
     }
     else
     {
-        loop_->Run(
-            boost::bind(static_cast<void (TcpConnection::*) (Buffer&)>(&TcpConnection::SendInLoop),
-                        shared_from_this(),
-                        Buffer(std::forward<Buffer>(*buffer))));
+        loop_->Run(SendTask<Buffer>(shared_from_this(), std::move(*buffer)));
     }
 }
 
@@ -104,20 +209,95 @@ void TcpConnection::Send(const StringPiece& s)
         SendInLoop(s.data(), s.size());
     }
     else
+    {
+        loop_->Run(SendTask<Buffer>(shared_from_this(), Buffer(s.data(), s.size())));
+    }
+}
+
+void TcpConnection::Send(ChainBuffer* buffer)
+{
+    if (loop_->IsInLoopThread())
+    {
+        SendInLoop(*buffer);
+    }
+    else
+    {
+        ChainBuffer chain;
+        chain.swap(*buffer);
+        loop_->Run(SendTask<ChainBuffer>(shared_from_this(), std::move(chain)));
+    }
+}
+
+void TcpConnection::SendFile(int fd, off_t offset, size_t length)
+{
+    if (length == 0)
+    {
+        return ;
+    }
+
+    auto dup_fd = ::dup(fd);
+    if (dup_fd < 0)
+    {
+        PLOG(ERROR) << "TcpConnection::SendFile dup failed";
+        return ;
+    }
+
+    if (loop_->IsInLoopThread())
+    {
+        SendFileInLoop(dup_fd, offset, length);
+    }
+    else
     {
         loop_->Run(
-            boost::bind(static_cast<void (TcpConnection::*) (Buffer&)>(&TcpConnection::SendInLoop),
+            boost::bind(&TcpConnection::SendFileInLoop,
                         shared_from_this(),
-                        Buffer(s.data(), s.size())));
+                        dup_fd,
+                        offset,
+                        length));
+    }
+}
+
+void TcpConnection::SendFileInLoop(int fd, off_t offset, size_t length)
+{
+    loop_->AssertInLoopThread();
+
+    if (state_ == kDisconnected)
+    {
+        LOG(ERROR) << "disconnected, give up writing";
+        ::close(fd);
+        return ;
+    }
+
+    auto idle = !channel_->IsWriting() && QueuedBytes() == 0;
+    QueueOutput(length);
+    file_regions_.push_back(new FileRegion(fd, offset, length));
+
+    // nothing ahead of the file, send it now
+    if (idle)
+    {
+        OnWrite();
     }
 }
 
 void TcpConnection::SendInLoop(Buffer& buffer)
 {
+    // large buffer is adopted by a chain, which can be sent by MSG_ZEROCOPY
+    if (FLAGS_connection_zerocopy_threshold > 0
+        && buffer.ReadableBytes() >= static_cast<size_t>(FLAGS_connection_zerocopy_threshold)
+        && !zerocopy_disabled_)
+    {
+        ChainBuffer chain;
+        chain.Append(&buffer);
+        SendInLoop(chain);
+        return ;
+    }
+
     if (channel_->IsWriting())
     {
-        CHECK(!output_buffers_.empty());
-        output_buffers_.push_back(new Buffer(std::forward<Buffer>(buffer)));
+        DCHECK(QueuedBytes() > 0);
+        QueueOutput(buffer.ReadableBytes());
+        OutputTail()->Append(&buffer);
+        UpdateBufferBytes();
     }
     else
     {
@@ -139,7 +319,7 @@ void TcpConnection::SendInLoop(const void* data, size_t length)
     bool error = false;
     ssize_t nwrote = 0;
     size_t remaining = length;
-    if (!channel_->IsWriting() && output_buffers_.empty())
+    if (!channel_->IsWriting() && QueuedBytes() == 0)
     {
         nwrote = socket_->Write(data, length);
         if (nwrote >= 0)
@@ -171,28 +351,85 @@ void TcpConnection::SendInLoop(const void* data, size_t length)
     {
         LOG(TRACE) << "writing more data";
 
-        size_t left = OutputBufferSize(output_buffers_);
-        if (left + remaining > static_cast<size_t>(FLAGS_connection_watermark)
-            && left < static_cast<size_t>(FLAGS_connection_watermark)
-            && high_watermark_callback_)
-        {
-            loop_->Post(
-                boost::bind(high_watermark_callback_,
-                            shared_from_this(),
-                            left + remaining));
-        }
+        QueueOutput(remaining);
+        OutputTail()->Append(static_cast<const char*>(data)+nwrote, remaining);
+        UpdateBufferBytes();
+    }
+}
+
+void TcpConnection::SendInLoop(ChainBuffer& buffer)
+{
+    loop_->AssertInLoopThread();
 
-        if (output_buffers_.empty())
+    if (state_ == kDisconnected)
+    {
+        LOG(ERROR) << "disconnected, give up writing";
+        return ;
+    }
+
+    bool error = false;
+    if (!channel_->IsWriting() && QueuedBytes() == 0)
+    {
+        auto nwrote = WriteOutput(&buffer);
+        if (nwrote >= 0)
         {
-            output_buffers_.push_back(new Buffer());
+            if (buffer.ReadableBytes() == 0 && write_complete_callback_)
+            {
+                loop_->Run(
+                    boost::bind(write_complete_callback_, shared_from_this()));
+            }
         }
-        output_buffers_.back().Append(static_cast<const char*>(data)+nwrote, remaining);
-
-        if (!channel_->IsWriting())
+        else
         {
-            channel_->EnableWriting();
+            if (errno != EWOULDBLOCK)
+            {
+                PLOG(ERROR) << "TcpConnection::SendInLoop";
+                if (errno == EPIPE || errno == ECONNRESET)
+                {
+                    error = true;
+                }
+            }
         }
     }
+
+    if (!error && buffer.ReadableBytes() > 0)
+    {
+        LOG(TRACE) << "writing more data";
+
+        QueueOutput(buffer.ReadableBytes());
+        OutputTail()->Append(&buffer);
+        UpdateBufferBytes();
+    }
+}
+
+void TcpConnection::QueueOutput(size_t remaining)
+{
+    size_t left = QueuedBytes();
+    if (left + remaining > static_cast<size_t>(FLAGS_connection_watermark)
+        && left < static_cast<size_t>(FLAGS_connection_watermark)
+        && high_watermark_callback_)
+    {
+        loop_->Post(
+            boost::bind(high_watermark_callback_,
+                        shared_from_this(),
+                        left + remaining));
+    }
+    queued_bytes_ += remaining;
+
+    if (!channel_->IsWriting())
+    {
+        channel_->EnableWriting();
+    }
+}
+
+ChainBuffer* TcpConnection::OutputTail()
+{
+    // data sent after a file waits behind it
+    if (file_regions_.empty())
+    {
+        return &output_buffer_;
+    }
+    return &file_regions_.back().trailer;
 }
 
 void TcpConnection::Shutdown()
@@ -220,6 +457,16 @@ void TcpConnection::SetTcpNoDelay(bool on)
     socket_->SetTcpNoDelay(on);
 }
 
+void TcpConnection::SetEdgeTriggered(bool on)
+{
+    channel_->set_edge_triggered(on);
+}
+
+void TcpConnection::SetPriority(Channel::Priority priority)
+{
+    channel_->set_priority(priority);
+}
+
 void TcpConnection::ConnectEstablished()
 {
     loop_->AssertInLoopThread();
@@ -251,32 +498,88 @@ void TcpConnection::ConnectDestroyed()
         }
     }
 
+    if (idle_timer_.Valid())
+    {
+        loop_->Cancel(idle_timer_);
+        idle_timer_ = TimerId();
+    }
     channel_->Remove();
+
+    if (!zerocopy_pinned_.empty())
+    {
+        ReleaseZeroCopyBuffers();
+    }
+
+    if (!zerocopy_pinned_.empty())
+    {
+        // the dup keeps the socket open, so send FIN now rather than
+        // when the parking is done
+        socket_->ShutdownWrite();
+        auto parking = boost::make_shared<ZeroCopyParking>(::dup(socket_->fd()));
+        parking->pinned.swap(zerocopy_pinned_);
+        parking->next = zerocopy_next_;
+        zerocopy_pinned_bytes_ = 0;
+        UpdateBufferBytes();
+
+        loop_->RunAfter(kParkingCheckMs, boost::bind(&CheckParking, loop_, parking));
+    }
 }
 
 void TcpConnection::OnRead()
 {
-    auto n = socket_->Read(&input_buffer_, NULL);
-    if (n > 0)
+    if (!input_buffer_)
     {
-        received_bytes_ += static_cast<int>(n);
-        received_bytes_counter_.Add(static_cast<int>(n));
+        input_buffer_.reset(new Buffer());
+    }
+
+    // edge-triggered channel is not notified again until EAGAIN,
+    // so read on, but no more than the budget to be fair to others
+    auto edge = channel_->edge_triggered();
+    ssize_t n = 0;
+    size_t total = 0;
+    do
+    {
+        n = socket_->Read(input_buffer_.get(), NULL);
+        if (n > 0)
+        {
+            total += n;
+        }
+    } while (edge && n > 0 && total < static_cast<size_t>(FLAGS_connection_drain_budget));
+    auto saved_errno = errno;
+
+    if (total > 0)
+    {
+        received_bytes_ += static_cast<int>(total);
+        received_bytes_counter_.Add(static_cast<int>(total));
+        last_receive_time_ = Timestamp::Now();
         if (message_callback_)
         {
-            message_callback_(shared_from_this(), &input_buffer_);
+            message_callback_(shared_from_this(), input_buffer_.get());
         }
         else
         {
-            input_buffer_.ConsumeAll();
+            input_buffer_->ConsumeAll();
         }
+
+        ReclaimInputBuffer();
+        UpdateBufferBytes();
     }
-    else if (n == 0)
+
+    if (n == 0)
     {
         OnClose();
     }
-    else
+    else if (n < 0)
+    {
+        if (saved_errno != EAGAIN)
+        {
+            OnError();
+        }
+    }
+    else if (edge && state_ != kDisconnected)
     {
-        OnError();
+        // budget is used up, pick up the rest in next poll
+        channel_->Rearm();
     }
 }
 
@@ -284,27 +587,13 @@ void TcpConnection::OnWrite()
 {
     if (channel_->IsWriting())
     {
-        while (!output_buffers_.empty())
+        if (!FlushOutput())
         {
-            auto n = socket_->Write(&output_buffers_[0]);
-            if (n > 0)
-            {
-                sent_bytes_ += static_cast<int>(n);
-                sent_bytes_counter_.Add(static_cast<int>(n));
-                output_buffers_[0].Consume(n);
-                if (output_buffers_[0].ReadableBytes() == 0)
-                {
-                    output_buffers_.erase(output_buffers_.begin());
-                }
-                else
-                {
-                    LOG(TRACE) << "need write more data";
-                    break;
-                }
-            }
+            channel_->DisableWriting();
+            return ;
         }
 
-        if (output_buffers_.empty())
+        if (QueuedBytes() == 0)
         {
             channel_->DisableWriting();
             if (write_complete_callback_)
@@ -325,6 +614,252 @@ void TcpConnection::OnWrite()
     }
 }
 
+void TcpConnection::ReclaimInputBuffer()
+{
+    if (!input_buffer_)
+    {
+        return ;
+    }
+
+    // buffer grown by large message is released at once,
+    // normal one is kept until the connection is idle
+    if (input_buffer_->Capacity() > static_cast<size_t>(FLAGS_connection_buffer_shrink_bytes))
+    {
+        if (input_buffer_->ReadableBytes() == 0)
+        {
+            input_buffer_.reset();
+        }
+        else if (input_buffer_->ReadableBytes()*2 < static_cast<size_t>(FLAGS_connection_buffer_shrink_bytes))
+        {
+            input_buffer_->Shrink(0);
+        }
+        return ;
+    }
+
+    if (FLAGS_connection_buffer_idle_ms > 0 && !idle_timer_.Valid())
+    {
+        idle_timer_ = loop_->RunAfter(
+            FLAGS_connection_buffer_idle_ms,
+            boost::bind<void>(MakeWeakCallback(&TcpConnection::OnIdleTimer, shared_from_this())));
+    }
+}
+
+void TcpConnection::OnIdleTimer()
+{
+    idle_timer_ = TimerId();
+    if (!input_buffer_ || state_ == kDisconnected)
+    {
+        return ;
+    }
+
+    auto idle = TimeDifference(Timestamp::Now(), last_receive_time_)/1000;
+    if (idle >= FLAGS_connection_buffer_idle_ms && input_buffer_->ReadableBytes() == 0)
+    {
+        LOG(TRACE) << "release input buffer of idle connection " << id_;
+        input_buffer_.reset();
+        UpdateBufferBytes();
+        return ;
+    }
+
+    // not idle long enough, check again when it could be
+    auto delay = FLAGS_connection_buffer_idle_ms - idle;
+    idle_timer_ = loop_->RunAfter(
+        static_cast<int>(delay > 0 ? delay : FLAGS_connection_buffer_idle_ms),
+        boost::bind<void>(MakeWeakCallback(&TcpConnection::OnIdleTimer, shared_from_this())));
+}
+
+void TcpConnection::UpdateBufferBytes()
+{
+    auto bytes = output_buffer_.ReadableBytes() + zerocopy_pinned_bytes_;
+    if (input_buffer_)
+    {
+        bytes += input_buffer_->Capacity();
+    }
+
+    if (bytes != buffer_bytes_)
+    {
+        buffer_bytes_counter_.Add(static_cast<int>(bytes - buffer_bytes_));
+        buffer_bytes_ = bytes;
+    }
+
+    auto pending = output_buffer_.ReadableBytes();
+    if (pending != pending_bytes_)
+    {
+        loop_->load().pending_bytes += static_cast<int64_t>(pending) - static_cast<int64_t>(pending_bytes_);
+        pending_bytes_ = pending;
+    }
+}
+
+bool TcpConnection::FlushOutput()
+{
+    // edge-triggered channel writes until EAGAIN, see OnRead
+    auto edge = channel_->edge_triggered();
+    size_t total = 0;
+    for (;;)
+    {
+        if (edge && total >= static_cast<size_t>(FLAGS_connection_drain_budget))
+        {
+            channel_->Rearm();
+            break;
+        }
+
+        if (output_buffer_.ReadableBytes() > 0)
+        {
+            // one writev covers whole output unless it has more than IOV_MAX slices
+            auto whole = output_buffer_.SliceCount() <= IOV_MAX;
+            auto n = WriteOutput(&output_buffer_);
+            if (n < 0)
+            {
+                if (errno == EWOULDBLOCK || errno == EINTR)
+                {
+                    break;
+                }
+
+                PLOG(ERROR) << "TcpConnection::FlushOutput";
+                DropOutput();
+                return false;
+            }
+
+            total += n;
+            queued_bytes_ -= n;
+
+            // short write means socket send buffer is full, wait for next OnWrite
+            if (!edge && whole && output_buffer_.ReadableBytes() > 0)
+            {
+                break;
+            }
+            continue;
+        }
+
+        if (file_regions_.empty())
+        {
+            break;
+        }
+
+        auto& region = file_regions_.front();
+        if (region.length > 0)
+        {
+            auto n = socket_->SendFile(region.fd, &region.offset, region.length);
+            if (n < 0)
+            {
+                if (errno == EWOULDBLOCK || errno == EINTR)
+                {
+                    break;
+                }
+
+                PLOG(ERROR) << "TcpConnection::FlushOutput sendfile";
+                AbortOutput();
+                return false;
+            }
+
+            if (n == 0)
+            {
+                LOG(ERROR) << "file is shorter than the length to send";
+                AbortOutput();
+                return false;
+            }
+
+            sent_bytes_ += static_cast<int>(n);
+            sent_bytes_counter_.Add(static_cast<int>(n));
+            region.length -= n;
+            total += n;
+            queued_bytes_ -= n;
+            if (region.length > 0)
+            {
+                if (edge)
+                {
+                    continue;
+                }
+                break;
+            }
+        }
+
+        // file is done, data queued after it goes on
+        output_buffer_.swap(region.trailer);
+        file_regions_.pop_front();
+    }
+
+    UpdateBufferBytes();
+    return true;
+}
+
+ssize_t TcpConnection::WriteOutput(ChainBuffer* buffer)
+{
+    // copies once closing, so less is left pinned when destroyed
+    if (FLAGS_connection_zerocopy_threshold > 0
+        && buffer->ReadableBytes() >= static_cast<size_t>(FLAGS_connection_zerocopy_threshold)
+        && !zerocopy_disabled_
+        && state_ == kConnected)
+    {
+        if (!zerocopy_enabled_)
+        {
+            zerocopy_enabled_ = socket_->SetZeroCopy(true);
+            zerocopy_disabled_ = !zerocopy_enabled_;
+        }
+
+        if (zerocopy_enabled_)
+        {
+            auto n = socket_->WriteZeroCopy(buffer);
+            if (n > 0)
+            {
+                // the sent blocks are shared by the pinned chain, so they
+                // are never written again until the completion releases them
+                zerocopy_pinned_.push_back(buffer->Split(n));
+                zerocopy_pinned_bytes_ += n;
+                zerocopy_next_++;
+                zerocopy_bytes_counter_.Add(static_cast<int>(n));
+                sent_bytes_ += static_cast<int>(n);
+                sent_bytes_counter_.Add(static_cast<int>(n));
+            }
+
+            // out of optmem for pinned pages, copy this time
+            if (n >= 0 || errno != ENOBUFS)
+            {
+                return n;
+            }
+            Counter("claire.TcpConnection.ZeroCopyFallback").Increment();
+        }
+    }
+
+    auto n = socket_->Write(buffer);
+    if (n > 0)
+    {
+        buffer->Consume(n);
+        sent_bytes_ += static_cast<int>(n);
+        sent_bytes_counter_.Add(static_cast<int>(n));
+    }
+    return n;
+}
+
+void TcpConnection::ReleaseZeroCopyBuffers()
+{
+    zerocopy_pinned_bytes_ -= ReleaseCompleted(socket_.get(),
+                                               &zerocopy_pinned_,
+                                               zerocopy_next_,
+                                               &zerocopy_copied_counter_);
+    UpdateBufferBytes();
+}
+
+void TcpConnection::DropOutput()
+{
+    output_buffer_.ConsumeAll();
+    file_regions_.clear();
+    queued_bytes_ = 0;
+    UpdateBufferBytes();
+}
+
+void TcpConnection::AbortOutput()
+{
+    // peer was told the length of the file, e.g. by Content-Length,
+    // and would wait for the rest forever, so end the connection
+    DropOutput();
+    channel_->DisableWriting();
+
+    auto s = kConnected;
+    state_.compare_exchange_strong(s, kDisconnecting);
+    ShutdownInLoop();
+}
+
 void TcpConnection::OnClose()
 {
     LOG(TRACE) << "TcpConnection::OnClose " << peer_address_.ToString()
@@ -349,6 +884,12 @@ void TcpConnection::OnClose()
 
 void TcpConnection::OnError()
 {
+    // POLLERR is also raised by MSG_ZEROCOPY completions in error queue
+    if (!zerocopy_pinned_.empty())
+    {
+        ReleaseZeroCopyBuffers();
+    }
+
     LOG(TRACE) << "TcpConnection::OnError " << peer_address_.ToString()
                << " -> " << local_address_.ToString() << " id=" << id_
                << "] - SO_ERROR = " << strerror_tl(socket_->ErrorCode());
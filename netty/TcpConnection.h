@@ -5,6 +5,9 @@
 #ifndef _CLAIRE_NETTY_TCPCONNECTION_H_
 #define _CLAIRE_NETTY_TCPCONNECTION_H_
 
+#include <unistd.h>
+
+#include <deque>
 #include <string>
 
 #include <boost/any.hpp>
@@ -13,19 +16,22 @@
 #include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/ptr_container/ptr_deque.hpp>
 #include <boost/enable_shared_from_this.hpp>
-#include <boost/ptr_container/ptr_vector.hpp>
 
 #include <claire/netty/Buffer.h>
+#include <claire/netty/ChainBuffer.h>
 #include <claire/netty/Callbacks.h>
 #include <claire/netty/InetAddress.h>
+#include <claire/common/events/Channel.h>
+#include <claire/common/events/TimerId.h>
+#include <claire/common/time/Timestamp.h>
 #include <claire/common/strings/StringPiece.h>
 #include <claire/common/metrics/Counter.h>
 
 namespace claire {
 
 class Socket;
-class Channel;
 class EventLoop;
 
 /// TCP connection, for both client and server usage.
@@ -50,6 +56,15 @@ public:
 
     void SetTcpNoDelay(bool on);
 
+    /// Watches the socket edge-triggered, every wakeup reads and writes
+    /// until EAGAIN or --connection_drain_budget bytes.
+    /// Call before ConnectEstablished or in the loop thread.
+    void SetEdgeTriggered(bool on);
+
+    /// Control connections, like heartbeats and admin, may be set to
+    /// Channel::Priority::kHigh so they are handled first under load.
+    void SetPriority(Channel::Priority priority);
+
     void set_context(const boost::any& context__)
     {
         context_ = context__;
@@ -69,6 +84,9 @@ public:
         message_callback_ = callback;
     }
 
+    const ConnectionCallback& connection_callback() const { return connection_callback_; }
+    const MessageCallback& message_callback() const { return message_callback_; }
+
     void set_write_complete_callback(const WriteCompleteCallback& callback)
     {
         write_complete_callback_ = callback;
@@ -87,6 +105,15 @@ public:
     void Send(Buffer* buffer);
     void Send(const StringPiece& message);
 
+    /// Sends the chain without copying its blocks,
+    /// buffer is empty after return.
+    void Send(ChainBuffer* buffer);
+
+    /// Sends length bytes of file fd from offset by sendfile, in order
+    /// with data sent before and after. fd is duplicated, so caller
+    /// can close it after return.
+    void SendFile(int fd, off_t offset, size_t length);
+
     // NOT thread safe, no simultaneous calling
     void Shutdown();
 
@@ -94,6 +121,9 @@ public:
     void ConnectDestroyed();
 
     std::string GetTcpInfoString() const;
+
+    /// Bytes held by input, output and pinned buffers, in loop thread
+    size_t buffer_bytes() const { return buffer_bytes_; }
 private:
     enum States
     {
@@ -103,13 +133,50 @@ private:
         kConnected
     };
 
+    /// A file being sent, with the data sent after it
+    struct FileRegion : boost::noncopyable
+    {
+        FileRegion(int fd__, off_t offset__, size_t length__)
+            : fd(fd__),
+              offset(offset__),
+              length(length__)
+        {}
+
+        ~FileRegion()
+        {
+            ::close(fd);
+        }
+
+        int fd;
+        off_t offset;
+        size_t length;
+        ChainBuffer trailer;
+    };
+
+    // carries output moved from another thread to the loop, unlike
+    // boost::bind it is never copied on the way
+    template<typename B> struct SendTask;
+
     void OnRead();
     void OnWrite();
     void OnClose();
     void OnError();
 
     void SendInLoop(Buffer& buffer);
+    void SendInLoop(ChainBuffer& buffer);
     void SendInLoop(const void* data, size_t length);
+    void SendFileInLoop(int fd, off_t offset, size_t length);
+    void QueueOutput(size_t remaining);
+    size_t QueuedBytes() const { return queued_bytes_; }
+    ChainBuffer* OutputTail();
+    bool FlushOutput();
+    ssize_t WriteOutput(ChainBuffer* buffer);
+    void ReleaseZeroCopyBuffers();
+    void DropOutput();
+    void AbortOutput();
+    void ReclaimInputBuffer();
+    void OnIdleTimer();
+    void UpdateBufferBytes();
     void ShutdownInLoop();
     void set_state(States s) { state_ = s; }
 
@@ -130,16 +197,37 @@ private:
     HighWaterMarkCallback high_watermark_callback_;
     CloseCallback close_callback_;
 
-    Buffer input_buffer_;
-    boost::ptr_vector<Buffer> output_buffers_;
+    // allocated at first read, released when drained and idle
+    boost::scoped_ptr<Buffer> input_buffer_;
+    ChainBuffer output_buffer_;
+    boost::ptr_deque<FileRegion> file_regions_;
+    Timestamp last_receive_time_;
+    TimerId idle_timer_;
+
+    // buffers sent by MSG_ZEROCOPY, kept until the kernel completes them,
+    // the front one is numbered zerocopy_next_ - zerocopy_pinned_.size(),
+    // those left when destroyed are parked with a dup of the socket
+    std::deque<ChainBuffer> zerocopy_pinned_;
+    uint32_t zerocopy_next_;
+    bool zerocopy_enabled_;
+    bool zerocopy_disabled_;
 
     boost::any context_;
 
     int received_bytes_;
     int sent_bytes_;
 
+    // bytes held by input, output and pinned buffers, reported by buffer_bytes_counter_
+    size_t buffer_bytes_;
+    size_t pending_bytes_; // output reported to load of loop
+    size_t queued_bytes_; // output_buffer_ and file_regions_ with their trailers
+    size_t zerocopy_pinned_bytes_;
+
     Counter received_bytes_counter_;
     Counter sent_bytes_counter_;
+    Counter buffer_bytes_counter_;
+    Counter zerocopy_bytes_counter_;
+    Counter zerocopy_copied_counter_;
 };
 
 } // namespace claire
@@ -4,13 +4,19 @@
 
 #include <claire/netty/TcpServer.h>
 
+#include <map>
+
 #include <boost/bind.hpp>
+#include <boost/atomic.hpp>
 #include <boost/make_shared.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
 
 #include <claire/common/events/EventLoop.h>
 #include <claire/common/events/EventLoopThread.h>
 #include <claire/common/events/EventLoopThreadPool.h>
 #include <claire/common/base/WeakCallback.h>
+#include <claire/common/threading/Mutex.h>
+#include <claire/common/threading/CountDownLatch.h>
 #include <claire/common/logging/Logging.h>
 
 #include <claire/netty/Socket.h>
@@ -18,6 +24,11 @@
 #include <claire/netty/TcpConnection.h>
 
 DEFINE_int32(max_input_connections, 10000, "max input connections");
+DEFINE_bool(tcp_edge_triggered, false, "watch acceptor and connections of TcpServer edge-triggered");
+DEFINE_string(tcp_placement, "round_robin",
+              "placement of TcpServer connections on IO loops, round_robin, "
+              "least_connections, least_pending_bytes or least_busy_time");
+DEFINE_int32(tcp_busy_poll_us, 0, "SO_BUSY_POLL of TcpServer connections in microseconds, 0 leaves it unset");
 
 namespace claire {
 
@@ -30,15 +41,33 @@ public:
          const std::string& name__,
          const Option& option)
         : loop_(loop__),
+          listen_address_(listen_address),
           hostport_(listen_address.ToString()),
           name_(name__),
-          acceptor_(loop_, listen_address, option == kReusePort),
+          option_(option),
           thread_pool_(loop_),
           started_(false),
           next_id_(1)
     {
-        acceptor_.SetNewConnectionCallback(
-            boost::bind(&Impl::NewConnection, this, _1));
+        EventLoopThreadPool::Placement placement;
+        if (EventLoopThreadPool::ParsePlacement(FLAGS_tcp_placement, &placement))
+        {
+            thread_pool_.set_placement(placement);
+        }
+        else
+        {
+            LOG(ERROR) << "Unknown placement " << FLAGS_tcp_placement << ", use round_robin";
+        }
+
+        // sharded acceptors are created by Start, one for each IO loop
+        if (option_ != kShardedReusePort)
+        {
+            auto acceptor = new Acceptor(loop_, listen_address, option_ == kReusePort);
+            acceptors_.push_back(acceptor);
+            acceptor->set_edge_triggered(FLAGS_tcp_edge_triggered);
+            acceptor->SetNewConnectionCallback(
+                boost::bind(&Impl::NewConnection, this, _1));
+        }
     }
 
     ~Impl()
@@ -46,6 +75,17 @@ public:
         loop_->AssertInLoopThread();
         LOG(TRACE) << "TcpServer::~TcpServer [" << name_ << "] destructing";
 
+        // acceptor must be destroyed in its loop
+        CountDownLatch latch(static_cast<int>(acceptors_.size()));
+        while (!acceptors_.empty())
+        {
+            auto acceptor = acceptors_.pop_back().release();
+            acceptor->loop()->Run(
+                boost::bind(&Impl::DestroyAcceptor, acceptor, &latch));
+        }
+        latch.Wait();
+
+        MutexLock lock(mutex_);
         for (auto ite = connections_.begin(); ite != connections_.end(); ++ite)
         {
             auto connection = (*ite).second; // thread safe
@@ -60,6 +100,11 @@ public:
     const std::string& hostport() const { return hostport_; }
     const std::string& name() const { return name_; }
 
+    const InetAddress listen_address() const
+    {
+        return acceptors_.empty() ? listen_address_ : acceptors_.front().listen_address();
+    }
+
     void Start()
     {
         if (started_)
@@ -69,11 +114,29 @@ public:
         started_ = true;
 
         thread_pool_.Start(thread_init_callback_);
-        if (!acceptor_.listenning())
+        if (option_ == kShardedReusePort)
         {
-            loop_->Run(
-                boost::bind(&Impl::ListenInLoop, shared_from_this()));
+            // with port 0 every bind picks another port, so the rest
+            // shards bind the port picked for the first one
+            auto address = listen_address_;
+            auto loops = thread_pool_.GetAllLoops();
+            for (auto it = loops.begin(); it != loops.end(); ++it)
+            {
+                auto acceptor = new Acceptor(*it, address, true);
+                acceptors_.push_back(acceptor);
+                address = acceptor->listen_address();
+                acceptor->set_edge_triggered(FLAGS_tcp_edge_triggered);
+
+                // acceptor may outlive server until its loop destroys it
+                acceptor->SetNewConnectionCallback(
+                    MakeWeakCallback(&Impl::NewShardConnection, shared_from_this()));
+            }
+        }
 
+        for (auto it = acceptors_.begin(); it != acceptors_.end(); ++it)
+        {
+            (*it).loop()->Run(
+                boost::bind(&Impl::ListenInLoop, shared_from_this(), &(*it)));
         }
     }
 
@@ -82,6 +145,11 @@ public:
         thread_pool_.set_num_threads(num_threads);
     }
 
+    void set_placement(EventLoopThreadPool::Placement placement)
+    {
+        thread_pool_.set_placement(placement);
+    }
+
     void set_thread_init_callback(const ThreadInitCallback& callback)
     {
         thread_init_callback_ = callback;
@@ -105,35 +173,63 @@ public:
     EventLoop* loop() { return loop_; }
 
 private:
-    void ListenInLoop()
+    void ListenInLoop(Acceptor* acceptor)
     {
-        loop_->AssertInLoopThread();
-        acceptor_.Listen();
+        acceptor->loop()->AssertInLoopThread();
+        if (!acceptor->listenning())
+        {
+            acceptor->Listen();
+        }
+    }
+
+    static void DestroyAcceptor(Acceptor* acceptor, CountDownLatch* latch)
+    {
+        delete acceptor;
+        latch->CountDown();
     }
 
     void NewConnection(Socket& socket)
     {
         loop_->AssertInLoopThread();
+        EstablishConnection(thread_pool_.NextLoop(), socket);
+    }
+
+    void NewShardConnection(Socket& socket)
+    {
+        // connection stays on the loop accepting it
+        EstablishConnection(EventLoop::CurrentLoopInThisThread(), socket);
+    }
 
-        if (s_total_connections_ >= FLAGS_max_input_connections)
+    void EstablishConnection(EventLoop* io_loop, Socket& socket)
+    {
+        if (s_total_connections_.fetch_add(1) >= FLAGS_max_input_connections)
         {
+            s_total_connections_--;
             LOG(WARNING) << "current connection reach max " << FLAGS_max_input_connections
                          << ", Shutdown from " << socket.peer_address().ToString();
             socket.ShutdownWrite();
             return ;
         }
-        s_total_connections_++;
 
-        EventLoop *io_loop = thread_pool_.NextLoop();
+        if (FLAGS_tcp_busy_poll_us > 0 && !socket.SetBusyPoll(FLAGS_tcp_busy_poll_us))
+        {
+            LOG_FIRST_N(WARNING, 1) << "SO_BUSY_POLL " << FLAGS_tcp_busy_poll_us
+                                    << " failed, needs CAP_NET_ADMIN above net.core.busy_read";
+        }
+
         TcpConnectionPtr connection(
             boost::make_shared<TcpConnection>(io_loop,
                                               std::move(socket),
                                               next_id_++));
-        connections_[connection->id()] = connection; // thread safe
+        {
+            MutexLock lock(mutex_);
+            connections_[connection->id()] = connection;
+        }
 
         connection->set_connection_callback(connection_callback_);
         connection->set_message_callback(message_callback_);
         connection->set_write_complete_callback(write_complete_callback_);
+        connection->SetEdgeTriggered(FLAGS_tcp_edge_triggered);
 
         auto callback = MakeWeakCallback(&Impl::RemoveConnection, shared_from_this());
         connection->set_close_callback(callback);
@@ -144,36 +240,31 @@ private:
 
     void RemoveConnection(const TcpConnectionPtr &connection)
     {
-        auto callback = WeakCallback<Impl>(
-            boost::bind(&Impl::RemoveConnectionInLoop, _1, connection->id()),
-            shared_from_this());
-        loop_->Run(callback);
-    }
-
-    void RemoveConnectionInLoop(TcpConnection::Id connection_id)
-    {
-        loop_->AssertInLoopThread();
+        LOG(INFO) << "TcpServer::RemoveConnection [" << name_
+              << "] - connection " << connection->id();
 
-        LOG(INFO) << "TcpServer::RemoveConnectionInLoop [" << name_
-              << "] - connection " << connection_id;
-
-        auto it = connections_.find(connection_id);
-        if (connections_.find(connection_id) != connections_.end())
         {
-            it->second->loop()->Post(
-                boost::bind(&TcpConnection::ConnectDestroyed, it->second)); // thread safe
-            connections_.erase(it);
+            MutexLock lock(mutex_);
+            if (connections_.erase(connection->id()) == 0)
+            {
+                return ;
+            }
         }
+
+        connection->loop()->Post(
+            boost::bind(&TcpConnection::ConnectDestroyed, connection)); // thread safe
         s_total_connections_--;
     }
 
     typedef std::map<TcpConnection::Id, TcpConnectionPtr> ConnectionMap;
 
     EventLoop* loop_;
+    const InetAddress listen_address_;
     const std::string hostport_;
     const std::string name_;
+    const Option option_;
 
-    Acceptor acceptor_;
+    boost::ptr_vector<Acceptor> acceptors_;
     EventLoopThreadPool thread_pool_;
 
     ConnectionCallback connection_callback_;
@@ -182,13 +273,16 @@ private:
     ThreadInitCallback thread_init_callback_;
 
     bool started_;
-    TcpConnection::Id next_id_;
-    ConnectionMap connections_;
+    boost::atomic<TcpConnection::Id> next_id_;
+
+    // connections are added and removed by IO loops in sharded mode
+    Mutex mutex_;
+    ConnectionMap connections_; // @GUARDBY mutex_
 
-    static int32_t s_total_connections_;
+    static boost::atomic<int32_t> s_total_connections_;
 };
 
-int32_t TcpServer::Impl::s_total_connections_ = 0;
+boost::atomic<int32_t> TcpServer::Impl::s_total_connections_(0);
 
 TcpServer::TcpServer(EventLoop* loop__,
                      const InetAddress& listen_address,
@@ -218,6 +312,16 @@ const std::string& TcpServer::name() const
     return impl_->name();
 }
 
+const InetAddress TcpServer::listen_address() const
+{
+    return impl_->listen_address();
+}
+
+void TcpServer::set_placement(EventLoopThreadPool::Placement placement)
+{
+    impl_->set_placement(placement);
+}
+
 void TcpServer::set_thread_init_callback(const ThreadInitCallback& callback)
 {
     impl_->set_thread_init_callback(callback);
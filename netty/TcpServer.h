@@ -11,6 +11,7 @@
 #include <boost/noncopyable.hpp>
 
 #include <claire/netty/Callbacks.h>
+#include <claire/common/events/EventLoopThreadPool.h>
 
 namespace claire {
 
@@ -23,7 +24,12 @@ public:
     enum Option
     {
         kNoReusePort,
-        kReusePort
+        kReusePort,
+
+        /// Every IO loop listens on its own SO_REUSEPORT socket, kernel
+        /// spreads incoming connections over them, and the connections
+        /// stay on the loop accepting them.
+        kShardedReusePort
     };
 
     TcpServer(EventLoop* loop__,
@@ -39,6 +45,11 @@ public:
     const std::string& hostport() const;
     const std::string& name() const;
 
+    /// Address listened on, with the port picked by kernel if it was 0.
+    /// Acceptors of kShardedReusePort are created by @c Start, before it
+    /// the address given is returned.
+    const InetAddress listen_address() const;
+
     /// Starts the server if it's not listenning.
     ///
     /// It's harmless to call it multiple times.
@@ -47,7 +58,7 @@ public:
 
     /// Set the number of threads for handling input.
     ///
-    /// Always accepts new connection in loop's thread.
+    /// Accepts new connection in loop's thread, unless kShardedReusePort.
     /// Must be called before @c Start
     /// @param num_threads
     /// - 0 means all I/O in loop's thread, no thread will created.
@@ -58,6 +69,11 @@ public:
     /// Please only set before @c Start!
     void set_num_threads(int num_threads);
 
+    /// How new connections are placed on the threads, default is
+    /// --tcp_placement. Not used by kShardedReusePort.
+    /// Please only set before @c Start!
+    void set_placement(EventLoopThreadPool::Placement placement);
+
     /// ThreadInitCallback to threadpool
     /// Not thread safe
     void set_thread_init_callback(const ThreadInitCallback& callback);
@@ -0,0 +1,83 @@
+// Copyright (c) 2013 The claire-netty Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <claire/netty/http/FileCache.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <claire/common/logging/Logging.h>
+
+namespace claire {
+
+FileCache::File::~File()
+{
+    ::close(fd_);
+}
+
+FileCache::FilePtr FileCache::Open(const std::string& filename)
+{
+    struct stat st;
+    if (::stat(filename.c_str(), &st) < 0 || !S_ISREG(st.st_mode))
+    {
+        return FilePtr();
+    }
+
+    {
+        MutexLock lock(mutex_);
+        auto it = files_.find(filename);
+        if (it != files_.end())
+        {
+            const auto& file = it->second.first;
+            if (file->inode() == st.st_ino
+                && file->mtime() == st.st_mtime
+                && file->size() == st.st_size)
+            {
+                lru_.splice(lru_.begin(), lru_, it->second.second);
+                hit_counter_.Increment();
+                return file;
+            }
+
+            lru_.erase(it->second.second);
+            files_.erase(it);
+        }
+    }
+
+    miss_counter_.Increment();
+
+    auto fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        PLOG(ERROR) << "open " << filename << " failed";
+        return FilePtr();
+    }
+
+    // stat again by fd, file may be replaced after the first stat
+    if (::fstat(fd, &st) < 0)
+    {
+        PLOG(ERROR) << "fstat " << filename << " failed";
+        ::close(fd);
+        return FilePtr();
+    }
+
+    FilePtr file(new File(fd, st.st_size, st.st_mtime, st.st_ino));
+
+    MutexLock lock(mutex_);
+    if (files_.find(filename) == files_.end())
+    {
+        lru_.push_front(filename);
+        files_.insert(std::make_pair(filename, std::make_pair(file, lru_.begin())));
+
+        while (files_.size() > capacity_)
+        {
+            files_.erase(lru_.back());
+            lru_.pop_back();
+        }
+    }
+
+    return file;
+}
+
+} // namespace claire
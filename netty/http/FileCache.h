@@ -0,0 +1,82 @@
+// Copyright (c) 2013 The claire-netty Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef _CLAIRE_NETTY_HTTP_FILECACHE_H_
+#define _CLAIRE_NETTY_HTTP_FILECACHE_H_
+
+#include <sys/types.h>
+
+#include <map>
+#include <list>
+#include <string>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <claire/common/threading/Mutex.h>
+#include <claire/common/metrics/Counter.h>
+
+namespace claire {
+
+/// A LRU cache of opened files, used to serve static files by sendfile
+/// without opening them for every request.
+///
+/// A cached file is checked by stat() on every lookup, and is reopened
+/// when it has been replaced or modified. Thread safe.
+class FileCache : boost::noncopyable
+{
+public:
+    class File : boost::noncopyable
+    {
+    public:
+        File(int fd__, off_t size__, time_t mtime__, ino_t inode__)
+            : fd_(fd__),
+              size_(size__),
+              mtime_(mtime__),
+              inode_(inode__)
+        {}
+
+        ~File();
+
+        int fd() const { return fd_; }
+        off_t size() const { return size_; }
+        time_t mtime() const { return mtime_; }
+        ino_t inode() const { return inode_; }
+
+    private:
+        const int fd_;
+        const off_t size_;
+        const time_t mtime_;
+        const ino_t inode_;
+    };
+    typedef boost::shared_ptr<File> FilePtr;
+
+    explicit FileCache(size_t capacity)
+        : capacity_(capacity),
+          hit_counter_("claire.FileCache.hit"),
+          miss_counter_("claire.FileCache.miss")
+    {}
+
+    /// Returns the opened regular file, or empty pointer if it can not
+    /// be opened. The fd keeps valid as long as the pointer is held,
+    /// even if the file is evicted.
+    FilePtr Open(const std::string& filename);
+
+private:
+    typedef std::list<std::string> LruList;
+    typedef std::map<std::string, std::pair<FilePtr, LruList::iterator> > FileMap;
+
+    const size_t capacity_;
+
+    Mutex mutex_;
+    FileMap files_; // @GUARDBY mutex_
+    LruList lru_; // @GUARDBY mutex_, most recently used at front
+
+    Counter hit_counter_;
+    Counter miss_counter_;
+};
+
+} // namespace claire
+
+#endif // _CLAIRE_NETTY_HTTP_FILECACHE_H_
@@ -49,6 +49,14 @@ public:
         }
     }
 
+    void Send(ChainBuffer* buffer)
+    {
+        if (connection_)
+        {
+            connection_->Send(buffer);
+        }
+    }
+
     bool connected() const
     {
         if (connection_)
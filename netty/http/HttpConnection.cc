@@ -26,6 +26,11 @@ void HttpConnection::Send(Buffer* buffer)
     connection_->Send(buffer);
 }
 
+void HttpConnection::Send(ChainBuffer* buffer)
+{
+    connection_->Send(buffer);
+}
+
 void HttpConnection::Send(const StringPiece& data)
 {
     connection_->Send(data);
@@ -58,6 +63,43 @@ void HttpConnection::Send(HttpRequest* request)
 }
 
 void HttpConnection::Send(HttpResponse* response)
+{
+    PrepareResponse(response, response->mutable_body()->length());
+
+    Buffer buffer;
+    response->AppendTo(&buffer);
+    connection_->Send(&buffer);
+
+    FinishResponse(response);
+}
+
+void HttpConnection::Send(HttpResponse* response, const StringPiece& body)
+{
+    DCHECK(response->mutable_body()->empty());
+    PrepareResponse(response, body.size());
+
+    Buffer buffer;
+    response->AppendTo(&buffer);
+    connection_->Send(&buffer);
+    connection_->Send(body);
+
+    FinishResponse(response);
+}
+
+void HttpConnection::SendFile(HttpResponse* response, int fd, off_t offset, size_t length)
+{
+    DCHECK(response->mutable_body()->empty());
+    PrepareResponse(response, length);
+
+    Buffer buffer;
+    response->AppendTo(&buffer);
+    connection_->Send(&buffer);
+    connection_->SendFile(fd, offset, length);
+
+    FinishResponse(response);
+}
+
+void HttpConnection::PrepareResponse(HttpResponse* response, size_t content_length)
 {
     if (response->version() == HttpMessage::kUnknown)
     {
@@ -77,18 +119,17 @@ void HttpConnection::Send(HttpResponse* response)
     if (!response->HasHeader("Transfer-Encoding")
         && !response->HasHeader("Content-Length"))
     {
-        response->AddHeader("Content-Length", boost::lexical_cast<std::string>(response->mutable_body()->length()));
+        response->AddHeader("Content-Length", boost::lexical_cast<std::string>(content_length));
     }
 
     if (message_->IsKeepAlive() && message_->version() == HttpMessage::kHttp10)
     {
         response->AddHeader("Connection", "Keep-Alive");
     }
+}
 
-    Buffer buffer;
-    response->AppendTo(&buffer);
-    connection_->Send(&buffer);
-
+void HttpConnection::FinishResponse(HttpResponse* response)
+{
     if (!message_->IsKeepAlive() && !response->IsKeepAlive())
     {
         Shutdown();
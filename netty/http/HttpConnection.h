@@ -20,6 +20,7 @@
 namespace claire {
 
 class Buffer;
+class ChainBuffer;
 
 class HttpConnection;
 typedef boost::shared_ptr<HttpConnection> HttpConnectionPtr;
@@ -59,8 +60,16 @@ public:
     bool Parse(Buffer* buffer);
 
     void Send(Buffer* buffer);
+    void Send(ChainBuffer* buffer);
     void Send(HttpRequest* request);
     void Send(HttpResponse* response);
+
+    /// Sends response with body, body is not copied into response
+    void Send(HttpResponse* response, const StringPiece& body);
+
+    /// Sends response with length bytes of file fd from offset as body,
+    /// fd can be closed after return.
+    void SendFile(HttpResponse* response, int fd, off_t offset, size_t length);
     void Send(const StringPiece& data);
 
     void set_headers_callback(const HeadersCallback& callback)
@@ -129,6 +138,8 @@ public:
 
 private:
     bool ParseMessage(Buffer* buf);
+    void PrepareResponse(HttpResponse* response, size_t content_length);
+    void FinishResponse(HttpResponse* response);
 
     const TcpConnectionPtr connection_;
     boost::shared_ptr<HttpMessage> message_;
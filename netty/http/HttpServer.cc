@@ -7,6 +7,9 @@
 #include <boost/bind.hpp>
 #include <boost/make_shared.hpp>
 
+#include "thirdparty/gflags/gflags.h"
+
+#include <claire/netty/http/FileCache.h>
 #include <claire/netty/http/HttpRequest.h>
 #include <claire/netty/http/HttpResponse.h>
 #include <claire/netty/http/MimeType.h>
@@ -15,6 +18,8 @@
 
 #include <claire/netty/static_resource.h>
 
+DEFINE_int32(http_file_cache_size, 1024, "max opened files cached for serving static files");
+
 namespace claire {
 
 namespace {
@@ -135,12 +140,26 @@ const char kFaviconArray[] = {
 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
 };
 
+// prefix "/dumps" matches "/dumps" and "/dumps/a", but not "/dumpsfoo"
+bool MatchPrefix(const std::string& path, const std::string& prefix)
+{
+    if (path.compare(0, prefix.size(), prefix) != 0)
+    {
+        return false;
+    }
+
+    return path.size() == prefix.size()
+        || (!prefix.empty() && prefix[prefix.size()-1] == '/')
+        || path[prefix.size()] == '/';
+}
+
 } // namespace
 
 HttpServer::HttpServer(EventLoop* loop__,
                        const InetAddress& listen_address,
                        const std::string& name)
-    : server_(loop__, listen_address, name)
+    : server_(loop__, listen_address, name),
+      file_cache_(new FileCache(FLAGS_http_file_cache_size))
 {
     server_.set_connection_callback(
         boost::bind(&HttpServer::OnConnection, this, _1));
@@ -159,6 +178,8 @@ HttpServer::HttpServer(EventLoop* loop__,
                   RESOURCE_claire_netty_http_assets_bootstrap_css_bootstrap_2_2_1_combined_min_css);
 }
 
+HttpServer::~HttpServer() {}
+
 void HttpServer::Start()
 {
     if (assets_.find("/favicon.ico") == assets_.end())
@@ -264,8 +285,28 @@ void HttpServer::OnMessage(const TcpConnectionPtr& connection, Buffer* buffer)
         }
         else
         {
-            LOG(ERROR) << "can not find path " << context->mutable_request()->uri().path() << " handler";
-            context->Shutdown();
+            const auto& path = context->mutable_request()->uri().path();
+
+            // the longest registered prefix wins
+            auto directoryI = directories_.end();
+            for (auto it = directories_.begin(); it != directories_.end(); ++it)
+            {
+                if (MatchPrefix(path, it->first)
+                    && (directoryI == directories_.end() || it->first.size() > directoryI->first.size()))
+                {
+                    directoryI = it;
+                }
+            }
+
+            if (directoryI != directories_.end())
+            {
+                OnFile(context, directoryI->first, directoryI->second);
+            }
+            else
+            {
+                LOG(ERROR) << "can not find path " << path << " handler";
+                context->Shutdown();
+            }
         }
     }
 
@@ -297,8 +338,40 @@ void HttpServer::OnAsset(const HttpConnectionPtr& connection)
     response.AddHeader("Content-Type",
                        MimeType::ExtensionToMimeType(path.substr(pos + 1, path.size())).get_subtype());
     response.AddHeader("Cache-Control", "max-age=60");
-    response.mutable_body()->append(it->second.data(), it->second.size());
-    connection->Send(&response);
+    connection->Send(&response, it->second);
+}
+
+void HttpServer::RegisterDirectory(const std::string& prefix, const std::string& directory)
+{
+    directories_[prefix] = directory;
+}
+
+void HttpServer::OnFile(const HttpConnectionPtr& connection,
+                        const std::string& prefix,
+                        const std::string& directory)
+{
+    auto name = connection->mutable_request()->uri().path().substr(prefix.size());
+    if (name.empty() || name.find("..") != std::string::npos)
+    {
+        connection->OnError(HttpResponse::k403Forbidden, "Forbidden");
+        return ;
+    }
+
+    auto file = file_cache_->Open(directory + "/" + name);
+    if (!file)
+    {
+        connection->OnError(HttpResponse::k404NotFound, "Not Found");
+        return ;
+    }
+
+    HttpResponse response;
+    response.set_status(HttpResponse::k200OK);
+
+    auto pos = name.rfind(".");
+    auto mime = (pos == std::string::npos) ? MimeType() : MimeType::ExtensionToMimeType(name.substr(pos + 1));
+    response.AddHeader("Content-Type",
+                       mime.empty() ? "application/octet-stream" : mime.ToString());
+    connection->SendFile(&response, file->fd(), 0, file->size());
 }
 
 void HttpServer::OnIndexPage(const HttpConnectionPtr& connection)
@@ -10,6 +10,7 @@
 #include <algorithm>
 
 #include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/noncopyable.hpp>
 
 #include <claire/common/threading/Mutex.h>
@@ -18,6 +19,8 @@
 
 namespace claire {
 
+class FileCache;
+
 class HttpServer : boost::noncopyable
 {
 public:
@@ -28,6 +31,7 @@ public:
     HttpServer(EventLoop* loop,
                const InetAddress& listen_address,
                const std::string& name);
+    ~HttpServer();
 
     /// Callback be registered before calling start().
     /// Not thread safe
@@ -66,6 +70,13 @@ public:
 
     void RegisterAsset(const std::string& path, const char* data, size_t length);
 
+    /// Serves files under directory for paths under prefix,
+    /// e.g. with prefix "/dumps/" and directory "/data/dumps",
+    /// "/dumps/a.bin" is served from "/data/dumps/a.bin" by sendfile.
+    /// Prefix matches whole path segments, "/dumps" does not match "/dumpsfoo".
+    /// Not thread safe, should be called before Start().
+    void RegisterDirectory(const std::string& prefix, const std::string& directory);
+
     void set_num_threads(int num_threads)
     {
         server_.set_num_threads(num_threads);
@@ -112,11 +123,17 @@ public:
 
     EventLoop* loop() { return server_.loop(); }
 
+    /// with the port picked if listening on port 0
+    const InetAddress listen_address() const { return server_.listen_address(); }
+
 private:
     void OnConnection(const TcpConnectionPtr& connection);
     void OnMessage(const TcpConnectionPtr& connection, Buffer* buffer);
 
     void OnAsset(const HttpConnectionPtr& connection);
+    void OnFile(const HttpConnectionPtr& connection,
+                const std::string& prefix,
+                const std::string& directory);
     void OnIndexPage(const HttpConnectionPtr& connection);
 
     TcpServer server_;
@@ -127,6 +144,8 @@ private:
     mutable Mutex mutex_;
     std::map<HttpConnection::Id, HttpConnectionPtr> connections_;
     std::map<std::string, StringPiece> assets_;
+    std::map<std::string, std::string> directories_;
+    boost::scoped_ptr<FileCache> file_cache_;
 
     std::set<std::string> show_paths_;
 };
@@ -79,7 +79,9 @@ void StatisticsInspector::OnHistograms(const HttpConnectionPtr& connection)
 {
     HttpResponse response;
     response.set_status(HttpResponse::k200OK);
-    HistogramRecorder::instance()->WriteHTMLGraph("", response.mutable_body());
+    // e.g. /histograms?query=claire.EventLoop shows histograms of loops
+    auto query = connection->mutable_request()->uri().get_parameter("query");
+    HistogramRecorder::instance()->WriteHTMLGraph(query, response.mutable_body());
     response.AddHeader("Content-Type", "text/html");
     connection->Send(&response);
 }
@@ -0,0 +1,74 @@
+// Copyright (c) 2013 The claire-netty Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <claire/netty/inspect/ThreadPoolsInspector.h>
+
+#include <stdio.h>
+
+#include <boost/bind.hpp>
+
+#include <claire/netty/http/HttpServer.h>
+#include <claire/netty/http/HttpRequest.h>
+#include <claire/netty/http/HttpResponse.h>
+#include <claire/netty/http/HttpConnection.h>
+
+#include <claire/common/threading/ThreadPool.h>
+
+namespace claire {
+
+ThreadPoolsInspector::ThreadPoolsInspector(HttpServer* server)
+{
+    if (!server)
+    {
+        return ;
+    }
+
+    server->Register("/threadpools",
+                     boost::bind(&ThreadPoolsInspector::OnThreadPools, _1),
+                     false);
+}
+
+void ThreadPoolsInspector::OnThreadPools(const HttpConnectionPtr& connection)
+{
+    if (connection->mutable_request()->method() != HttpRequest::kGet)
+    {
+        connection->OnError(HttpResponse::k400BadRequest,
+                            "Only accept Get method");
+        return ;
+    }
+
+    HttpResponse response;
+    auto body = response.mutable_body();
+    body->append("name\tthreads\tmin\tmax\tactive\tqueued\tmax_queue\tcompleted\trejected\texpired\t"
+                 "avg_queue_us\tavg_run_us\tgrown\tretired\n");
+
+    auto all_stats = ThreadPool::GetAllStats();
+    for (auto it = all_stats.begin(); it != all_stats.end(); ++it)
+    {
+        // expired tasks are taken and timed too
+        auto taken = (*it).completed + (*it).expired;
+        char buf[256];
+        snprintf(buf, sizeof buf, "\t%d\t%d\t%d\t%d\t%zu\t%zu\t%ld\t%ld\t%ld\t%ld\t%ld\t%ld\t%ld\n",
+                 (*it).num_threads,
+                 (*it).min_threads,
+                 (*it).max_threads,
+                 (*it).active_threads,
+                 (*it).queue_size,
+                 (*it).max_queue_size,
+                 (*it).completed,
+                 (*it).rejected,
+                 (*it).expired,
+                 taken > 0 ? (*it).queue_time / taken : 0,
+                 taken > 0 ? (*it).run_time / taken : 0,
+                 (*it).grown,
+                 (*it).retired);
+        body->append((*it).name);
+        body->append(buf);
+    }
+
+    response.AddHeader("Content-Type", "text/plain");
+    connection->Send(&response);
+}
+
+} // namespace claire
@@ -0,0 +1,27 @@
+// Copyright (c) 2013 The claire-netty Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#pragma once
+
+#include <boost/shared_ptr.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace claire {
+
+class HttpServer;
+class HttpConnection;
+typedef boost::shared_ptr<HttpConnection> HttpConnectionPtr;
+
+/// Lists ThreadPools with their saturation, and where time of their
+/// tasks goes, waiting in queue or running
+class ThreadPoolsInspector : boost::noncopyable
+{
+public:
+    explicit ThreadPoolsInspector(HttpServer* server);
+
+private:
+    static void OnThreadPools(const HttpConnectionPtr& connection);
+};
+
+} // namespace claire
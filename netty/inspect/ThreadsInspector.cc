@@ -0,0 +1,114 @@
+// Copyright (c) 2013 The claire-netty Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <claire/netty/inspect/ThreadsInspector.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <boost/bind.hpp>
+
+#include <claire/netty/http/HttpServer.h>
+#include <claire/netty/http/HttpRequest.h>
+#include <claire/netty/http/HttpResponse.h>
+#include <claire/netty/http/HttpConnection.h>
+
+#include <claire/common/threading/CpuAffinity.h>
+
+namespace claire {
+
+namespace {
+
+// field 39 of /proc/self/task/<tid>/stat, -1 if thread exited
+int LastCpuOf(pid_t tid)
+{
+    char path[64];
+    snprintf(path, sizeof path, "/proc/self/task/%d/stat", tid);
+
+    auto fp = ::fopen(path, "r");
+    if (!fp)
+    {
+        return -1;
+    }
+
+    char buf[1024];
+    auto n = ::fread(buf, 1, sizeof(buf)-1, fp);
+    ::fclose(fp);
+    buf[n] = '\0';
+
+    // comm may contain spaces, fields after it start from state
+    auto p = strrchr(buf, ')');
+    if (!p)
+    {
+        return -1;
+    }
+
+    int field = 2;
+    while (*p && field < 39)
+    {
+        if (*p++ == ' ')
+        {
+            field++;
+        }
+    }
+    return field == 39 ? atoi(p) : -1;
+}
+
+} // namespace
+
+ThreadsInspector::ThreadsInspector(HttpServer* server)
+{
+    if (!server)
+    {
+        return ;
+    }
+
+    server->Register("/threads",
+                     boost::bind(&ThreadsInspector::OnThreads, _1),
+                     false);
+}
+
+void ThreadsInspector::OnThreads(const HttpConnectionPtr& connection)
+{
+    if (connection->mutable_request()->method() != HttpRequest::kGet)
+    {
+        connection->OnError(HttpResponse::k400BadRequest,
+                            "Only accept Get method");
+        return ;
+    }
+
+    HttpResponse response;
+    auto body = response.mutable_body();
+    body->append("tid\tname\tcpus\tnode\tlast_cpu\n");
+
+    auto mappings = CpuAffinity::GetMappings();
+    for (auto it = mappings.begin(); it != mappings.end(); ++it)
+    {
+        auto last_cpu = LastCpuOf((*it).tid);
+
+        char buf[64];
+        snprintf(buf, sizeof buf, "%d\t", (*it).tid);
+        body->append(buf);
+        body->append((*it).name.empty() ? "-" : (*it).name);
+        body->append("\t");
+        body->append(CpuAffinity::FormatCpuList((*it).cpus));
+        snprintf(buf, sizeof buf, "\t%d\t", CpuAffinity::NodeOf((*it).cpus.front()));
+        body->append(buf);
+        if (last_cpu < 0)
+        {
+            body->append("exited\n");
+        }
+        else
+        {
+            snprintf(buf, sizeof buf, "%d\n", last_cpu);
+            body->append(buf);
+        }
+    }
+
+    response.AddHeader("Content-Type", "text/plain");
+    connection->Send(&response);
+}
+
+} // namespace claire
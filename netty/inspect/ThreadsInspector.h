@@ -0,0 +1,26 @@
+// Copyright (c) 2013 The claire-netty Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#pragma once
+
+#include <boost/shared_ptr.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace claire {
+
+class HttpServer;
+class HttpConnection;
+typedef boost::shared_ptr<HttpConnection> HttpConnectionPtr;
+
+/// Lists threads pinned by CpuAffinity, with the cpu each one last ran on
+class ThreadsInspector : boost::noncopyable
+{
+public:
+    explicit ThreadsInspector(HttpServer* server);
+
+private:
+    static void OnThreads(const HttpConnectionPtr& connection);
+};
+
+} // namespace claire
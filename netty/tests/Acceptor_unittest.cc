@@ -0,0 +1,195 @@
+#include <claire/netty/Acceptor.h>
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include <gtest/gtest.h>
+
+#include <claire/netty/Socket.h>
+#include <claire/netty/InetAddress.h>
+#include <claire/common/events/EventLoop.h>
+#include <claire/common/metrics/CounterProvider.h>
+
+using namespace claire;
+
+namespace {
+
+const int kClients = 10;
+
+void OnConnection(boost::ptr_vector<Socket>* sockets, Socket& socket)
+{
+    sockets->push_back(new Socket(std::move(socket)));
+}
+
+int CounterValue(const char* name)
+{
+    return CounterProvider::instance()->GetCounterValue(name);
+}
+
+uint16_t FreePort()
+{
+    auto fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    ::memset(&address, 0, sizeof address);
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ::bind(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof address);
+
+    socklen_t length = sizeof address;
+    ::getsockname(fd, reinterpret_cast<struct sockaddr*>(&address), &length);
+    ::close(fd);
+    return ntohs(address.sin_port);
+}
+
+// the kernel completes handshake for listen queue, so it returns at once
+int Connect(const struct sockaddr_in& address)
+{
+    auto fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    ::connect(fd, reinterpret_cast<const struct sockaddr*>(&address), sizeof address);
+    return fd;
+}
+
+// true if the connection is closed by peer, without blocking
+bool ClosedByPeer(int fd)
+{
+    char byte;
+    auto n = ::recv(fd, &byte, 1, MSG_DONTWAIT);
+    return n == 0 || (n < 0 && errno == ECONNRESET);
+}
+
+} // namespace
+
+TEST(AcceptorTest, ShedOnFdExhaustion)
+{
+    auto port = FreePort();
+    EventLoop loop;
+
+    boost::ptr_vector<Socket> accepted;
+    Acceptor acceptor(&loop, InetAddress("127.0.0.1", port));
+    acceptor.SetNewConnectionCallback(boost::bind(&OnConnection, &accepted, _1));
+    acceptor.Listen();
+
+    struct sockaddr_in address;
+    ::memset(&address, 0, sizeof address);
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    std::vector<int> clients;
+    for (int i = 0; i < kClients; i++)
+    {
+        clients.push_back(Connect(address));
+    }
+
+    // room for 2 more fds only, the rest of queue overloads the acceptor
+    struct rlimit saved;
+    ::getrlimit(RLIMIT_NOFILE, &saved);
+    struct rlimit limit = saved;
+    limit.rlim_cur = *std::max_element(clients.begin(), clients.end()) + 3;
+    ::setrlimit(RLIMIT_NOFILE, &limit);
+
+    auto overload = CounterValue("claire.Acceptor.overload");
+    auto before = CounterValue("claire.Acceptor.accepted");
+    loop.RunAfter(200, boost::bind(&EventLoop::quit, &loop));
+    loop.loop();
+    ::setrlimit(RLIMIT_NOFILE, &saved);
+
+    // shed connections are closed instead of left in the queue
+    int shed = 0;
+    for (auto it = clients.begin(); it != clients.end(); ++it)
+    {
+        if (ClosedByPeer(*it))
+        {
+            shed++;
+        }
+        ::close(*it);
+    }
+
+    EXPECT_LT(0u, accepted.size());
+    EXPECT_LT(0, shed);
+    EXPECT_EQ(kClients, static_cast<int>(accepted.size()) + shed);
+    EXPECT_EQ(shed, CounterValue("claire.Acceptor.overload") - overload);
+    EXPECT_EQ(static_cast<int>(accepted.size()), CounterValue("claire.Acceptor.accepted") - before);
+}
+
+TEST(AcceptorTest, ReserveFdAgainAfterFailure)
+{
+    auto port = FreePort();
+    EventLoop loop;
+
+    std::vector<int> clients;
+    for (int i = 0; i < kClients; i++)
+    {
+        clients.push_back(::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0));
+    }
+
+    // use up all fds but the one of listen socket, so no fd is reserved
+    struct rlimit saved;
+    ::getrlimit(RLIMIT_NOFILE, &saved);
+    struct rlimit limit = saved;
+    limit.rlim_cur = *std::max_element(clients.begin(), clients.end()) + 64;
+    ::setrlimit(RLIMIT_NOFILE, &limit);
+
+    std::vector<int> fillers;
+    int fd;
+    while ((fd = ::dup(0)) >= 0)
+    {
+        fillers.push_back(fd);
+    }
+    ::close(fillers.back());
+    fillers.pop_back();
+
+    boost::ptr_vector<Socket> accepted;
+    Acceptor acceptor(&loop, InetAddress("127.0.0.1", port));
+    acceptor.SetNewConnectionCallback(boost::bind(&OnConnection, &accepted, _1));
+    acceptor.Listen();
+
+    struct sockaddr_in address;
+    ::memset(&address, 0, sizeof address);
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    for (auto it = clients.begin(); it != clients.end(); ++it)
+    {
+        ::connect(*it, reinterpret_cast<const struct sockaddr*>(&address), sizeof address);
+    }
+
+    // one fd is free again, it is reserved before accept takes it
+    ::close(fillers.back());
+    fillers.pop_back();
+
+    auto overload = CounterValue("claire.Acceptor.overload");
+    loop.RunAfter(200, boost::bind(&EventLoop::quit, &loop));
+    loop.loop();
+
+    for (auto it = fillers.begin(); it != fillers.end(); ++it)
+    {
+        ::close(*it);
+    }
+    ::setrlimit(RLIMIT_NOFILE, &saved);
+
+    int shed = 0;
+    for (auto it = clients.begin(); it != clients.end(); ++it)
+    {
+        if (ClosedByPeer(*it))
+        {
+            shed++;
+        }
+        ::close(*it);
+    }
+
+    EXPECT_EQ(0u, accepted.size());
+    EXPECT_EQ(kClients, shed);
+    EXPECT_EQ(shed, CounterValue("claire.Acceptor.overload") - overload);
+}
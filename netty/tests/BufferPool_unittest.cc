@@ -0,0 +1,101 @@
+#include <claire/netty/BufferPool.h>
+#include <claire/netty/Buffer.h>
+#include <claire/netty/ChainBuffer.h>
+
+#include "thirdparty/gtest/gtest.h"
+
+using namespace claire;
+
+TEST(BufferPoolTest, Recycle)
+{
+    auto& pool = BufferPool::instance();
+
+    BufferPool::Storage storage;
+    pool.Take(100, &storage);
+    EXPECT_EQ(100, storage.size());
+
+    auto data = storage.data();
+    auto pooled = pool.pooled_bytes();
+    pool.Give(&storage);
+    EXPECT_TRUE(storage.empty());
+    EXPECT_LT(pooled, pool.pooled_bytes());
+
+    // the same size class takes the recycled storage
+    pool.Take(Buffer::kCheapPrepend + Buffer::kInitialSize, &storage);
+    EXPECT_EQ(data, storage.data());
+    EXPECT_EQ(pooled, pool.pooled_bytes());
+    pool.Give(&storage);
+}
+
+TEST(BufferPoolTest, TooLarge)
+{
+    auto& pool = BufferPool::instance();
+    auto pooled = pool.pooled_bytes();
+
+    BufferPool::Storage storage;
+    pool.Take(1024*1024, &storage);
+    pool.Give(&storage);
+    EXPECT_EQ(pooled, pool.pooled_bytes());
+}
+
+TEST(BufferPoolTest, BufferReuse)
+{
+    const char* data = NULL;
+    {
+        Buffer buffer;
+        data = buffer.Peek();
+    }
+
+    Buffer buffer;
+    EXPECT_EQ(data, buffer.Peek());
+
+    Buffer copy(buffer);
+    copy.Append("hello");
+    EXPECT_EQ(0, buffer.ReadableBytes());
+    EXPECT_EQ("hello", copy.ToStringPiece().ToString());
+
+    Buffer moved(std::move(copy));
+    EXPECT_EQ("hello", moved.ToStringPiece().ToString());
+    EXPECT_EQ(0, copy.ReadableBytes());
+}
+
+TEST(BufferPoolTest, ChainBufferReuse)
+{
+    auto pooled = BufferPool::instance().pooled_bytes();
+    {
+        ChainBuffer buffer;
+        buffer.Append(std::string(ChainBuffer::kBlockSize * 2, 'x'));
+    }
+    EXPECT_LT(pooled, BufferPool::instance().pooled_bytes());
+}
+
+TEST(BufferPoolTest, MoveTakesNoStorage)
+{
+    Buffer buffer;
+    buffer.Append("hello");
+    auto data = buffer.Peek();
+
+    auto& pool = BufferPool::instance();
+    auto pooled = pool.pooled_bytes();
+    Buffer moved(std::move(buffer));
+    EXPECT_EQ(data, moved.Peek());
+    EXPECT_EQ(0, buffer.Capacity());
+    EXPECT_EQ(pooled, pool.pooled_bytes());
+
+    // moved from buffer takes storage again when written
+    buffer.Append("world");
+    buffer.PrependInt32(5);
+    EXPECT_EQ(5, buffer.ReadInt32());
+    EXPECT_EQ("world", buffer.ToStringPiece().ToString());
+}
+
+TEST(BufferPoolTest, Shrink)
+{
+    Buffer buffer;
+    buffer.Append(std::string(64*1024, 'x'));
+    buffer.Consume(64*1024 - 5);
+    buffer.Shrink(10);
+    EXPECT_EQ("xxxxx", buffer.ToStringPiece().ToString());
+    EXPECT_EQ(10, buffer.WritableBytes());
+    EXPECT_EQ(static_cast<size_t>(Buffer::kCheapPrepend), buffer.PrependableBytes());
+}
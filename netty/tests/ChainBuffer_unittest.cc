@@ -0,0 +1,106 @@
+#include <claire/netty/ChainBuffer.h>
+#include <claire/netty/Buffer.h>
+
+#include <sys/uio.h>
+
+#include "thirdparty/gtest/gtest.h"
+
+using namespace claire;
+
+TEST(ChainBufferTest, AppendAndRead)
+{
+    ChainBuffer buffer;
+    EXPECT_EQ(0, buffer.ReadableBytes());
+
+    buffer.Append("hello, ");
+    buffer.Append("world");
+    EXPECT_EQ(12, buffer.ReadableBytes());
+    EXPECT_EQ(1, buffer.SliceCount());
+
+    char data[5];
+    EXPECT_EQ(5, buffer.Read(data, sizeof data));
+    EXPECT_EQ("hello", std::string(data, sizeof data));
+    EXPECT_EQ(", world", buffer.ToString());
+}
+
+TEST(ChainBufferTest, AppendLarge)
+{
+    std::string s(ChainBuffer::kBlockSize * 2 + 100, 'x');
+    ChainBuffer buffer;
+    buffer.Append("a");
+    buffer.Append(s);
+    EXPECT_EQ(s.size() + 1, buffer.ReadableBytes());
+    EXPECT_EQ("a" + s, buffer.ToString());
+
+    buffer.Consume(ChainBuffer::kBlockSize);
+    EXPECT_EQ(s.size() + 1 - ChainBuffer::kBlockSize, buffer.ReadableBytes());
+    EXPECT_EQ(std::string(s.size() + 1 - ChainBuffer::kBlockSize, 'x'), buffer.ToString());
+}
+
+TEST(ChainBufferTest, Prepend)
+{
+    ChainBuffer buffer;
+    buffer.Append("payload");
+    buffer.PrependInt32(7);
+    EXPECT_EQ(1, buffer.SliceCount());
+    EXPECT_EQ(11, buffer.ReadableBytes());
+
+    // no room left in front of the head block
+    buffer.PrependInt32(1);
+    buffer.Prepend("head", 4);
+    EXPECT_EQ(2, buffer.SliceCount());
+
+    std::string s(buffer.ToString());
+    EXPECT_EQ("head", s.substr(0, 4));
+    EXPECT_EQ("payload", s.substr(12));
+}
+
+TEST(ChainBufferTest, AppendBuffer)
+{
+    std::string s(Buffer::kInitialSize * 4, 'y');
+    Buffer buffer;
+    buffer.Append(s);
+
+    ChainBuffer chain;
+    chain.Append("x");
+    chain.Append(&buffer);
+    EXPECT_EQ(0, buffer.ReadableBytes());
+    EXPECT_EQ(s.size() + 1, chain.ReadableBytes());
+    EXPECT_EQ("x" + s, chain.ToString());
+}
+
+TEST(ChainBufferTest, SplitSharesBlocks)
+{
+    ChainBuffer buffer;
+    buffer.Append("hello, world");
+
+    ChainBuffer head(buffer.Split(5));
+    EXPECT_EQ("hello", head.ToString());
+    EXPECT_EQ(", world", buffer.ToString());
+
+    // block is shared, so neither side writes in place
+    EXPECT_EQ(0, head.WritableBytes());
+    EXPECT_EQ(0, buffer.WritableBytes());
+
+    head.Append("!");
+    EXPECT_EQ("hello!", head.ToString());
+    EXPECT_EQ(", world", buffer.ToString());
+
+    head.Append(&buffer);
+    EXPECT_EQ(0, buffer.ReadableBytes());
+    EXPECT_EQ("hello!, world", head.ToString());
+}
+
+TEST(ChainBufferTest, Peek)
+{
+    ChainBuffer buffer;
+    buffer.Append("abc");
+    ChainBuffer other("def", 3);
+    buffer.Append(&other);
+
+    struct iovec vec[4];
+    EXPECT_EQ(1, buffer.Peek(vec, 1));
+    EXPECT_EQ(2, buffer.Peek(vec, 4));
+    EXPECT_EQ("abc", std::string(static_cast<char*>(vec[0].iov_base), vec[0].iov_len));
+    EXPECT_EQ("def", std::string(static_cast<char*>(vec[1].iov_base), vec[1].iov_len));
+}
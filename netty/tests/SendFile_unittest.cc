@@ -0,0 +1,324 @@
+#include <claire/netty/TcpConnection.h>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+
+#include <gtest/gtest.h>
+
+#include <claire/netty/Socket.h>
+#include <claire/netty/InetAddress.h>
+#include <claire/netty/http/FileCache.h>
+#include <claire/netty/http/HttpServer.h>
+#include <claire/common/events/EventLoop.h>
+#include <claire/common/threading/Thread.h>
+
+using namespace claire;
+
+namespace {
+
+// temporary directory removed with the files in it
+class TempDirectory
+{
+public:
+    TempDirectory()
+    {
+        char name[] = "/tmp/sendfile_unittest.XXXXXX";
+        path_ = ::mkdtemp(name);
+    }
+
+    ~TempDirectory()
+    {
+        for (auto it = files_.begin(); it != files_.end(); ++it)
+        {
+            ::unlink((*it).c_str());
+        }
+        ::rmdir(path_.c_str());
+    }
+
+    std::string Write(const std::string& name, const std::string& data)
+    {
+        auto filename = path_ + "/" + name;
+        auto fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        ::write(fd, data.data(), data.size());
+        ::close(fd);
+        files_.push_back(filename);
+        return filename;
+    }
+
+    const std::string& path() const { return path_; }
+
+private:
+    std::string path_;
+    std::vector<std::string> files_;
+};
+
+std::string MakeData(size_t length)
+{
+    std::string data(length, 0);
+    for (size_t i = 0; i < length; i++)
+    {
+        data[i] = static_cast<char>('a' + i % 26);
+    }
+    return data;
+}
+
+// reads until EOF, then closes fd so the connection is closed too
+void ReadToEnd(int fd, std::string* data)
+{
+    char buffer[65536];
+    for (;;)
+    {
+        auto n = ::read(fd, buffer, sizeof buffer);
+        if (n <= 0)
+        {
+            break;
+        }
+        data->append(buffer, n);
+    }
+    ::close(fd);
+}
+
+void Quit(EventLoop* loop, const TcpConnectionPtr&)
+{
+    loop->quit();
+}
+
+void Shutdown(const TcpConnectionPtr& connection)
+{
+    connection->Shutdown();
+}
+
+// sends request by a new connection, reads response until EOF
+// or the end of body given by Content-Length
+std::string Get(uint16_t port, const std::string& path)
+{
+    auto fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct timeval timeout = { 5, 0 };
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+
+    struct sockaddr_in address;
+    ::memset(&address, 0, sizeof address);
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof address) < 0)
+    {
+        ::close(fd);
+        return "connect failed";
+    }
+
+    auto request = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    ::write(fd, request.data(), request.size());
+
+    std::string response;
+    char buffer[65536];
+    for (;;)
+    {
+        auto end = response.find("\r\n\r\n");
+        auto length = response.find("Content-Length: ");
+        if (end != std::string::npos && length != std::string::npos
+            && response.size() >= end + 4 + ::atoi(response.c_str() + length + 16))
+        {
+            break;
+        }
+
+        auto n = ::read(fd, buffer, sizeof buffer);
+        if (n <= 0)
+        {
+            break;
+        }
+        response.append(buffer, n);
+    }
+    ::close(fd);
+    return response;
+}
+
+uint16_t FreePort()
+{
+    auto fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    ::memset(&address, 0, sizeof address);
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ::bind(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof address);
+
+    socklen_t length = sizeof address;
+    ::getsockname(fd, reinterpret_cast<struct sockaddr*>(&address), &length);
+    ::close(fd);
+    return ntohs(address.sin_port);
+}
+
+void GetAll(uint16_t port,
+            const std::vector<std::string>* paths,
+            std::vector<std::string>* responses,
+            EventLoop* loop)
+{
+    for (auto it = paths->begin(); it != paths->end(); ++it)
+    {
+        responses->push_back(Get(port, *it));
+    }
+    loop->quit();
+}
+
+} // namespace
+
+TEST(SendFileTest, OrderWithTrailers)
+{
+    TempDirectory directory;
+    auto data = MakeData(1024*1024);
+    auto fd = ::open(directory.Write("a", data).c_str(), O_RDONLY);
+
+    EventLoop loop;
+    int fds[2];
+    ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds);
+    ::fcntl(fds[0], F_SETFL, O_NONBLOCK);
+
+    auto connection = boost::make_shared<TcpConnection>(&loop, Socket(fds[0]), 1);
+    connection->set_close_callback(boost::bind(&Quit, &loop, _1));
+    connection->ConnectEstablished();
+
+    // data sent after a file waits behind it, even while it is queued
+    connection->Send(StringPiece("head"));
+    connection->SendFile(fd, 0, data.size());
+    connection->Send(StringPiece("middle"));
+    connection->SendFile(fd, 10, 5);
+    connection->Send(StringPiece("tail"));
+    ::close(fd);
+
+    // shut down after all queued is sent
+    loop.Post(boost::bind(&Shutdown, connection));
+
+    std::string received;
+    Thread reader(boost::bind(&ReadToEnd, fds[1], &received), "reader");
+    reader.Start();
+    loop.loop();
+    reader.Join();
+
+    EXPECT_EQ("head" + data + "middle" + data.substr(10, 5) + "tail", received);
+    connection->ConnectDestroyed();
+}
+
+TEST(SendFileTest, ShortFileEndsConnection)
+{
+    TempDirectory directory;
+    auto data = MakeData(1000);
+    auto fd = ::open(directory.Write("a", data).c_str(), O_RDONLY);
+
+    EventLoop loop;
+    int fds[2];
+    ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds);
+    ::fcntl(fds[0], F_SETFL, O_NONBLOCK);
+
+    auto connection = boost::make_shared<TcpConnection>(&loop, Socket(fds[0]), 1);
+    connection->set_close_callback(boost::bind(&Quit, &loop, _1));
+    connection->ConnectEstablished();
+
+    // file truncated after its length is announced, like a rotated log
+    connection->Send(StringPiece("head"));
+    connection->SendFile(fd, 0, 2000);
+    connection->Send(StringPiece("tail"));
+    ::close(fd);
+
+    // reader gets EOF instead of waiting for the missing bytes
+    std::string received;
+    Thread reader(boost::bind(&ReadToEnd, fds[1], &received), "reader");
+    reader.Start();
+    loop.loop();
+    reader.Join();
+
+    EXPECT_EQ("head" + data, received);
+    EXPECT_FALSE(connection->connected());
+    connection->ConnectDestroyed();
+}
+
+TEST(FileCacheTest, HitAndRevalidate)
+{
+    TempDirectory directory;
+    auto filename = directory.Write("a", "hello");
+
+    FileCache cache(2);
+    auto file = cache.Open(filename);
+    ASSERT_TRUE(!!file);
+    EXPECT_EQ(5, file->size());
+    EXPECT_EQ(file, cache.Open(filename));
+
+    // changed file is opened again
+    directory.Write("a", "hello world");
+    auto changed = cache.Open(filename);
+    ASSERT_TRUE(!!changed);
+    EXPECT_NE(file, changed);
+    EXPECT_EQ(11, changed->size());
+
+    EXPECT_FALSE(cache.Open(directory.path() + "/missing"));
+    EXPECT_FALSE(cache.Open(directory.path()));
+}
+
+TEST(FileCacheTest, EvictLeastRecentlyUsed)
+{
+    TempDirectory directory;
+    auto a = directory.Write("a", "a");
+    auto b = directory.Write("b", "b");
+    auto c = directory.Write("c", "c");
+
+    FileCache cache(2);
+    auto file_a = cache.Open(a);
+    auto file_b = cache.Open(b);
+    EXPECT_EQ(file_a, cache.Open(a));
+
+    // b is the least recently used one
+    cache.Open(c);
+    EXPECT_EQ(file_a, cache.Open(a));
+    EXPECT_NE(file_b, cache.Open(b));
+
+    // evicted file keeps its fd while held
+    char byte = 0;
+    EXPECT_EQ(1, ::pread(file_b->fd(), &byte, 1, 0));
+    EXPECT_EQ('b', byte);
+}
+
+TEST(HttpServerTest, RegisterDirectory)
+{
+    TempDirectory directory;
+    auto data = MakeData(100*1000);
+    directory.Write("a.txt", data);
+
+    auto port = FreePort();
+    EventLoop loop;
+    HttpServer server(&loop, InetAddress("127.0.0.1", port), "file");
+    server.RegisterDirectory("/dumps", directory.path());
+    server.Start();
+
+    std::vector<std::string> paths;
+    paths.push_back("/dumps/a.txt");
+    paths.push_back("/dumpsfoo/a.txt");
+    paths.push_back("/dumps/../a.txt");
+    paths.push_back("/dumps/missing");
+
+    std::vector<std::string> responses;
+    Thread client(boost::bind(&GetAll, port, &paths, &responses, &loop), "client");
+    client.Start();
+    loop.loop();
+    client.Join();
+
+    ASSERT_EQ(paths.size(), responses.size());
+    EXPECT_EQ(0, responses[0].find("HTTP/1.1 200"));
+    EXPECT_EQ(data, responses[0].substr(responses[0].find("\r\n\r\n") + 4));
+
+    // not under the prefix, no handler
+    EXPECT_EQ("", responses[1]);
+
+    EXPECT_EQ(0, responses[2].find("HTTP/1.1 403"));
+    EXPECT_EQ(0, responses[3].find("HTTP/1.1 404"));
+}
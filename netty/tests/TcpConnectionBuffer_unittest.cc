@@ -0,0 +1,149 @@
+#include <claire/netty/TcpConnection.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <string>
+
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+
+#include <gtest/gtest.h>
+
+#include <claire/netty/Socket.h>
+#include <claire/common/events/EventLoop.h>
+#include <claire/common/threading/Thread.h>
+#include <claire/common/metrics/CounterProvider.h>
+
+DECLARE_int32(connection_buffer_idle_ms);
+DECLARE_int32(connection_buffer_shrink_bytes);
+
+using namespace claire;
+
+namespace {
+
+class TcpConnectionBufferTest : public ::testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        FLAGS_connection_buffer_idle_ms = 0;
+        FLAGS_connection_buffer_shrink_bytes = 64*1024;
+
+        ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds_);
+        ::fcntl(fds_[0], F_SETFL, O_NONBLOCK);
+        connection_ = boost::make_shared<TcpConnection>(&loop_, Socket(fds_[0]), 1);
+        connection_->set_message_callback(
+            boost::bind(&TcpConnectionBufferTest::OnMessage, this, _1, _2));
+        connection_->ConnectEstablished();
+        message_capacity_ = 0;
+        received_bytes_ = 0;
+        received_counter_ = 0;
+    }
+
+    virtual void TearDown()
+    {
+        connection_->ConnectDestroyed();
+        connection_.reset();
+        ::close(fds_[1]);
+    }
+
+    // takes the whole message at once, like a codec
+    void OnMessage(const TcpConnectionPtr&, Buffer* buffer)
+    {
+        if (buffer->ReadableBytes() >= expected_)
+        {
+            message_capacity_ = buffer->Capacity();
+            buffer->ConsumeAll();
+            // after the input buffer is reclaimed by OnRead
+            loop_.Post(boost::bind(&TcpConnectionBufferTest::OnReceived, this));
+        }
+    }
+
+    void OnReceived()
+    {
+        received_bytes_ = connection_->buffer_bytes();
+        received_counter_ = BufferBytesCounter();
+        loop_.RunAfter(linger_ms_, boost::bind(&EventLoop::quit, &loop_));
+    }
+
+    // sends length bytes from peer, returns linger_ms after all are received,
+    // EventLoop can not loop again once quit
+    void Receive(size_t length, int linger_ms)
+    {
+        expected_ = length;
+        linger_ms_ = linger_ms;
+        Thread writer(boost::bind(&WriteAll, fds_[1], std::string(length, 'x')), "writer");
+        writer.Start();
+        loop_.loop();
+        writer.Join();
+    }
+
+    static void WriteAll(int fd, const std::string& data)
+    {
+        size_t written = 0;
+        while (written < data.size())
+        {
+            auto n = ::write(fd, data.data() + written, data.size() - written);
+            if (n <= 0)
+            {
+                break;
+            }
+            written += n;
+        }
+    }
+
+    static int BufferBytesCounter()
+    {
+        return CounterProvider::instance()->GetCounterValue("claire.TcpConnection.BufferBytes");
+    }
+
+    EventLoop loop_;
+    int fds_[2];
+    TcpConnectionPtr connection_;
+    size_t expected_;
+    int linger_ms_;
+
+    size_t message_capacity_;
+
+    // when all is received
+    size_t received_bytes_;
+    int received_counter_;
+};
+
+} // namespace
+
+TEST_F(TcpConnectionBufferTest, AllocateOnRead)
+{
+    // no input buffer until something is read
+    EXPECT_EQ(0, connection_->buffer_bytes());
+
+    auto counter = BufferBytesCounter();
+    Receive(10, 0);
+    EXPECT_LT(0, received_bytes_);
+    EXPECT_EQ(counter + static_cast<int>(received_bytes_), received_counter_);
+}
+
+TEST_F(TcpConnectionBufferTest, ReleaseLargeBufferOnDrain)
+{
+    // buffer grown beyond --connection_buffer_shrink_bytes is released once drained
+    auto counter = BufferBytesCounter();
+    Receive(1024*1024, 0);
+    EXPECT_LT(static_cast<size_t>(FLAGS_connection_buffer_shrink_bytes), message_capacity_);
+    EXPECT_EQ(0, received_bytes_);
+    EXPECT_EQ(counter, received_counter_);
+}
+
+TEST_F(TcpConnectionBufferTest, ReleaseOnIdle)
+{
+    FLAGS_connection_buffer_idle_ms = 20;
+
+    auto counter = BufferBytesCounter();
+    Receive(10, 100);
+    EXPECT_LT(0, received_bytes_);
+    EXPECT_EQ(counter + static_cast<int>(received_bytes_), received_counter_);
+
+    EXPECT_EQ(0, connection_->buffer_bytes());
+    EXPECT_EQ(counter, BufferBytesCounter());
+}
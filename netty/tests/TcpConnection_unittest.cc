@@ -0,0 +1,269 @@
+#include <claire/netty/TcpConnection.h>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <string>
+
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+
+#include <gtest/gtest.h>
+
+#include <claire/netty/Socket.h>
+#include <claire/netty/ChainBuffer.h>
+#include <claire/common/events/EventLoop.h>
+#include <claire/common/threading/Thread.h>
+
+DECLARE_int32(connection_drain_budget);
+DECLARE_int32(connection_zerocopy_threshold);
+
+using namespace claire;
+
+namespace {
+
+struct Pair
+{
+    Pair()
+    {
+        ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds);
+    }
+
+    int fds[2];
+};
+
+// MSG_ZEROCOPY needs tcp, fds[0] is nonblocking
+struct LoopbackPair
+{
+    LoopbackPair()
+    {
+        auto listener = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        struct sockaddr_in address;
+        ::memset(&address, 0, sizeof address);
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        ::bind(listener, reinterpret_cast<struct sockaddr*>(&address), sizeof address);
+        ::listen(listener, 1);
+
+        socklen_t length = sizeof address;
+        ::getsockname(listener, reinterpret_cast<struct sockaddr*>(&address), &length);
+        fds[1] = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+        // small window keeps the data sent in the queue of fds[0]
+        int size = 64*1024;
+        ::setsockopt(fds[1], SOL_SOCKET, SO_RCVBUF, &size, sizeof size);
+        ::connect(fds[1], reinterpret_cast<struct sockaddr*>(&address), sizeof address);
+        fds[0] = ::accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        ::close(listener);
+    }
+
+    int fds[2];
+};
+
+void OnMessage(EventLoop* loop,
+               std::string* received,
+               size_t expected,
+               const TcpConnectionPtr&,
+               Buffer* buffer)
+{
+    received->append(buffer->Peek(), buffer->ReadableBytes());
+    buffer->ConsumeAll();
+    if (received->size() >= expected)
+    {
+        loop->quit();
+    }
+}
+
+void WriteAll(int fd, const std::string& data)
+{
+    ::fcntl(fd, F_SETFL, 0);
+    size_t written = 0;
+    while (written < data.size())
+    {
+        auto n = ::write(fd, data.data() + written, data.size() - written);
+        if (n <= 0)
+        {
+            break;
+        }
+        written += n;
+    }
+}
+
+void ReadAll(int fd, size_t length, std::string* data, EventLoop* loop)
+{
+    ::fcntl(fd, F_SETFL, 0);
+    char buffer[65536];
+    while (data->size() < length)
+    {
+        auto n = ::read(fd, buffer, sizeof buffer);
+        if (n <= 0)
+        {
+            break;
+        }
+        data->append(buffer, n);
+    }
+    loop->quit();
+}
+
+// reads until EOF
+void ReadToEnd(int fd, std::string* data, EventLoop* loop)
+{
+    char buffer[65536];
+    for (;;)
+    {
+        auto n = ::read(fd, buffer, sizeof buffer);
+        if (n <= 0)
+        {
+            break;
+        }
+        data->append(buffer, n);
+    }
+    loop->quit();
+}
+
+} // namespace
+
+TEST(TcpConnectionTest, EdgeTriggeredReadBeyondBudget)
+{
+    FLAGS_connection_drain_budget = 4096;
+
+    EventLoop loop;
+    Pair pair;
+
+    std::string data(1024*1024, 'x');
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        data[i] = static_cast<char>('a' + i % 26);
+    }
+
+    std::string received;
+    auto connection = boost::make_shared<TcpConnection>(&loop, Socket(pair.fds[0]), 1);
+    connection->SetEdgeTriggered(true);
+    connection->set_message_callback(
+        boost::bind(&OnMessage, &loop, &received, data.size(), _1, _2));
+    connection->ConnectEstablished();
+
+    // socket buffer holds far more than the budget, so reads are split by it
+    Thread writer(boost::bind(&WriteAll, pair.fds[1], data), "writer");
+    writer.Start();
+    loop.loop();
+    writer.Join();
+
+    EXPECT_EQ(data, received);
+    connection->ConnectDestroyed();
+    ::close(pair.fds[1]);
+}
+
+TEST(TcpConnectionTest, EdgeTriggeredWriteBeyondBudget)
+{
+    FLAGS_connection_drain_budget = 4096;
+
+    EventLoop loop;
+    Pair pair;
+
+    std::string data(1024*1024, 'y');
+    auto connection = boost::make_shared<TcpConnection>(&loop, Socket(pair.fds[0]), 1);
+    connection->SetEdgeTriggered(true);
+    connection->ConnectEstablished();
+    connection->Send(StringPiece(data));
+    connection->Send(StringPiece("end"));
+
+    std::string received;
+    Thread reader(boost::bind(&ReadAll, pair.fds[1], data.size() + 3, &received, &loop), "reader");
+    reader.Start();
+    loop.loop();
+    reader.Join();
+
+    EXPECT_EQ(data + "end", received);
+    connection->ConnectDestroyed();
+    ::close(pair.fds[1]);
+}
+
+TEST(TcpConnectionTest, WriteMoreSlicesThanIovMax)
+{
+    EventLoop loop;
+    Pair pair;
+
+    std::string data(3*IOV_MAX*16, 'x');
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        data[i] = static_cast<char>('a' + i % 26);
+    }
+
+    // small slices of shared blocks, more than one writev can take
+    ChainBuffer whole;
+    whole.Append(data.data(), data.size());
+    ChainBuffer buffer;
+    while (whole.ReadableBytes() > 0)
+    {
+        auto slice = whole.Split(16);
+        buffer.Append(&slice);
+    }
+    ASSERT_LT(static_cast<size_t>(IOV_MAX), buffer.SliceCount());
+
+    auto connection = boost::make_shared<TcpConnection>(&loop, Socket(pair.fds[0]), 1);
+    connection->ConnectEstablished();
+    connection->Send(&buffer);
+    connection->Send(StringPiece("end"));
+
+    std::string received;
+    Thread reader(boost::bind(&ReadAll, pair.fds[1], data.size() + 3, &received, &loop), "reader");
+    reader.Start();
+    loop.loop();
+    reader.Join();
+
+    EXPECT_EQ(data + "end", received);
+    EXPECT_EQ(0, loop.load().pending_bytes.load());
+    connection->ConnectDestroyed();
+    ::close(pair.fds[1]);
+}
+
+TEST(TcpConnectionTest, ZeroCopyBuffersOutliveConnection)
+{
+    FLAGS_connection_zerocopy_threshold = 1024;
+
+    EventLoop loop;
+    LoopbackPair pair;
+
+    std::string data(4*1024*1024, 'x');
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        data[i] = static_cast<char>('a' + i % 26);
+    }
+
+    // peer reads nothing yet, so the sent blocks are still queued in socket
+    auto connection = boost::make_shared<TcpConnection>(&loop, Socket(pair.fds[0]), 1);
+    connection->ConnectEstablished();
+    ChainBuffer buffer;
+    for (size_t i = 0; i < data.size(); i += ChainBuffer::kBlockSize)
+    {
+        buffer.Append(data.data() + i, ChainBuffer::kBlockSize);
+    }
+    connection->Send(&buffer);
+    connection->ConnectDestroyed();
+    connection.reset();
+
+    // blocks given back to the pool too early would be overwritten here
+    ChainBuffer other;
+    std::string overwrite(ChainBuffer::kBlockSize, 'z');
+    for (size_t i = 0; i < data.size(); i += overwrite.size())
+    {
+        other.Append(overwrite.data(), overwrite.size());
+    }
+
+    std::string received;
+    Thread reader(boost::bind(&ReadToEnd, pair.fds[1], &received, &loop), "reader");
+    reader.Start();
+    loop.loop();
+    reader.Join();
+
+    // output not written is dropped with the connection
+    EXPECT_LT(0u, received.size());
+    EXPECT_EQ(data.substr(0, received.size()), received);
+    ::close(pair.fds[1]);
+    FLAGS_connection_zerocopy_threshold = 0;
+}
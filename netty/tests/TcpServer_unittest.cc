@@ -0,0 +1,111 @@
+#include <claire/netty/TcpServer.h>
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <set>
+#include <vector>
+
+#include <boost/bind.hpp>
+
+#include <gtest/gtest.h>
+
+#include <claire/netty/Socket.h>
+#include <claire/netty/InetAddress.h>
+#include <claire/netty/TcpConnection.h>
+#include <claire/common/events/EventLoop.h>
+#include <claire/common/threading/Mutex.h>
+
+using namespace claire;
+
+namespace {
+
+const int kThreads = 4;
+const int kClients = 64;
+
+struct Shards
+{
+    Shards() : connected(0) {}
+
+    Mutex mutex;
+    std::set<EventLoop*> loops; // @GUARDBY mutex
+    int connected; // @GUARDBY mutex
+};
+
+void OnConnection(Shards* shards, const TcpConnectionPtr& connection)
+{
+    if (connection->connected())
+    {
+        MutexLock lock(shards->mutex);
+        shards->loops.insert(connection->loop());
+        shards->connected++;
+    }
+}
+
+void ConnectClients(TcpServer* server, std::vector<int>* clients)
+{
+    struct sockaddr_in address;
+    ::memset(&address, 0, sizeof address);
+    address.sin_family = AF_INET;
+    address.sin_port = htons(server->listen_address().port());
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    for (int i = 0; i < kClients; i++)
+    {
+        auto fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        ::connect(fd, reinterpret_cast<const struct sockaddr*>(&address), sizeof address);
+        clients->push_back(fd);
+    }
+}
+
+int ReusePort(const Socket& socket)
+{
+    int option = -1;
+    socklen_t length = sizeof option;
+    ::getsockopt(socket.fd(), SOL_SOCKET, SO_REUSEPORT, &option, &length);
+    return option;
+}
+
+} // namespace
+
+TEST(TcpServerTest, SetReusePort)
+{
+    auto socket = Socket::NewNonBlockingSocket(true);
+    socket->SetReusePort(true);
+    EXPECT_NE(0, ReusePort(*socket));
+    socket->SetReusePort(false);
+    EXPECT_EQ(0, ReusePort(*socket));
+}
+
+TEST(TcpServerTest, ShardedConnectionsLandOnSeveralLoops)
+{
+    EventLoop loop;
+    Shards shards;
+
+    // port 0, every shard must listen on the port of the first one
+    TcpServer server(&loop, InetAddress("127.0.0.1", 0), "sharded", TcpServer::kShardedReusePort);
+    server.set_num_threads(kThreads);
+    server.set_connection_callback(boost::bind(&OnConnection, &shards, _1));
+    server.Start();
+    EXPECT_NE(0, server.listen_address().port());
+
+    // shards start listening in their own loops
+    std::vector<int> clients;
+    loop.RunAfter(100, boost::bind(&ConnectClients, &server, &clients));
+    loop.RunAfter(500, boost::bind(&EventLoop::quit, &loop));
+    loop.loop();
+
+    {
+        MutexLock lock(shards.mutex);
+        EXPECT_EQ(kClients, shards.connected);
+        EXPECT_LT(1u, shards.loops.size());
+    }
+
+    for (auto it = clients.begin(); it != clients.end(); ++it)
+    {
+        ::close(*it);
+    }
+}
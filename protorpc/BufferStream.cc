@@ -0,0 +1,168 @@
+// Copyright (c) 2013 The claire-protorpc Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <claire/protorpc/BufferStream.h>
+
+#include <algorithm>
+
+#include <claire/common/logging/Logging.h>
+
+#include <claire/netty/Buffer.h>
+#include <claire/netty/ChainBuffer.h>
+
+namespace claire {
+namespace protorpc {
+
+BufferInputStream::BufferInputStream(const Buffer* buffer)
+    : data_(buffer->Peek()),
+      size_(static_cast<int>(buffer->ReadableBytes())),
+      position_(0)
+{}
+
+BufferInputStream::BufferInputStream(const Buffer* buffer, size_t offset, size_t length)
+    : data_(buffer->Peek() + offset),
+      size_(static_cast<int>(length)),
+      position_(0)
+{
+    DCHECK(offset + length <= buffer->ReadableBytes());
+}
+
+bool BufferInputStream::Next(const void** data, int* size)
+{
+    if (position_ >= size_)
+    {
+        return false;
+    }
+
+    *data = data_ + position_;
+    *size = size_ - position_;
+    position_ = size_;
+    return true;
+}
+
+void BufferInputStream::BackUp(int count)
+{
+    DCHECK(count >= 0 && count <= position_);
+    position_ -= count;
+}
+
+bool BufferInputStream::Skip(int count)
+{
+    DCHECK(count >= 0);
+    if (count > size_ - position_)
+    {
+        position_ = size_;
+        return false;
+    }
+
+    position_ += count;
+    return true;
+}
+
+int64_t BufferInputStream::ByteCount() const
+{
+    return position_;
+}
+
+ChainBufferInputStream::ChainBufferInputStream(const ChainBuffer* buffer)
+    : index_(0),
+      position_(0),
+      byte_count_(0)
+{
+    Init(buffer, 0, buffer->ReadableBytes());
+}
+
+ChainBufferInputStream::ChainBufferInputStream(const ChainBuffer* buffer,
+                                               size_t offset,
+                                               size_t length)
+    : index_(0),
+      position_(0),
+      byte_count_(0)
+{
+    Init(buffer, offset, length);
+}
+
+void ChainBufferInputStream::Init(const ChainBuffer* buffer, size_t offset, size_t length)
+{
+    DCHECK(offset + length <= buffer->ReadableBytes());
+
+    std::vector<struct iovec> vec(buffer->SliceCount());
+    vec.resize(buffer->Peek(vec.data(), static_cast<int>(vec.size())));
+
+    // keeps slices of [offset, offset+length) only
+    for (auto it = vec.begin(); it != vec.end() && length > 0; ++it)
+    {
+        if (offset >= (*it).iov_len)
+        {
+            offset -= (*it).iov_len;
+            continue;
+        }
+
+        struct iovec slice;
+        slice.iov_base = static_cast<char*>((*it).iov_base) + offset;
+        slice.iov_len = std::min((*it).iov_len - offset, length);
+        slices_.push_back(slice);
+
+        length -= slice.iov_len;
+        offset = 0;
+    }
+}
+
+bool ChainBufferInputStream::Next(const void** data, int* size)
+{
+    while (index_ < slices_.size() && position_ == slices_[index_].iov_len)
+    {
+        index_++;
+        position_ = 0;
+    }
+
+    if (index_ == slices_.size())
+    {
+        return false;
+    }
+
+    *data = static_cast<const char*>(slices_[index_].iov_base) + position_;
+    *size = static_cast<int>(slices_[index_].iov_len - position_);
+    byte_count_ += *size;
+    position_ = slices_[index_].iov_len;
+    return true;
+}
+
+void ChainBufferInputStream::BackUp(int count)
+{
+    // only within the slice returned by last Next
+    DCHECK(count >= 0 && static_cast<size_t>(count) <= position_);
+    position_ -= count;
+    byte_count_ -= count;
+}
+
+bool ChainBufferInputStream::Skip(int count)
+{
+    DCHECK(count >= 0);
+    size_t left = count;
+    while (index_ < slices_.size())
+    {
+        auto available = slices_[index_].iov_len - position_;
+        if (left < available)
+        {
+            position_ += left;
+            byte_count_ += left;
+            return true;
+        }
+
+        left -= available;
+        byte_count_ += available;
+        index_++;
+        position_ = 0;
+    }
+    return left == 0;
+}
+
+int64_t ChainBufferInputStream::ByteCount() const
+{
+    return byte_count_;
+}
+
+} // namespace protorpc
+} // namespace claire
@@ -0,0 +1,68 @@
+// Copyright (c) 2013 The claire-protorpc Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include <vector>
+
+#include "thirdparty/google/protobuf/io/zero_copy_stream.h"
+
+namespace claire {
+
+class Buffer;
+class ChainBuffer;
+
+namespace protorpc {
+
+/// Reads readable bytes of Buffer in place, so protobuf parses from the
+/// buffer without copying. Buffer is not consumed and must not be changed
+/// while reading.
+class BufferInputStream : public ::google::protobuf::io::ZeroCopyInputStream
+{
+public:
+    explicit BufferInputStream(const Buffer* buffer);
+
+    /// Reads length bytes from offset of readable bytes
+    BufferInputStream(const Buffer* buffer, size_t offset, size_t length);
+
+    virtual bool Next(const void** data, int* size);
+    virtual void BackUp(int count);
+    virtual bool Skip(int count);
+    virtual int64_t ByteCount() const;
+
+private:
+    const char* data_;
+    int size_;
+    int position_;
+};
+
+/// Reads readable bytes of ChainBuffer in place, one slice at a time.
+/// ChainBuffer is not consumed and must not be changed while reading.
+class ChainBufferInputStream : public ::google::protobuf::io::ZeroCopyInputStream
+{
+public:
+    explicit ChainBufferInputStream(const ChainBuffer* buffer);
+
+    /// Reads length bytes from offset of readable bytes
+    ChainBufferInputStream(const ChainBuffer* buffer, size_t offset, size_t length);
+
+    virtual bool Next(const void** data, int* size);
+    virtual void BackUp(int count);
+    virtual bool Skip(int count);
+    virtual int64_t ByteCount() const;
+
+private:
+    void Init(const ChainBuffer* buffer, size_t offset, size_t length);
+
+    std::vector<struct iovec> slices_;
+    size_t index_;    // slice reading
+    size_t position_; // offset in slice reading
+    int64_t byte_count_;
+};
+
+} // namespace protorpc
+} // namespace claire
@@ -22,7 +22,7 @@
 #include <claire/common/metrics/Histogram.h>
 #include <claire/common/tracing/Tracing.h>
 
-#include <claire/netty/Buffer.h>
+#include <claire/netty/ChainBuffer.h>
 #include <claire/netty/InetAddress.h>
 #include <claire/netty/http/HttpClient.h>
 #include <claire/netty/http/HttpRequest.h>
@@ -76,7 +76,7 @@ public:
         DCHECK(!!loadbalancer_);
 
         codec_.set_message_callback(
-            boost::bind(&Impl::OnResponse, this, _1, _2));
+            boost::bind(&Impl::OnResponse, this, _1, _2, _3));
     }
 
     void Connect(const std::string& server_address)
@@ -111,7 +111,10 @@ public:
 
         if (message.request().empty())
         {
+            // done is called on every path, awaiting coroutines rely on it,
+            // and never before CallMethod returns, like a response
             controller->SetFailed(RPC_ERROR_INVALID_REQUEST);
+            loop_->Post(boost::bind(done, controller, ::google::protobuf::MessagePtr()));
             return ;
         }
         RegisterRequest(method,
@@ -235,7 +238,7 @@ private:
             TRACE_ANNOTATION(Annotation::client_send());
         }
 
-        Buffer buffer;
+        ChainBuffer buffer;
         codec_.SerializeToBuffer(message, &buffer);
         connection->Send(&buffer);
     }
@@ -303,7 +306,9 @@ private:
         codec_.ParseFromBuffer(connection, buffer);
     }
 
-    void OnResponse(const HttpConnectionPtr& connection, const RpcMessage& message)
+    void OnResponse(const HttpConnectionPtr& connection,
+                    const RpcMessage& message,
+                    ::google::protobuf::io::ZeroCopyInputStream* payload)
     {
         ThisThread::ResetTraceContext();
         if (message.has_trace_id())
@@ -359,7 +364,7 @@ private:
         if (out.response_prototype)
         {
             boost::shared_ptr< ::google::protobuf::Message> response(out.response_prototype->New());
-            if (!response->ParseFromString(message.response()))
+            if (!response->ParseFromZeroCopyStream(payload))
             {
                 out.controller->SetFailed(RPC_ERROR_PARSE_FAIL);
             }
@@ -436,7 +441,7 @@ private:
                                 boost::bind(&Impl::OnHeartBeatResponse, this, _1, _2),
                                 message.id());
 
-                Buffer buffer;
+                ChainBuffer buffer;
                 codec_.SerializeToBuffer(message, &buffer);
                 client.Send(&buffer);
             }
@@ -149,6 +149,10 @@ public:
     // are less strict in one important way:  the request and response objects
     // need not be of any specific class as long as their descriptors are
     // method->input_type() and method->output_type().
+    //
+    // done is always called later in the loop of channel, with a NULL
+    // response if the call fails, even for an empty request which is
+    // failed at once.
     void CallMethod(const ::google::protobuf::MethodDescriptor* method,
                     RpcControllerPtr& controller,
                     const ::google::protobuf::Message& request,
@@ -7,15 +7,20 @@
 #include <zlib.h>
 #include "thirdparty/snappy/snappy.h"
 #include "thirdparty/google/protobuf/message.h"
+#include "thirdparty/google/protobuf/wire_format_lite.h"
+#include "thirdparty/google/protobuf/io/coded_stream.h"
+#include "thirdparty/google/protobuf/io/zero_copy_stream_impl_lite.h"
 
 #include <string>
 
 #include <claire/common/logging/Logging.h>
 
 #include <claire/netty/Buffer.h>
+#include <claire/netty/ChainBuffer.h>
 #include <claire/netty/http/HttpConnection.h>
 
 #include <claire/protorpc/RpcUtil.h>
+#include <claire/protorpc/BufferStream.h>
 #include <claire/protorpc/rpcmessage.pb.h> // protoc-rpc-gen
 
 namespace claire {
@@ -23,6 +28,10 @@ namespace protorpc {
 
 namespace {
 
+using ::google::protobuf::io::ArrayInputStream;
+using ::google::protobuf::io::CodedInputStream;
+using ::google::protobuf::internal::WireFormatLite;
+
 const static int kMinMessageLength = sizeof(int32_t); // checksum
 const static int kMaxMessageLength = 64*1024*1024;    // same as codec_stream.h kDefaultTotalBytesLimit
 const static int kChecksumLength   = sizeof(int32_t);
@@ -113,7 +122,114 @@ int32_t BytesChecksum(const char* buffer, size_t length)
                                           static_cast<int>(length)));
 }
 
-ErrorCode Parse(Buffer* buffer, RpcMessage* message)
+// Request or response field of message, [begin, end) is the field with
+// its tag, [offset, offset+size) is its bytes
+struct PayloadField
+{
+    PayloadField()
+        : number(0),
+          begin(0),
+          end(0),
+          offset(0),
+          size(0)
+    {}
+
+    bool found() const { return number != 0; }
+
+    int number;
+    int begin;
+    int end;
+    int offset;
+    int size;
+};
+
+// Scans tags of message without parsing, finds the last payload field
+bool FindPayload(const Buffer* buffer, int length, PayloadField* field)
+{
+    BufferInputStream stream(buffer, 0, length);
+    CodedInputStream input(&stream);
+    for (;;)
+    {
+        auto begin = input.CurrentPosition();
+        auto tag = input.ReadTag();
+        if (tag == 0)
+        {
+            break;
+        }
+
+        auto number = WireFormatLite::GetTagFieldNumber(tag);
+        if ((number == RpcMessage::kRequestFieldNumber || number == RpcMessage::kResponseFieldNumber)
+            && WireFormatLite::GetTagWireType(tag) == WireFormatLite::WIRETYPE_LENGTH_DELIMITED)
+        {
+            uint32_t size;
+            if (!input.ReadVarint32(&size) || size > static_cast<uint32_t>(length))
+            {
+                return false;
+            }
+
+            field->number = number;
+            field->begin = begin;
+            field->offset = input.CurrentPosition();
+            field->size = static_cast<int>(size);
+            if (!input.Skip(field->size))
+            {
+                return false;
+            }
+            field->end = input.CurrentPosition();
+        }
+        else if (!WireFormatLite::SkipField(&input, tag))
+        {
+            return false;
+        }
+    }
+    return input.ConsumedEntireMessage();
+}
+
+// Parses fields before and after payload field, which are
+// a valid message each, concatenated messages are merged
+bool ParseWithoutPayload(const Buffer* buffer,
+                         int length,
+                         const PayloadField& field,
+                         RpcMessage* message)
+{
+    BufferInputStream stream(buffer, 0, length);
+    CodedInputStream input(&stream);
+    if (field.found())
+    {
+        auto limit = input.PushLimit(field.begin);
+        if (!message->MergePartialFromCodedStream(&input) || !input.ConsumedEntireMessage())
+        {
+            return false;
+        }
+        input.PopLimit(limit);
+
+        if (!input.Skip(field.end - field.begin))
+        {
+            return false;
+        }
+    }
+
+    if (!message->MergePartialFromCodedStream(&input) || !input.ConsumedEntireMessage())
+    {
+        return false;
+    }
+
+    // former duplicates are overridden by payload, as by protobuf
+    message->clear_request();
+    message->clear_response();
+    if (field.number == RpcMessage::kRequestFieldNumber)
+    {
+        message->mutable_request();
+    }
+    else if (field.number == RpcMessage::kResponseFieldNumber)
+    {
+        message->mutable_response();
+    }
+    return message->IsInitialized();
+}
+
+// Consumes length and checksum, parses message but leaves it in buffer
+ErrorCode Parse(Buffer* buffer, RpcMessage* message, PayloadField* field)
 {
     auto length = buffer->PeekInt32();
     buffer->Consume(sizeof(int32_t));
@@ -128,36 +244,89 @@ ErrorCode Parse(Buffer* buffer, RpcMessage* message)
         return RPC_ERROR_INVALID_CHECKSUM;
     }
 
-    if (!message->ParseFromArray(buffer->Peek(), length - kChecksumLength))
+    if (!FindPayload(buffer, length - kChecksumLength, field)
+        || !ParseWithoutPayload(buffer, length - kChecksumLength, *field, message))
     {
         return RPC_ERROR_PARSE_FAIL;
     }
+    return RPC_SUCCESS;
+}
+
+// Returns true if payload is uncompressed into output, otherwise
+// payload is not compressed and is read in place
+bool Uncompress(const Buffer* buffer,
+                const PayloadField& field,
+                RpcMessage* message,
+                std::string* output)
+{
+    if (!message->has_compress_type())
+    {
+        return false;
+    }
+
+    switch (message->compress_type())
+    {
+        case Compress_Snappy:
+            return field.found()
+                && snappy::Uncompress(buffer->Peek() + field.offset,
+                                      field.size,
+                                      output);
+        default:
+            message->set_compress_type(Compress_None);
+            return false;
+    }
+}
 
-    buffer->Consume(length - kChecksumLength);
+// Buffer must be empty, length and checksum are prepended in front of message
+template<typename BufferType>
+void Serialize(RpcMessage& message, BufferType* buffer)
+{
+    DCHECK(buffer->ReadableBytes() == 0);
+
+    DCHECK(message.IsInitialized())
+        << InitializationErrorMessage("Serialize", message);
 
-    if (message->has_compress_type())
+    if (message.has_compress_type())
     {
-        switch (message->compress_type())
+        switch (message.compress_type())
         {
             case Compress_Snappy:
             {
-                auto compressed_message
-                    = message->has_request() ? message->mutable_request() : message->mutable_response();
-                std::string uncompressed_message;
-                if (snappy::Uncompress(compressed_message->data(),
-                                      compressed_message->size(),
-                                      &uncompressed_message))
+                auto uncompressed_message =
+                    message.has_request() ? message.mutable_request() : message.mutable_response();
+                std::string compressed_message;
+                if (snappy::Compress(uncompressed_message->data(),
+                                     uncompressed_message->size(),
+                                     &compressed_message))
+
                 {
-                    compressed_message->swap(uncompressed_message);
+                    uncompressed_message->swap(compressed_message);
                 }
                 break;
             }
             default:
-                message->set_compress_type(Compress_None);
+                message.set_compress_type(Compress_None);
                 break;
         }
     }
-    return RPC_SUCCESS;
+
+    auto bytes = message.ByteSize();
+    DCHECK(bytes < kMaxMessageLength)
+        << "message " << message.id() << " length " << bytes << " too big.";
+    buffer->EnsureWritableBytes(bytes + kChecksumLength + sizeof(int32_t));
+
+    auto start = reinterpret_cast<uint8_t*>(buffer->BeginWrite());
+    auto end = message.SerializeWithCachedSizesToArray(start);
+    if ((end - start) != bytes)
+    {
+        ByteSizeConsistencyError(bytes,
+                                 message.ByteSize(),
+                                 static_cast<int>(end - start));
+    }
+    buffer->HasWritten(bytes);
+
+    buffer->PrependInt32(BytesChecksum(reinterpret_cast<const char*>(start), bytes));
+    buffer->PrependInt32(static_cast<int32_t>(bytes + kChecksumLength));
 }
 
 } // namespace
@@ -182,17 +351,32 @@ void RpcCodec::ParseFromBuffer(const HttpConnectionPtr& connection, Buffer* buff
         if (buffer->ReadableBytes() >= implicit_cast<size_t>(length + sizeof(int32_t)))
         {
             RpcMessage message;
-            auto error = Parse(buffer, &message);
+            PayloadField field;
+            auto error = Parse(buffer, &message, &field);
             if (error != RPC_SUCCESS)
             {
                 connection->OnError(HttpResponse::k400BadRequest,
                                     ErrorCodeToString(error));
                 break;
             }
+
+            std::string uncompressed;
+            if (Uncompress(buffer, field, &message, &uncompressed))
+            {
+                ArrayInputStream payload(uncompressed.data(),
+                                         static_cast<int>(uncompressed.size()));
+                message_callback_(connection, message, &payload);
+            }
+            else if (field.found())
+            {
+                BufferInputStream payload(buffer, field.offset, field.size);
+                message_callback_(connection, message, &payload);
+            }
             else
             {
-                message_callback_(connection, message);
+                message_callback_(connection, message, nullptr);
             }
+            buffer->Consume(length - kChecksumLength);
         }
         else
         {
@@ -203,50 +387,12 @@ void RpcCodec::ParseFromBuffer(const HttpConnectionPtr& connection, Buffer* buff
 
 void RpcCodec::SerializeToBuffer(RpcMessage& message, Buffer* buffer) const
 {
-    DCHECK(message.IsInitialized())
-        << InitializationErrorMessage("Serialize", message);
-
-    if (message.has_compress_type())
-    {
-        switch (message.compress_type())
-        {
-            case Compress_Snappy:
-            {
-                auto uncompressed_message =
-                    message.has_request() ? message.mutable_request() : message.mutable_response();
-                std::string compressed_message;
-                if (snappy::Compress(uncompressed_message->data(),
-                                     uncompressed_message->size(),
-                                     &compressed_message))
-
-                {
-                    uncompressed_message->swap(compressed_message);
-                }
-                break;
-            }
-            default:
-                message.set_compress_type(Compress_None);
-                break;
-        }
-    }
-
-    auto bytes = message.ByteSize();
-    DCHECK(bytes < kMaxMessageLength)
-        << "message " << message.id() << " length " << bytes << " too big.";
-    buffer->EnsureWritableBytes(bytes + kChecksumLength + sizeof(int32_t));
-
-    auto start = reinterpret_cast<uint8_t*>(buffer->BeginWrite());
-    auto end = message.SerializeWithCachedSizesToArray(start);
-    if ((end - start) != bytes)
-    {
-        ByteSizeConsistencyError(bytes,
-                                 message.ByteSize(),
-                                 static_cast<int>(end - start));
-    }
-    buffer->HasWritten(bytes);
+    Serialize(message, buffer);
+}
 
-    buffer->PrependInt32(BytesChecksum(buffer->Peek(), buffer->ReadableBytes()));
-    buffer->PrependInt32(static_cast<int32_t>(buffer->ReadableBytes()));
+void RpcCodec::SerializeToBuffer(RpcMessage& message, ChainBuffer* buffer) const
+{
+    Serialize(message, buffer);
 }
 
 } // namespace protorpc
@@ -8,9 +8,19 @@
 #include <boost/shared_ptr.hpp>
 #include <boost/noncopyable.hpp>
 
+namespace google {
+namespace protobuf {
+namespace io {
+
+class ZeroCopyInputStream;
+} // namespace io
+} // namespace protobuf
+} // namespace google
+
 namespace claire {
 
 class Buffer;
+class ChainBuffer;
 class HttpConnection;
 typedef boost::shared_ptr<HttpConnection> HttpConnectionPtr;
 
@@ -20,8 +30,12 @@ class RpcMessage;
 class RpcCodec : boost::noncopyable
 {
 public:
+    /// request or response field of message is set but left empty, payload
+    /// reads its bytes from the input buffer in place, uncompressed.
+    /// payload is nullptr if neither is set, and valid only in callback.
     typedef boost::function<void(const HttpConnectionPtr&,
-                                 const RpcMessage&) > MessageCallback;
+                                 const RpcMessage&,
+                                 ::google::protobuf::io::ZeroCopyInputStream* payload) > MessageCallback;
 
     RpcCodec();
 
@@ -33,6 +47,10 @@ public:
     void ParseFromBuffer(const HttpConnectionPtr& connection, Buffer* buffer) const;
     void SerializeToBuffer(RpcMessage& message, Buffer* buffer) const;
 
+    /// Serializes into one contiguous block of buffer,
+    /// so it can be sent without copying.
+    void SerializeToBuffer(RpcMessage& message, ChainBuffer* buffer) const;
+
 private:
     MessageCallback message_callback_;
 };
@@ -0,0 +1,147 @@
+// Copyright (c) 2013 The claire-protorpc Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors
+
+#pragma once
+
+// Awaitable rpc calls, needs -std=c++20. Stubs generated by
+// protoc-gen-rpc have an awaitable overload of each method then:
+//
+//   Task<void> Handle(echo::EchoService::Stub* stub)
+//   {
+//       RpcControllerPtr controller(new RpcController());
+//       echo::EchoRequest request;
+//       request.set_str("hello");
+//       auto response = co_await stub->Echo(controller, request);
+//       if (!controller->Failed()) ...
+//   }
+//
+// Server methods are served by coroutines through RunHandler.
+
+#include <atomic>
+
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <claire/common/events/Coroutine.h>
+#include <claire/protorpc/RpcChannel.h>
+#include <claire/protorpc/RpcController.h>
+#include <claire/protorpc/service.h>
+
+namespace claire {
+namespace protorpc {
+
+/// co_await of it sends request by channel, resumes in the loop awaiting
+/// it with the response, NULL if controller->Failed().
+template<typename Output>
+class RpcCall
+{
+public:
+    RpcCall(RpcChannel* channel,
+            const ::google::protobuf::MethodDescriptor* method,
+            RpcControllerPtr& controller,
+            const ::google::protobuf::Message& request)
+        : channel_(channel),
+          method_(method),
+          controller_(controller),
+          request_(request),
+          loop_(NULL),
+          state_(kPending)
+    {}
+
+    bool await_ready() const noexcept { return false; }
+
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        handle_ = handle;
+        loop_ = EventLoop::CurrentLoopInThisThread();
+        channel_->CallMethod(method_,
+                             controller_,
+                             request_,
+                             &Output::default_instance(),
+                             boost::bind(&RpcCall::OnDone, this, _1, _2));
+
+        // done may run before, even in another thread
+        int expected = kPending;
+        return state_.compare_exchange_strong(expected, kSuspended);
+    }
+
+    boost::shared_ptr<Output> await_resume()
+    {
+        return ::google::protobuf::down_pointer_cast<Output>(response_);
+    }
+
+private:
+    enum State
+    {
+        kPending,
+        kSuspended,
+        kDone
+    };
+
+    void OnDone(RpcControllerPtr&, const ::google::protobuf::MessagePtr& response)
+    {
+        response_ = response;
+        if (state_.exchange(kDone) == kSuspended)
+        {
+            ResumeIn(loop_, handle_);
+        }
+    }
+
+    RpcChannel* channel_;
+    const ::google::protobuf::MethodDescriptor* method_;
+    RpcControllerPtr& controller_;
+    const ::google::protobuf::Message& request_;
+    EventLoop* loop_;
+    std::coroutine_handle<> handle_;
+    ::google::protobuf::MessagePtr response_;
+    std::atomic<int> state_;
+};
+
+namespace detail {
+
+template<typename Output>
+Task<void> CallDone(RpcControllerPtr controller,
+                    RpcDoneCallback done,
+                    Task<boost::shared_ptr<Output> > handler)
+{
+    auto response = co_await handler;
+    done(controller, response.get());
+}
+
+} // namespace detail
+
+/// Serves a method by a coroutine, which starts at once in the loop
+/// calling the method. done is called with the response it returns,
+/// which may be NULL if it fails the controller:
+///
+///   virtual void Echo(RpcControllerPtr& controller,
+///                     const echo::EchoRequestPtr& request,
+///                     const echo::EchoResponse* responsePrototype,
+///                     const RpcDoneCallback& done)
+///   {
+///       RunHandler(controller, done, EchoAsync(controller, request));
+///   }
+///
+///   // takes arguments by value, it outlives the call of Echo
+///   Task<echo::EchoResponsePtr> EchoAsync(RpcControllerPtr controller,
+///                                         echo::EchoRequestPtr request)
+///   {
+///       auto response = boost::make_shared<echo::EchoResponse>();
+///       co_await ...
+///       co_return response;
+///   }
+///
+/// Generated services have no coroutine overload of their methods, the
+/// library is built as C++11 and its vtables must not depend on it.
+template<typename Output>
+void RunHandler(RpcControllerPtr& controller,
+                const RpcDoneCallback& done,
+                Task<boost::shared_ptr<Output> >&& handler)
+{
+    Spawn(EventLoop::CurrentLoopInThisThread(),
+          detail::CallDone<Output>(controller, done, std::move(handler)));
+}
+
+} // namespace protorpc
+} // namespace claire
@@ -18,6 +18,7 @@
 #include <claire/common/protobuf/ProtobufIO.h>
 #include <claire/common/tracing/Tracing.h>
 
+#include <claire/netty/ChainBuffer.h>
 #include <claire/netty/InetAddress.h>
 #include <claire/netty/http/HttpServer.h>
 #include <claire/netty/http/HttpRequest.h>
@@ -27,6 +28,8 @@
 #include <claire/netty/inspect/FlagsInspector.h>
 #include <claire/netty/inspect/PProfInspector.h>
 #include <claire/netty/inspect/StatisticsInspector.h>
+#include <claire/netty/inspect/ThreadsInspector.h>
+#include <claire/netty/inspect/ThreadPoolsInspector.h>
 
 #include <claire/protorpc/RpcCodec.h>
 #include <claire/protorpc/rpcmessage.pb.h> // protoc-rpc-gen
@@ -48,6 +51,8 @@ public:
           flags_(options.disable_flags ? nullptr : &server_),
           pprof_(options.disable_pprof ? nullptr : &server_),
           statistics_(options.disable_statistics  ? nullptr : &server_),
+          threads_(options.disable_threads ? nullptr : &server_),
+          threadpools_(options.disable_threadpools ? nullptr : &server_),
           total_request_("protorpc.RpcServer.total_request"),
           total_response_("protorpc.RpcServer.total_response"),
           failed_request_("protorpc.RpcServer.failed_request")
@@ -58,10 +63,12 @@ public:
                    << "\n    disable_form: " << options.disable_form
                    << "\n    disable_json: " << options.disable_json
                    << "\n    disable_statistics: " << options.disable_statistics
+                   << "\n    disable_threads: " << options.disable_threads
+                   << "\n    disable_threadpools: " << options.disable_threadpools
                    << "\n    disable_builtin_service: " << options.disable_builtin_service;
 
         codec_.set_message_callback(
-            boost::bind(&Impl::OnRequest, this, _1, _2));
+            boost::bind(&Impl::OnRequest, this, _1, _2, _3));
 
         server_.set_headers_callback(
             boost::bind(&Impl::OnHeaders, this, _1));
@@ -135,7 +142,9 @@ public:
         codec_.ParseFromBuffer(connection, buffer);
     }
 
-    void OnRequest(const HttpConnectionPtr& connection, const RpcMessage& message)
+    void OnRequest(const HttpConnectionPtr& connection,
+                   const RpcMessage& message,
+                   ::google::protobuf::io::ZeroCopyInputStream* payload)
     {
         total_request_.Increment();
 
@@ -176,7 +185,7 @@ public:
         }
 
         ::google::protobuf::MessagePtr request(service->GetRequestPrototype(method).New());
-        if (!request->ParseFromString(message.request()))
+        if (!request->ParseFromZeroCopyStream(payload))
         {
             controller->SetFailed(RPC_ERROR_PARSE_FAIL);
             OnRequestComplete(controller, nullptr);
@@ -222,7 +231,7 @@ public:
         }
         TraceContextGuard trace_context_guard;
 
-        Buffer buffer;
+        ChainBuffer buffer;
         codec_.SerializeToBuffer(message, &buffer);
         server_.SendByHttpConnectionId(context.connection_id, &buffer);
         TRACE_ANNOTATION(Annotation::server_send());
@@ -430,6 +439,8 @@ public:
     FlagsInspector flags_;
     PProfInspector pprof_;
     StatisticsInspector statistics_;
+    ThreadsInspector threads_;
+    ThreadPoolsInspector threadpools_;
 
     Counter total_request_;
     Counter total_response_;
@@ -25,6 +25,8 @@ public:
         bool disable_flags = false;
         bool disable_pprof = false;
         bool disable_statistics = false;
+        bool disable_threads = false;
+        bool disable_threadpools = false;
         bool disable_builtin_service = false;
     };
 
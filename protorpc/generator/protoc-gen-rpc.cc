@@ -154,6 +154,7 @@ void ServiceGenerator::GenerateMethodSignatures(
     map<string, string> sub_vars;
     sub_vars["classname"] = descriptor_->name();
     sub_vars["name"] = method->name();
+    sub_vars["index"] = SimpleItoa(i);
     sub_vars["input_type"] = ClassName(method->input_type(), true);
     sub_vars["output_type"] = ClassName(method->output_type(), true);
 
@@ -168,7 +169,13 @@ void ServiceGenerator::GenerateMethodSignatures(
         "using $classname$::$name$;\n"
         "virtual void $name$(::claire::protorpc::RpcControllerPtr& controller,\n"
         "                     const $input_type$& request,\n"
-        "                     const ::boost::function<void (::claire::protorpc::RpcControllerPtr& controller, const $output_type$Ptr&)>& done);\n");
+        "                     const ::boost::function<void (::claire::protorpc::RpcControllerPtr& controller, const $output_type$Ptr&)>& done);\n"
+        "#if defined(__cpp_impl_coroutine)\n"
+        "inline ::claire::protorpc::RpcCall<$output_type$> $name$(::claire::protorpc::RpcControllerPtr& controller,\n"
+        "                     const $input_type$& request) {\n"
+        "  return ::claire::protorpc::RpcCall<$output_type$>(channel_, descriptor()->method($index$), controller, request);\n"
+        "}\n"
+        "#endif\n");
     }
   }
 }
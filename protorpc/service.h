@@ -122,3 +122,8 @@ public:
 
 } // namespace protorpc
 } // namespace claire
+
+// after RpcDoneCallback, which it uses
+#if defined(__cpp_impl_coroutine)
+#include <claire/protorpc/RpcCoroutine.h> // awaitable methods of stubs
+#endif
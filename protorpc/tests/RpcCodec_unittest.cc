@@ -0,0 +1,612 @@
+#include <claire/protorpc/RpcCodec.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <zlib.h>
+#include "thirdparty/google/protobuf/wire_format_lite.h"
+#include "thirdparty/google/protobuf/io/coded_stream.h"
+#include "thirdparty/google/protobuf/io/zero_copy_stream_impl_lite.h"
+
+#include <string>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+
+#include <gtest/gtest.h>
+
+#include <claire/netty/Buffer.h>
+#include <claire/netty/Socket.h>
+#include <claire/netty/ChainBuffer.h>
+#include <claire/netty/TcpConnection.h>
+#include <claire/netty/http/HttpConnection.h>
+#include <claire/common/events/EventLoop.h>
+
+#include <claire/protorpc/BufferStream.h>
+#include <claire/protorpc/rpcmessage.pb.h> // protoc-rpc-gen
+
+using namespace claire;
+using namespace claire::protorpc;
+
+using ::google::protobuf::io::CodedOutputStream;
+using ::google::protobuf::io::StringOutputStream;
+using ::google::protobuf::io::ZeroCopyInputStream;
+using ::google::protobuf::internal::WireFormatLite;
+
+namespace {
+
+struct Received
+{
+    RpcMessage message;
+    bool has_payload;
+    std::string payload;
+};
+
+// copies the payload, which is valid only in callback
+void OnMessage(std::vector<Received>* received,
+               const HttpConnectionPtr&,
+               const RpcMessage& message,
+               ZeroCopyInputStream* payload)
+{
+    Received r;
+    r.message.CopyFrom(message);
+    r.has_payload = (payload != NULL);
+
+    const void* data;
+    int size;
+    while (payload && payload->Next(&data, &size))
+    {
+        r.payload.append(static_cast<const char*>(data), size);
+    }
+    received->push_back(r);
+}
+
+void ParseUserMessage(TraceId* user,
+                      bool* ok,
+                      const HttpConnectionPtr&,
+                      const RpcMessage&,
+                      ZeroCopyInputStream* payload)
+{
+    *ok = user->ParseFromZeroCopyStream(payload);
+}
+
+void Quit(EventLoop* loop, const TcpConnectionPtr&)
+{
+    loop->quit();
+}
+
+// bytes field with its tag, as written by protobuf
+std::string BytesField(int number, const std::string& value)
+{
+    std::string output;
+    {
+        StringOutputStream stream(&output);
+        CodedOutputStream coded(&stream);
+        WireFormatLite::WriteBytes(number, value, &coded);
+    }
+    return output;
+}
+
+std::string Header(MessageType type, uint64_t id)
+{
+    RpcMessage message;
+    message.set_type(type);
+    message.set_id(id);
+    message.set_service("EchoService");
+    message.set_method("Echo");
+    return message.SerializeAsString();
+}
+
+// length and checksum in front of message, as by SerializeToBuffer
+void AppendFrame(const std::string& message, Buffer* buffer)
+{
+    Buffer frame;
+    frame.Append(message.data(), message.size());
+    frame.PrependInt32(static_cast<int32_t>(::adler32(1,
+                                                       reinterpret_cast<const Bytef*>(message.data()),
+                                                       static_cast<uInt>(message.size()))));
+    frame.PrependInt32(static_cast<int32_t>(message.size() + sizeof(int32_t)));
+    buffer->Append(frame.Peek(), frame.ReadableBytes());
+}
+
+std::string MakePayload(size_t length)
+{
+    std::string payload(length, 0);
+    for (size_t i = 0; i < length; i++)
+    {
+        payload[i] = static_cast<char>('a' + i % 26);
+    }
+    return payload;
+}
+
+// chain of slices of at most size bytes each
+void AppendSlices(const std::string& data, size_t size, ChainBuffer* chain)
+{
+    for (size_t i = 0; i < data.size(); i += size)
+    {
+        ChainBuffer slice(data.data() + i, std::min(size, data.size() - i));
+        chain->Append(&slice);
+    }
+}
+
+std::string ReadAll(ZeroCopyInputStream* stream)
+{
+    std::string output;
+    const void* data;
+    int size;
+    while (stream->Next(&data, &size))
+    {
+        output.append(static_cast<const char*>(data), size);
+    }
+    return output;
+}
+
+} // namespace
+
+class RpcCodecTest : public ::testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds_);
+        ::fcntl(fds_[0], F_SETFL, O_NONBLOCK);
+        ::fcntl(fds_[1], F_SETFL, O_NONBLOCK);
+
+        connection_ = boost::make_shared<TcpConnection>(&loop_, Socket(fds_[0]), 1);
+        connection_->set_close_callback(boost::bind(&Quit, &loop_, _1));
+        connection_->ConnectEstablished();
+        http_connection_ = boost::make_shared<HttpConnection>(connection_);
+
+        // rpc follows the headers sent by RpcChannel
+        const char meta[] = "POST /__protorpc__ HTTP/1.1\r\nConnection: Keep-Alive\r\n\r\n";
+        Buffer headers;
+        headers.Append(meta, sizeof(meta) - 1);
+        http_connection_->Parse<HttpRequest>(&headers);
+
+        codec_.set_message_callback(boost::bind(&OnMessage, &received_, _1, _2, _3));
+    }
+
+    virtual void TearDown()
+    {
+        // wait for close of connection shut down by error
+        if (!connection_->connected())
+        {
+            ::close(fds_[1]);
+            fds_[1] = -1;
+            loop_.loop();
+        }
+        connection_->ConnectDestroyed();
+
+        if (fds_[1] >= 0)
+        {
+            ::close(fds_[1]);
+        }
+    }
+
+    // error response sent to peer, empty if none
+    std::string Response()
+    {
+        std::string response;
+        char buffer[4096];
+        ssize_t n;
+        while ((n = ::read(fds_[1], buffer, sizeof buffer)) > 0)
+        {
+            response.append(buffer, n);
+        }
+        return response;
+    }
+
+    void Parse(Buffer* buffer)
+    {
+        codec_.ParseFromBuffer(http_connection_, buffer);
+    }
+
+    EventLoop loop_;
+    int fds_[2];
+    TcpConnectionPtr connection_;
+    HttpConnectionPtr http_connection_;
+    RpcCodec codec_;
+    std::vector<Received> received_;
+};
+
+TEST_F(RpcCodecTest, RoundTrip)
+{
+    auto payload = MakePayload(100*1000);
+    Buffer buffer;
+
+    RpcMessage request;
+    request.set_type(REQUEST);
+    request.set_id(1);
+    request.set_service("EchoService");
+    request.set_method("Echo");
+    request.set_request(payload);
+    request.mutable_trace_id()->set_trace_id(10);
+    request.mutable_trace_id()->set_span_id(11);
+    codec_.SerializeToBuffer(request, &buffer);
+
+    RpcMessage response;
+    response.set_type(RESPONSE);
+    response.set_id(1);
+    response.set_response("pong");
+    response.set_error(RPC_ERROR_INVALID_METHOD);
+    Buffer frame;
+    codec_.SerializeToBuffer(response, &frame);
+    buffer.Append(frame.Peek(), frame.ReadableBytes());
+
+    Parse(&buffer);
+    EXPECT_EQ(0u, buffer.ReadableBytes());
+    ASSERT_EQ(2u, received_.size());
+
+    auto& first = received_[0];
+    EXPECT_EQ(REQUEST, first.message.type());
+    EXPECT_EQ(1u, first.message.id());
+    EXPECT_EQ("EchoService", first.message.service());
+    EXPECT_EQ("Echo", first.message.method());
+    EXPECT_EQ(10, first.message.trace_id().trace_id());
+    EXPECT_TRUE(first.message.has_request());
+    EXPECT_FALSE(first.message.has_response());
+
+    // payload is read from buffer, not kept in message
+    EXPECT_TRUE(first.message.request().empty());
+    EXPECT_TRUE(first.has_payload);
+    EXPECT_EQ(payload, first.payload);
+
+    auto& second = received_[1];
+    EXPECT_EQ(RESPONSE, second.message.type());
+    EXPECT_EQ(RPC_ERROR_INVALID_METHOD, second.message.error());
+    EXPECT_TRUE(second.message.has_response());
+    EXPECT_EQ("pong", second.payload);
+    EXPECT_EQ("", Response());
+}
+
+TEST_F(RpcCodecTest, ParseUserMessageInPlace)
+{
+    TraceId user;
+    user.set_trace_id(123456789012LL);
+    user.set_span_id(42);
+
+    RpcMessage message;
+    message.set_type(REQUEST);
+    message.set_id(2);
+    message.set_request(user.SerializeAsString());
+    Buffer buffer;
+    codec_.SerializeToBuffer(message, &buffer);
+
+    TraceId parsed;
+    bool ok = false;
+    codec_.set_message_callback(boost::bind(&ParseUserMessage, &parsed, &ok, _1, _2, _3));
+    Parse(&buffer);
+
+    EXPECT_TRUE(ok);
+    EXPECT_EQ(123456789012LL, parsed.trace_id());
+    EXPECT_EQ(42, parsed.span_id());
+}
+
+TEST_F(RpcCodecTest, PayloadPosition)
+{
+    Buffer buffer;
+    AppendFrame(BytesField(RpcMessage::kRequestFieldNumber, "first") + Header(REQUEST, 1), &buffer);
+
+    // fields before and after payload are merged
+    RpcMessage before;
+    before.set_type(REQUEST);
+    before.set_id(2);
+    RpcMessage after;
+    after.set_service("EchoService");
+    after.set_method("Echo");
+    AppendFrame(before.SerializePartialAsString()
+                + BytesField(RpcMessage::kRequestFieldNumber, "middle")
+                + after.SerializePartialAsString(),
+                &buffer);
+
+    AppendFrame(Header(REQUEST, 3) + BytesField(RpcMessage::kRequestFieldNumber, "last"), &buffer);
+
+    Parse(&buffer);
+    EXPECT_EQ(0u, buffer.ReadableBytes());
+    ASSERT_EQ(3u, received_.size());
+
+    const char* payloads[] = { "first", "middle", "last" };
+    for (size_t i = 0; i < received_.size(); i++)
+    {
+        auto& r = received_[i];
+        EXPECT_EQ(i + 1, r.message.id());
+        EXPECT_EQ("EchoService", r.message.service());
+        EXPECT_EQ("Echo", r.message.method());
+        EXPECT_TRUE(r.message.has_request());
+        EXPECT_EQ(payloads[i], r.payload);
+    }
+}
+
+TEST_F(RpcCodecTest, DuplicateFields)
+{
+    // last payload overrides former ones, as by protobuf
+    Buffer buffer;
+    AppendFrame(Header(REQUEST, 1)
+                + BytesField(RpcMessage::kRequestFieldNumber, "old")
+                + BytesField(RpcMessage::kRequestFieldNumber, "new"),
+                &buffer);
+
+    // so does a later non payload field
+    AppendFrame(Header(REQUEST, 2)
+                + BytesField(RpcMessage::kRequestFieldNumber, "payload")
+                + Header(RESPONSE, 3),
+                &buffer);
+
+    Parse(&buffer);
+    ASSERT_EQ(2u, received_.size());
+    EXPECT_EQ("new", received_[0].payload);
+    EXPECT_EQ(1u, received_[0].message.id());
+
+    EXPECT_EQ("payload", received_[1].payload);
+    EXPECT_EQ(RESPONSE, received_[1].message.type());
+    EXPECT_EQ(3u, received_[1].message.id());
+}
+
+TEST_F(RpcCodecTest, RequestAndResponse)
+{
+    // only the last payload field is kept
+    Buffer buffer;
+    AppendFrame(Header(RESPONSE, 1)
+                + BytesField(RpcMessage::kRequestFieldNumber, "request")
+                + BytesField(RpcMessage::kResponseFieldNumber, "response"),
+                &buffer);
+    AppendFrame(Header(REQUEST, 2)
+                + BytesField(RpcMessage::kResponseFieldNumber, "response")
+                + BytesField(RpcMessage::kRequestFieldNumber, "request"),
+                &buffer);
+
+    Parse(&buffer);
+    ASSERT_EQ(2u, received_.size());
+    EXPECT_FALSE(received_[0].message.has_request());
+    EXPECT_TRUE(received_[0].message.has_response());
+    EXPECT_EQ("response", received_[0].payload);
+
+    EXPECT_TRUE(received_[1].message.has_request());
+    EXPECT_FALSE(received_[1].message.has_response());
+    EXPECT_EQ("request", received_[1].payload);
+}
+
+TEST_F(RpcCodecTest, EmptyPayload)
+{
+    Buffer buffer;
+    RpcMessage empty;
+    empty.set_type(REQUEST);
+    empty.set_id(1);
+    empty.set_request("");
+    codec_.SerializeToBuffer(empty, &buffer);
+
+    // neither request nor response
+    Buffer frame;
+    RpcMessage none;
+    none.set_type(RESPONSE);
+    none.set_id(2);
+    none.set_error(RPC_ERROR_REQUEST_TIMEOUT);
+    codec_.SerializeToBuffer(none, &frame);
+    buffer.Append(frame.Peek(), frame.ReadableBytes());
+
+    Parse(&buffer);
+    ASSERT_EQ(2u, received_.size());
+    EXPECT_TRUE(received_[0].message.has_request());
+    EXPECT_TRUE(received_[0].has_payload);
+    EXPECT_EQ("", received_[0].payload);
+
+    EXPECT_FALSE(received_[1].message.has_request());
+    EXPECT_FALSE(received_[1].message.has_response());
+    EXPECT_FALSE(received_[1].has_payload);
+    EXPECT_EQ(RPC_ERROR_REQUEST_TIMEOUT, received_[1].message.error());
+}
+
+TEST_F(RpcCodecTest, Snappy)
+{
+    auto payload = MakePayload(100*1000);
+    Buffer buffer;
+
+    RpcMessage request;
+    request.set_type(REQUEST);
+    request.set_id(1);
+    request.set_compress_type(Compress_Snappy);
+    request.set_request(payload);
+    codec_.SerializeToBuffer(request, &buffer);
+    EXPECT_GT(payload.size(), buffer.ReadableBytes());
+
+    Buffer frame;
+    RpcMessage empty;
+    empty.set_type(RESPONSE);
+    empty.set_id(2);
+    empty.set_compress_type(Compress_Snappy);
+    empty.set_response("");
+    codec_.SerializeToBuffer(empty, &frame);
+    buffer.Append(frame.Peek(), frame.ReadableBytes());
+
+    Parse(&buffer);
+    ASSERT_EQ(2u, received_.size());
+    EXPECT_EQ(Compress_Snappy, received_[0].message.compress_type());
+    EXPECT_EQ(payload, received_[0].payload);
+
+    EXPECT_TRUE(received_[1].message.has_response());
+    EXPECT_TRUE(received_[1].has_payload);
+    EXPECT_EQ("", received_[1].payload);
+}
+
+TEST_F(RpcCodecTest, PartialFrame)
+{
+    RpcMessage message;
+    message.set_type(REQUEST);
+    message.set_id(1);
+    message.set_request("hello");
+    Buffer frame;
+    codec_.SerializeToBuffer(message, &frame);
+
+    // waits for the rest, even of length
+    std::string bytes(frame.Peek(), frame.ReadableBytes());
+    Buffer buffer;
+    for (size_t i = 0; i < bytes.size() - 1; i++)
+    {
+        buffer.Append(&bytes[i], 1);
+        Parse(&buffer);
+        ASSERT_EQ(0u, received_.size());
+        ASSERT_EQ(i + 1, buffer.ReadableBytes());
+    }
+
+    buffer.Append(&bytes[bytes.size()-1], 1);
+    Parse(&buffer);
+    ASSERT_EQ(1u, received_.size());
+    EXPECT_EQ("hello", received_[0].payload);
+}
+
+TEST_F(RpcCodecTest, TruncatedVarint)
+{
+    // length of payload ends with the message
+    Buffer buffer;
+    AppendFrame(Header(REQUEST, 1) + "\x2a\x80", &buffer);
+    Parse(&buffer);
+
+    EXPECT_EQ(0u, received_.size());
+    EXPECT_NE(std::string::npos, Response().find("RPC_ERROR_PARSE_FAIL"));
+}
+
+TEST_F(RpcCodecTest, CorruptVarint)
+{
+    // more than 10 bytes of varint
+    Buffer buffer;
+    AppendFrame(Header(REQUEST, 1) + "\x2a" + std::string(11, '\xff') + "\x01", &buffer);
+    Parse(&buffer);
+
+    EXPECT_EQ(0u, received_.size());
+    EXPECT_NE(std::string::npos, Response().find("RPC_ERROR_PARSE_FAIL"));
+}
+
+TEST_F(RpcCodecTest, PayloadBeyondMessage)
+{
+    Buffer buffer;
+    AppendFrame(Header(REQUEST, 1) + "\x2a\x10" + "abc", &buffer);
+    Parse(&buffer);
+
+    EXPECT_EQ(0u, received_.size());
+    EXPECT_NE(std::string::npos, Response().find("RPC_ERROR_PARSE_FAIL"));
+}
+
+TEST_F(RpcCodecTest, CorruptVarintBeforePayload)
+{
+    // id of varint type instead of fixed64, truncated
+    Buffer buffer;
+    AppendFrame(std::string("\x08\x01\x10\xff", 4) + BytesField(RpcMessage::kRequestFieldNumber, "abc"), &buffer);
+    Parse(&buffer);
+
+    EXPECT_EQ(0u, received_.size());
+    EXPECT_NE(std::string::npos, Response().find("RPC_ERROR_PARSE_FAIL"));
+}
+
+TEST_F(RpcCodecTest, MissingRequiredField)
+{
+    Buffer buffer;
+    RpcMessage message;
+    message.set_service("EchoService");
+    AppendFrame(message.SerializePartialAsString() + BytesField(RpcMessage::kRequestFieldNumber, "abc"), &buffer);
+    Parse(&buffer);
+
+    EXPECT_EQ(0u, received_.size());
+    EXPECT_NE(std::string::npos, Response().find("RPC_ERROR_PARSE_FAIL"));
+}
+
+TEST_F(RpcCodecTest, InvalidChecksum)
+{
+    RpcMessage message;
+    message.set_type(REQUEST);
+    message.set_id(1);
+    message.set_request("hello");
+    Buffer frame;
+    codec_.SerializeToBuffer(message, &frame);
+
+    std::string bytes(frame.Peek(), frame.ReadableBytes());
+    bytes[bytes.size()-1] ^= 1;
+    Buffer buffer;
+    buffer.Append(bytes.data(), bytes.size());
+    Parse(&buffer);
+
+    EXPECT_EQ(0u, received_.size());
+    EXPECT_NE(std::string::npos, Response().find("RPC_ERROR_INVALID_CHECKSUM"));
+}
+
+TEST(ChainBufferInputStreamTest, AcrossSlices)
+{
+    auto data = MakePayload(1000);
+    ChainBuffer chain;
+    AppendSlices(data, 7, &chain);
+    ASSERT_LT(1u, chain.SliceCount());
+
+    ChainBufferInputStream stream(&chain);
+    EXPECT_EQ(data, ReadAll(&stream));
+    EXPECT_EQ(1000, stream.ByteCount());
+
+    // window starts and ends within slices
+    ChainBufferInputStream window(&chain, 10, 500);
+    EXPECT_EQ(data.substr(10, 500), ReadAll(&window));
+    EXPECT_EQ(500, window.ByteCount());
+
+    ChainBufferInputStream empty(&chain, 1000, 0);
+    const void* d;
+    int size;
+    EXPECT_FALSE(empty.Next(&d, &size));
+}
+
+TEST(ChainBufferInputStreamTest, BackUpAndSkip)
+{
+    auto data = MakePayload(100);
+    ChainBuffer chain;
+    AppendSlices(data, 10, &chain);
+
+    ChainBufferInputStream stream(&chain);
+    const void* d;
+    int size;
+    ASSERT_TRUE(stream.Next(&d, &size));
+    ASSERT_EQ(10, size);
+
+    // backed up bytes are returned again
+    stream.BackUp(4);
+    EXPECT_EQ(6, stream.ByteCount());
+    ASSERT_TRUE(stream.Next(&d, &size));
+    EXPECT_EQ(data.substr(6, 4), std::string(static_cast<const char*>(d), size));
+    EXPECT_EQ(10, stream.ByteCount());
+
+    // skips into the middle of a later slice
+    EXPECT_TRUE(stream.Skip(25));
+    EXPECT_EQ(35, stream.ByteCount());
+    ASSERT_TRUE(stream.Next(&d, &size));
+    EXPECT_EQ(data.substr(35, 5), std::string(static_cast<const char*>(d), size));
+
+    stream.BackUp(size);
+    EXPECT_TRUE(stream.Skip(65));
+    EXPECT_EQ(100, stream.ByteCount());
+    EXPECT_FALSE(stream.Next(&d, &size));
+
+    // skip past the end stops at the end
+    ChainBufferInputStream past(&chain, 0, 50);
+    EXPECT_FALSE(past.Skip(60));
+    EXPECT_EQ(50, past.ByteCount());
+}
+
+TEST(ChainBufferInputStreamTest, ParseAcrossSlices)
+{
+    RpcMessage message;
+    message.set_type(REQUEST);
+    message.set_id(1);
+    message.set_service("EchoService");
+    message.set_method("Echo");
+    message.set_request(MakePayload(300));
+    auto bytes = "head" + message.SerializeAsString() + "tail";
+
+    // every field and varint crosses slices
+    for (size_t size = 1; size <= 16; size++)
+    {
+        ChainBuffer chain;
+        AppendSlices(bytes, size, &chain);
+
+        ChainBufferInputStream stream(&chain, 4, bytes.size() - 8);
+        RpcMessage parsed;
+        ASSERT_TRUE(parsed.ParseFromZeroCopyStream(&stream)) << size;
+        EXPECT_EQ(message.SerializeAsString(), parsed.SerializeAsString());
+    }
+}
@@ -13,13 +13,17 @@
 #include <boost/bind.hpp>
 #include <boost/shared_ptr.hpp>
 
-#include <claire/common/base/BlockingQueue.h>
+#include <claire/common/base/BoundedBlockingQueue.h>
 #include <claire/common/threading/Thread.h>
 #include <claire/common/time/Timestamp.h>
+#include <claire/common/logging/Logging.h>
 #include <claire/netty/InetAddress.h>
 
 #include <claire/zipkin/scribe.h>
 
+DEFINE_int32(scribe_queue_size, 65536, "max log entries queued by ScribeClient, newer ones are dropped when full");
+DEFINE_int32(scribe_batch_size, 256, "max log entries sent by ScribeClient in one request");
+
 namespace claire {
 
 class ScribeClient::Impl
@@ -31,6 +35,7 @@ public:
           protocol_(new apache::thrift::protocol::TBinaryProtocol(transport_)),
           client_(protocol_, protocol_),
           io_thread_(boost::bind(&Impl::ThreadEntry, this), "ScribeClient"),
+          queue_(FLAGS_scribe_queue_size, BoundedBlockingQueue<scribe::thrift::LogEntry>::kDropNewest),
           running_(false)
     {
         TryConnect();
@@ -55,7 +60,7 @@ public:
         scribe::thrift::LogEntry e;
         e.__set_category(category);
         e.__set_message(message);
-        queue_.Put(e);
+        queue_.Put(std::move(e));
 
         TryConnect();
     }
@@ -86,11 +91,26 @@ private:
 
     void ThreadEntry()
     {
+        int64_t reported_dropped = 0;
+        Timestamp last_report;
         while (running_)
         {
+            // timeout lets destructor stop the thread when idle
             std::vector<scribe::thrift::LogEntry> logs;
-            logs.push_back(queue_.Take());
-            client_.Log(logs);
+            if (queue_.TakeBatch(&logs, FLAGS_scribe_batch_size, 100) > 0)
+            {
+                client_.Log(logs);
+            }
+
+            auto dropped = queue_.dropped();
+            if (dropped > reported_dropped
+                && (!last_report.Valid() || TimeDifference(Timestamp::Now(), last_report) >= 1000000))
+            {
+                LOG(WARNING) << "ScribeClient dropped " << dropped - reported_dropped
+                             << " log entries, queue of " << queue_.capacity() << " is full";
+                reported_dropped = dropped;
+                last_report = Timestamp::Now();
+            }
         }
     }
 
@@ -99,7 +119,7 @@ private:
     boost::shared_ptr<apache::thrift::protocol::TProtocol> protocol_;
     scribe::thrift::scribeClient client_;
     Thread io_thread_;
-    BlockingQueue<scribe::thrift::LogEntry> queue_;
+    BoundedBlockingQueue<scribe::thrift::LogEntry> queue_;
     bool running_;
     Timestamp last_connect_timestamp_;
 };